@@ -0,0 +1,682 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "reader.h"
+#include "symtab.h"
+#include "cgen.h"
+
+/* The translator runs the stack code of each routine on a stack of C
+ * expressions. Loads and arithmetic build expressions; stores, calls and
+ * jumps print statements. Addresses are WORD pointers, so the word
+ * offsets of the stack code become C pointer arithmetic. */
+
+enum CEntryKind {
+  CE_RESERVED,      // a frame word reserved for a call
+  CE_VALUE,
+  CE_ADDRESS
+};
+
+typedef struct {
+  enum CEntryKind kind;
+  char* text;
+  char* lvalue;     // the variable, for the address of a scalar
+  int readsMemory;  // whether a store or a call may change the value
+} CEntry;
+
+CodeBlock* cCode;
+FILE* cOut;
+int* cOwner;
+int* cParent;
+char** cInStruct;      // per routine and slot: lives in the frame struct
+char** cIsUsed;        // per routine and slot: the code refers to it
+int* cHasStruct;
+char** cNames;
+char* cIsLabel;
+
+CEntry* cStack;
+int cDepth;
+int cMaxDepth;
+int cTempCount;
+
+char* formatText(const char* format, ...) {
+  va_list args;
+  char* text;
+  int size;
+
+  va_start(args, format);
+  size = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  text = (char*) malloc(size + 1);
+  va_start(args, format);
+  vsnprintf(text, size + 1, format, args);
+  va_end(args);
+  return text;
+}
+
+char* lowerName(char* prefix, char* name) {
+  char* text = formatText("%s%s", prefix, name);
+  char* c;
+  for (c = text; *c != '\0'; c++)
+    *c = tolower(*c);
+  return text;
+}
+
+/******************* Routines and frames ******************************/
+
+int isProgram(int routine) {
+  return cParent[routine] < 0;
+}
+
+int ancestorOf(int routine, int distance) {
+  if (distance == PROGRAM_FRAME)
+    distance = cCode->routines[routine].level;
+  while (distance-- > 0)
+    routine = cParent[routine];
+  return routine;
+}
+
+/* The environment pointer of the frame distance (> 0) levels up */
+char* upChain(int distance) {
+  char* text = formatText("up");
+  char* longer;
+  while (--distance > 0) {
+    longer = formatText("%s->up", text);
+    free(text);
+    text = longer;
+  }
+  return text;
+}
+
+char* slotName(Routine* routine, FrameSlot* slot, int program) {
+  if (slot->name[0] == '\0')
+    return formatText("result");
+  return lowerName(program ? "g_" : "v_", slot->name);
+}
+
+/* How the code of routine r reaches a slot of the frame distance levels up */
+char* slotAccess(int r, int distance, FrameSlot* slot) {
+  int target = ancestorOf(r, distance);
+  Routine* routine = &(cCode->routines[target]);
+  char* name = slotName(routine, slot, isProgram(target));
+  char* chain;
+  char* text;
+
+  if (isProgram(target))
+    return name;
+  if (distance == 0) {
+    if (!cInStruct[target][slot - routine->slots])
+      return name;
+    text = formatText("f.%s", name);
+  } else {
+    chain = upChain(distance);
+    text = formatText("%s->%s", chain, name);
+    free(chain);
+  }
+  free(name);
+  return text;
+}
+
+FrameSlot* slotAt(int r, int distance, int offset) {
+  FrameSlot* slot = findFrameSlot(&(cCode->routines[ancestorOf(r, distance)]), offset);
+  if (slot == NULL) {
+    fprintf(stderr, "cgen: no variable at offset %d\n", offset);
+    exit(1);
+  }
+  return slot;
+}
+
+/* Marks the slots the code uses, and those that nested routines use:
+ * these go in frame structs */
+void findSharedSlots(void) {
+  Instruction* inst;
+  FrameSlot* slot;
+  int i, r, target;
+
+  for (r = 0; r < cCode->routineCount; r++) {
+    cInStruct[r] = (char*) calloc(cCode->routines[r].slotCount + 1, 1);
+    cIsUsed[r] = (char*) calloc(cCode->routines[r].slotCount + 1, 1);
+    cHasStruct[r] = 0;
+  }
+  for (r = 0; r < cCode->routineCount; r++)
+    if (cParent[r] >= 0 && !isProgram(cParent[r]))
+      cHasStruct[cParent[r]] = 1;
+
+  for (i = 0; i < cCode->codeSize; i++) {
+    inst = &(cCode->code[i]);
+    if ((inst->op != OP_LA && inst->op != OP_LV) || cOwner[i] < 0)
+      continue;
+    target = ancestorOf(cOwner[i], inst->p);
+    slot = slotAt(cOwner[i], inst->p, inst->q);
+    cIsUsed[target][slot - cCode->routines[target].slots] = 1;
+    if (inst->p > 0 && !isProgram(target))
+      cInStruct[target][slot - cCode->routines[target].slots] = 1;
+  }
+}
+
+void printDeclaration(FrameSlot* slot, char* name) {
+  int d;
+
+  if (slot->kind == SLOT_REFERENCE)
+    fprintf(cOut, "WORD* %s", name);
+  else {
+    fprintf(cOut, "WORD %s", name);
+    for (d = 0; d < slot->dimCount; d++)
+      fprintf(cOut, "[%d]", slot->dims[d]);
+  }
+}
+
+void printStructs(void) {
+  Routine* routine;
+  FrameSlot* slot;
+  char* name;
+  int r, i, fields;
+
+  for (r = 0; r < cCode->routineCount; r++)
+    if (cHasStruct[r])
+      fprintf(cOut, "struct frame_%s;\n", cNames[r]);
+
+  for (r = 0; r < cCode->routineCount; r++) {
+    if (!cHasStruct[r])
+      continue;
+    routine = &(cCode->routines[r]);
+    fields = 0;
+    fprintf(cOut, "\nstruct frame_%s {\n", cNames[r]);
+    if (!isProgram(cParent[r])) {
+      fprintf(cOut, "  struct frame_%s* up;\n", cNames[cParent[r]]);
+      fields++;
+    }
+    for (i = 0; i < routine->slotCount; i++) {
+      slot = &(routine->slots[i]);
+      if (!cInStruct[r][i])
+        continue;
+      name = slotName(routine, slot, 0);
+      fprintf(cOut, "  ");
+      printDeclaration(slot, name);
+      fprintf(cOut, ";\n");
+      free(name);
+      fields++;
+    }
+    if (fields == 0)
+      fprintf(cOut, "  char unused;\n");
+    fprintf(cOut, "};\n");
+  }
+}
+
+void printHeader(int r) {
+  Routine* routine = &(cCode->routines[r]);
+  FrameSlot* slot;
+  char* name;
+  int i, first = 1;
+
+  fprintf(cOut, "static %s %s(", routine->kind == RT_FUNCTION ? "WORD" : "void", cNames[r]);
+  if (!isProgram(cParent[r])) {
+    fprintf(cOut, "struct frame_%s* up", cNames[cParent[r]]);
+    first = 0;
+  }
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    if (!slot->isParameter)
+      continue;
+    if (!first)
+      fprintf(cOut, ", ");
+    name = slotName(routine, slot, 0);
+    printDeclaration(slot, name);
+    free(name);
+    first = 0;
+  }
+  if (first)
+    fprintf(cOut, "void");
+  fprintf(cOut, ")");
+}
+
+void printGlobals(int program) {
+  Routine* routine = &(cCode->routines[program]);
+  char* name;
+  int i;
+
+  for (i = 0; i < routine->slotCount; i++) {
+    if (!cIsUsed[program][i])
+      continue;
+    name = slotName(routine, &(routine->slots[i]), 1);
+    fprintf(cOut, "static ");
+    printDeclaration(&(routine->slots[i]), name);
+    fprintf(cOut, ";\n");
+    free(name);
+  }
+}
+
+void printLocals(int r) {
+  Routine* routine = &(cCode->routines[r]);
+  FrameSlot* slot;
+  char* name;
+  int i;
+
+  if (cHasStruct[r]) {
+    fprintf(cOut, "  struct frame_%s f;\n", cNames[r]);
+    if (!isProgram(cParent[r]))
+      fprintf(cOut, "  f.up = up;\n");
+  }
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    name = slotName(routine, slot, 0);
+    if (cInStruct[r][i]) {
+      if (slot->isParameter)
+        fprintf(cOut, "  f.%s = %s;\n", name, name);
+    } else if (slot->name[0] == '\0')
+      fprintf(cOut, "  WORD result = 0;\n");
+    else if (!slot->isParameter && cIsUsed[r][i]) {
+      fprintf(cOut, "  ");
+      printDeclaration(slot, name);
+      fprintf(cOut, ";\n");
+    }
+    free(name);
+  }
+}
+
+/******************* The expression stack ******************************/
+
+CEntry* pushEntry(enum CEntryKind kind, char* text, int readsMemory) {
+  CEntry* entry;
+
+  if (cDepth == cMaxDepth) {
+    cMaxDepth *= 2;
+    cStack = (CEntry*) realloc(cStack, cMaxDepth * sizeof(CEntry));
+  }
+  entry = &(cStack[cDepth++]);
+  entry->kind = kind;
+  entry->text = text;
+  entry->lvalue = NULL;
+  entry->readsMemory = readsMemory;
+  return entry;
+}
+
+void dropEntry(CEntry* entry) {
+  free(entry->text);
+  free(entry->lvalue);
+}
+
+/* Evaluates an entry into a fresh temporary now */
+void materializeEntry(CEntry* entry) {
+  char* temp = formatText("t%d", ++cTempCount);
+
+  fprintf(cOut, "  %s %s = %s;\n", entry->kind == CE_ADDRESS ? "WORD*" : "WORD", temp, entry->text);
+  dropEntry(entry);
+  entry->text = temp;
+  entry->lvalue = NULL;
+  entry->readsMemory = 0;
+}
+
+/* Before memory changes, pending reads are done in stack order */
+void protectEntries(void) {
+  int i;
+  for (i = 0; i < cDepth; i++)
+    if (cStack[i].readsMemory)
+      materializeEntry(&(cStack[i]));
+}
+
+void checkEmptyStack(CodeAddress address) {
+  if (cDepth != 0) {
+    fprintf(stderr, "cgen: values left on the stack at %d\n", address);
+    exit(1);
+  }
+}
+
+/* A DCT before a CALL drops the reserved words of the frame and the
+ * arguments above them; any other DCT drops values only */
+void checkDroppedEntries(CodeAddress address, int count, int calling) {
+  int reserved = calling ? RESERVED_WORDS : 0;
+  int valid = (count >= reserved && count <= cDepth);
+  int k;
+
+  for (k = 0; valid && k < count; k++)
+    valid = ((cStack[cDepth - count + k].kind == CE_RESERVED) == (k < reserved));
+  if (!valid) {
+    fprintf(stderr, "cgen: unexpected DCT %d at %d\n", count, address);
+    exit(1);
+  }
+}
+
+char* constantText(WORD value) {
+  if (value == (WORD) 0x80000000)
+    return formatText("(-2147483647 - 1)");
+  return formatText(value < 0 ? "(%d)" : "%d", value);
+}
+
+/******************* Translation ******************************/
+
+void translateAddress(int r, Instruction* inst) {
+  FrameSlot* slot = slotAt(r, inst->p, inst->q);
+  char* access = slotAccess(r, inst->p, slot);
+  CEntry* entry;
+  int offset = inst->q - slot->offset;
+
+  if (slot->kind == SLOT_ARRAY) {
+    if (offset == 0)
+      pushEntry(CE_ADDRESS, formatText("(WORD*) %s", access), 0);
+    else pushEntry(CE_ADDRESS, formatText("((WORD*) %s + %d)", access, offset), 0);
+    free(access);
+  } else {
+    entry = pushEntry(CE_ADDRESS, formatText("&%s", access), 0);
+    entry->lvalue = access;
+  }
+}
+
+void translateValue(int r, Instruction* inst) {
+  FrameSlot* slot = slotAt(r, inst->p, inst->q);
+  char* access = slotAccess(r, inst->p, slot);
+
+  // VAR parameters are never assigned, only written through
+  if (slot->kind == SLOT_REFERENCE)
+    pushEntry(CE_ADDRESS, access, 0);
+  else pushEntry(CE_VALUE, access, 1);
+}
+
+void translateBinary(Instruction* inst) {
+  CEntry* left = &(cStack[cDepth - 2]);
+  CEntry* right = &(cStack[cDepth - 1]);
+  enum CEntryKind kind = CE_VALUE;
+  int readsMemory = left->readsMemory || right->readsMemory;
+  char* text;
+
+  switch (inst->op) {
+  case OP_AD:
+    kind = (right->kind == CE_ADDRESS) ? CE_ADDRESS : left->kind;
+    text = formatText("(%s + %s)", left->text, right->text);
+    break;
+  case OP_SB:
+    kind = left->kind;
+    text = formatText("(%s - %s)", left->text, right->text);
+    break;
+  case OP_ML:
+    text = formatText("(%s * %s)", left->text, right->text);
+    break;
+  case OP_DV:
+    text = formatText("kplDiv(%s, %s)", left->text, right->text);
+    break;
+  default: {
+    static char* operators[] = { "==", "!=", ">", "<", ">=", "<=" };
+    text = formatText("(%s %s %s)", left->text, operators[inst->op - OP_EQ], right->text);
+    break;
+  }
+  }
+  dropEntry(left);
+  dropEntry(right);
+  cDepth -= 2;
+  pushEntry(kind, text, readsMemory);
+}
+
+void translateCall(int r, Instruction* inst, CEntry* args, int argCount) {
+  int callee, i;
+  char* up = NULL;
+  char* call;
+  char* longer;
+
+  for (callee = 0; callee < cCode->routineCount; callee++)
+    if (cCode->routines[callee].entry == inst->q)
+      break;
+
+  protectEntries();
+  if (!isProgram(cParent[callee]))
+    up = (inst->p == 0) ? formatText("&f") : upChain(inst->p);
+
+  call = formatText("%s(%s", cNames[callee], up != NULL ? up : "");
+  for (i = 0; i < argCount; i++) {
+    longer = formatText("%s%s%s", call, (i > 0 || up != NULL) ? ", " : "", args[i].text);
+    free(call);
+    call = longer;
+    dropEntry(&(args[i]));
+  }
+  free(up);
+
+  if (cCode->routines[callee].kind == RT_FUNCTION) {
+    fprintf(cOut, "  WORD t%d = %s);\n", ++cTempCount, call);
+    pushEntry(CE_VALUE, formatText("t%d", cTempCount), 0);
+  } else fprintf(cOut, "  %s);\n", call);
+  free(call);
+}
+
+void translateRoutineCode(int r) {
+  Routine* routine = &(cCode->routines[r]);
+  CEntry args[256];
+  CEntry* entry;
+  Instruction* inst;
+  CodeAddress i = routine->entry;
+  int argCount = 0;
+  int calling;
+  int k;
+  char* text;
+
+  // Skip the jump over nested routines and the frame allocation
+  if (cCode->code[i].op == OP_J)
+    i = cCode->code[i].q;
+  if (cCode->code[i].op == OP_INT)
+    i++;
+
+  cDepth = 0;
+  for (; i < cCode->codeSize; i++) {
+    if (cOwner[i] != r)
+      continue;
+    inst = &(cCode->code[i]);
+    if (cIsLabel[i]) {
+      checkEmptyStack(i);
+      fprintf(cOut, " L%d:;\n", i);
+    }
+
+    switch (inst->op) {
+    case OP_LA:
+      translateAddress(r, inst);
+      break;
+    case OP_LV:
+      translateValue(r, inst);
+      break;
+    case OP_LC:
+      pushEntry(CE_VALUE, constantText(inst->q), 0);
+      break;
+    case OP_LI:
+      entry = &(cStack[cDepth - 1]);
+      if (entry->lvalue != NULL) {
+        text = entry->lvalue;
+        entry->lvalue = NULL;
+      } else text = formatText("*%s", entry->text);
+      dropEntry(entry);
+      entry->kind = CE_VALUE;
+      entry->text = text;
+      entry->readsMemory = 1;
+      break;
+    case OP_INT:
+      for (k = 0; k < inst->q; k++)
+        pushEntry(CE_RESERVED, NULL, 0);
+      break;
+    case OP_DCT:
+      // Either the frame of the CALL that follows, or values dropped on
+      // their own; anything else is code this backend cannot translate
+      calling = (i + 1 < cCode->codeSize && cCode->code[i + 1].op == OP_CALL);
+      checkDroppedEntries(i, inst->q, calling);
+      if (calling) {
+        // The arguments wait for the CALL
+        argCount = inst->q - RESERVED_WORDS;
+        for (k = 0; k < argCount; k++)
+          args[k] = cStack[cDepth - argCount + k];
+        cDepth -= inst->q;
+      } else {
+        // Values dropped for their side effects, a check or a division
+        // that may trap, are still evaluated, in stack order
+        for (k = cDepth - inst->q; k < cDepth; k++) {
+          if (cStack[k].text != NULL)
+            fprintf(cOut, "  (void) (%s);\n", cStack[k].text);
+          dropEntry(&(cStack[k]));
+        }
+        cDepth -= inst->q;
+      }
+      break;
+    case OP_J:
+      checkEmptyStack(i);
+      fprintf(cOut, "  goto L%d;\n", inst->q);
+      break;
+    case OP_FJ:
+      entry = &(cStack[--cDepth]);
+      checkEmptyStack(i);
+      fprintf(cOut, "  if (!%s) goto L%d;\n", entry->text, inst->q);
+      dropEntry(entry);
+      break;
+    case OP_HL:
+      fprintf(cOut, "  return 0;\n");
+      break;
+    case OP_ST:
+      entry = &(cStack[cDepth - 2]);
+      cDepth -= 2;
+      protectEntries();
+      if (entry->lvalue != NULL)
+        fprintf(cOut, "  %s = %s;\n", entry->lvalue, entry[1].text);
+      else fprintf(cOut, "  *%s = %s;\n", entry->text, entry[1].text);
+      dropEntry(entry);
+      dropEntry(entry + 1);
+      break;
+    case OP_CALL:
+      translateCall(r, inst, args, argCount);
+      argCount = 0;
+      break;
+    case OP_EP:
+      fprintf(cOut, "  return;\n");
+      break;
+    case OP_EF:
+      text = slotAccess(r, 0, &(routine->slots[0]));
+      fprintf(cOut, "  return %s;\n", text);
+      free(text);
+      break;
+    case OP_RC:
+    case OP_RI:
+      fprintf(cOut, "  WORD t%d = %s();\n", ++cTempCount, inst->op == OP_RC ? "kplReadChar" : "kplReadInt");
+      pushEntry(CE_VALUE, formatText("t%d", cTempCount), 0);
+      break;
+    case OP_WRC:
+    case OP_WRI:
+      entry = &(cStack[--cDepth]);
+      fprintf(cOut, "  %s(%s);\n", inst->op == OP_WRC ? "kplWriteChar" : "kplWriteInt", entry->text);
+      dropEntry(entry);
+      break;
+    case OP_WLN:
+      fprintf(cOut, "  kplWriteLn();\n");
+      break;
+    case OP_NEG:
+      entry = &(cStack[cDepth - 1]);
+      text = formatText("(-%s)", entry->text);
+      free(entry->text);
+      entry->text = text;
+      break;
+    case OP_CK:
+      entry = &(cStack[cDepth - 1]);
+      text = formatText("kplCheck(%s, %d)", entry->text, inst->q);
+      free(entry->text);
+      entry->text = text;
+      break;
+    case OP_CV:
+      materializeEntry(&(cStack[cDepth - 1]));
+      entry = pushEntry(cStack[cDepth - 1].kind, NULL, 0);
+      entry->text = formatText("%s", cStack[cDepth - 2].text);
+      break;
+    default:
+      translateBinary(inst);
+      break;
+    }
+  }
+}
+
+void translateRoutine(int r) {
+  Routine* routine = &(cCode->routines[r]);
+
+  cTempCount = 0;
+  fprintf(cOut, "\n/* %s */\n", routine->name);
+  if (isProgram(r))
+    fprintf(cOut, "int main(void)");
+  else printHeader(r);
+  fprintf(cOut, " {\n");
+  if (!isProgram(r))
+    printLocals(r);
+  translateRoutineCode(r);
+  fprintf(cOut, "}\n");
+}
+
+char* routineName(int r) {
+  int i;
+  for (i = 0; i < cCode->routineCount; i++)
+    if (i != r && strcmp(cCode->routines[i].name, cCode->routines[r].name) == 0) {
+      char* name = lowerName("", cCode->routines[r].name);
+      char* unique = formatText("%s_%d", name, r);
+      free(name);
+      return unique;
+    }
+  return lowerName("", cCode->routines[r].name);
+}
+
+int saveC(CodeBlock* codeBlock, char* fileName) {
+  Instruction* inst;
+  int i, r, program = 0;
+
+  cOut = fopen(fileName, "w");
+  if (cOut == NULL)
+    return IO_ERROR;
+
+  cCode = codeBlock;
+  cOwner = mapRoutines(codeBlock);
+  cParent = (int*) malloc(codeBlock->routineCount * sizeof(int));
+  cInStruct = (char**) malloc(codeBlock->routineCount * sizeof(char*));
+  cIsUsed = (char**) malloc(codeBlock->routineCount * sizeof(char*));
+  cHasStruct = (int*) malloc(codeBlock->routineCount * sizeof(int));
+  cNames = (char**) malloc(codeBlock->routineCount * sizeof(char*));
+  cIsLabel = (char*) calloc(codeBlock->codeSize + 1, 1);
+  cMaxDepth = 64;
+  cStack = (CEntry*) malloc(cMaxDepth * sizeof(CEntry));
+
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    cParent[r] = findParentRoutine(codeBlock, r);
+    cNames[r] = routineName(r);
+    if (cParent[r] < 0)
+      program = r;
+  }
+  for (i = 0; i < codeBlock->codeSize; i++) {
+    inst = &(codeBlock->code[i]);
+    if ((inst->op == OP_J || inst->op == OP_FJ) && findRoutine(codeBlock, i) == NULL)
+      cIsLabel[inst->q] = 1;
+  }
+  findSharedSlots();
+
+  fprintf(cOut, "/* %s, translated from KPL by kplc.\n", codeBlock->routines[program].name);
+  fprintf(cOut, " * Build with: gcc -O2 -fwrapv %s kplrt.c */\n\n", fileName);
+  fprintf(cOut, "#include \"kplrt.h\"\n\n");
+  fprintf(cOut, "typedef int WORD;\n\n");
+  printGlobals(program);
+  printStructs();
+  fprintf(cOut, "\n");
+  for (r = 0; r < codeBlock->routineCount; r++)
+    if (r != program) {
+      printHeader(r);
+      fprintf(cOut, ";\n");
+    }
+  for (r = 0; r < codeBlock->routineCount; r++)
+    translateRoutine(r);
+
+  fclose(cOut);
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    free(cInStruct[r]);
+    free(cIsUsed[r]);
+    free(cNames[r]);
+  }
+  free(cStack);
+  free(cIsLabel);
+  free(cNames);
+  free(cHasStruct);
+  free(cInStruct);
+  free(cIsUsed);
+  free(cParent);
+  free(cOwner);
+  return IO_SUCCESS;
+}
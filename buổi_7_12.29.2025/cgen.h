@@ -0,0 +1,28 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __CGEN_H__
+#define __CGEN_H__
+
+#include "instructions.h"
+
+/* Translates a code block into portable C. Every routine becomes a
+ * top-level C function. Its variables and parameters become C locals,
+ * except those used by nested routines: these live in a frame struct,
+ * and the nested routines reach it through an environment pointer
+ * (up). Program variables become globals. VAR parameters become
+ * pointers and arrays become fixed-size C arrays. The builtins call the
+ * runtime declared in kplrt.h. Build the output with
+ *   gcc -O2 -fwrapv program.c kplrt.c
+ * since KPL arithmetic wraps around. */
+
+int saveC(CodeBlock* codeBlock, char* fileName);
+
+/* Text helpers, shared with the LLVM backend */
+char* formatText(const char* format, ...);
+char* lowerName(char* prefix, char* name);
+
+#endif
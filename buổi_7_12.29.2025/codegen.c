@@ -0,0 +1,339 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "codegen.h"
+#include "error.h"
+
+extern SymTab* symtab;
+extern Token* currentToken;
+
+CodeBlock* codeBlock;
+
+void initCodeBuffer(void) {
+  codeBlock = createCodeBlock();
+}
+
+void cleanCodeBuffer(void) {
+  freeCodeBlock(codeBlock);
+}
+
+void printCodeBuffer(void) {
+  printCodeBlock(codeBlock);
+}
+
+CodeAddress getCurrentCodeAddress(void) {
+  return codeBlock->codeSize;
+}
+
+/* Number of static links from the current frame to the frame of scope */
+int computeNestedLevel(Scope* scope) {
+  return symtab->currentScope->level - scope->level;
+}
+
+/******************* Routines ******************************/
+
+void genRoutineEntry(Object* owner) {
+  Routine* routine;
+  Scope* scope;
+  CodeAddress entry = getCurrentCodeAddress();
+
+  switch (owner->kind) {
+  case OBJ_FUNCTION:
+    owner->funcAttrs->codeAddress = entry;
+    scope = owner->funcAttrs->scope;
+    routine = addRoutine(codeBlock, owner->name, RT_FUNCTION, entry);
+    routine->paramCount = owner->funcAttrs->paramCount;
+    break;
+  case OBJ_PROCEDURE:
+    owner->procAttrs->codeAddress = entry;
+    scope = owner->procAttrs->scope;
+    routine = addRoutine(codeBlock, owner->name, RT_PROCEDURE, entry);
+    routine->paramCount = owner->procAttrs->paramCount;
+    break;
+  default:
+    owner->progAttrs->codeAddress = entry;
+    scope = owner->progAttrs->scope;
+    routine = addRoutine(codeBlock, owner->name, RT_PROGRAM, entry);
+    break;
+  }
+
+  routine->level = scope->level;
+  routine->frameSize = scope->frameSize;
+  if (owner->kind == OBJ_FUNCTION)
+    addFrameSlot(routine, "", SLOT_SCALAR, 0, 1);
+  genFrameSlots(routine, scope);
+}
+
+/* Records the variables and parameters of a scope for the backends that
+ * need more than the frame offsets */
+void genFrameSlots(Routine* routine, Scope* scope) {
+  ObjectNode* node;
+  FrameSlot* slot;
+  Type* type;
+
+  for (node = scope->objList; node != NULL; node = node->next) {
+    Object* obj = node->object;
+    switch (obj->kind) {
+    case OBJ_VARIABLE:
+      type = obj->varAttrs->type;
+      slot = addFrameSlot(routine, obj->name, type->typeClass == TP_ARRAY ? SLOT_ARRAY : SLOT_SCALAR,
+                          obj->varAttrs->localOffset, sizeOfType(type));
+      while (type->typeClass == TP_ARRAY) {
+        if (slot->dimCount < MAX_SLOT_DIMS)
+          slot->dims[slot->dimCount++] = type->arraySize;
+        else slot->dims[MAX_SLOT_DIMS - 1] *= type->arraySize;
+        type = type->elementType;
+      }
+      break;
+    case OBJ_PARAMETER:
+      slot = addFrameSlot(routine, obj->name, obj->paramAttrs->kind == PARAM_REFERENCE ? SLOT_REFERENCE : SLOT_SCALAR,
+                          obj->paramAttrs->localOffset, 1);
+      slot->isParameter = 1;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/******************* Variables and parameters ******************************/
+
+void checkStorage(Scope* scope) {
+  // Declarations imported from a snapshot have no frame to live in
+  if (scope->owner == NULL)
+    error(ERR_EXTERNAL_IDENT, currentToken->lineNo, currentToken->colNo);
+}
+
+void genVariableAddress(Object* var) {
+  checkStorage(var->varAttrs->scope);
+  genLA(computeNestedLevel(var->varAttrs->scope), var->varAttrs->localOffset);
+}
+
+void genVariableValue(Object* var) {
+  checkStorage(var->varAttrs->scope);
+  genLV(computeNestedLevel(var->varAttrs->scope), var->varAttrs->localOffset);
+}
+
+void genParameterAddress(Object* param) {
+  int level = symtab->currentScope->level - param->paramAttrs->level;
+
+  // A VAR parameter already holds the address of its argument
+  if (param->paramAttrs->kind == PARAM_REFERENCE)
+    genLV(level, param->paramAttrs->localOffset);
+  else
+    genLA(level, param->paramAttrs->localOffset);
+}
+
+void genParameterValue(Object* param) {
+  int level = symtab->currentScope->level - param->paramAttrs->level;
+
+  genLV(level, param->paramAttrs->localOffset);
+  if (param->paramAttrs->kind == PARAM_REFERENCE)
+    genLI();
+}
+
+void genReturnValueAddress(Object* func) {
+  genLA(computeNestedLevel(func->funcAttrs->scope), 0);
+}
+
+/******************* Calls ******************************/
+
+int isPredefinedFunction(Object* func) {
+  return func == &readiFunction || func == &readcFunction;
+}
+
+int isPredefinedProcedure(Object* proc) {
+  return proc == &writeiProcedure || proc == &writecProcedure || proc == &writelnProcedure;
+}
+
+void genPredefinedFunctionCall(Object* func) {
+  if (func == &readiFunction)
+    genRI();
+  else if (func == &readcFunction)
+    genRC();
+}
+
+void genPredefinedProcedureCall(Object* proc) {
+  if (proc == &writeiProcedure)
+    genWRI();
+  else if (proc == &writecProcedure)
+    genWRC();
+  else if (proc == &writelnProcedure)
+    genWLN();
+}
+
+/* The caller reserves the callee's RESERVED_WORDS and pushes the arguments
+ * into its parameter slots, then drops them again before CALL so that the
+ * callee's frame starts right above the caller's top of stack. */
+
+void genFunctionCall(Object* func) {
+  if (func->funcAttrs->codeAddress < 0)
+    error(ERR_EXTERNAL_IDENT, currentToken->lineNo, currentToken->colNo);
+  genDCT(RESERVED_WORDS + func->funcAttrs->paramCount);
+  genCALL(computeNestedLevel(func->funcAttrs->scope->outer), func->funcAttrs->codeAddress);
+}
+
+void genProcedureCall(Object* proc) {
+  if (proc->procAttrs->codeAddress < 0)
+    error(ERR_EXTERNAL_IDENT, currentToken->lineNo, currentToken->colNo);
+  genDCT(RESERVED_WORDS + proc->procAttrs->paramCount);
+  genCALL(computeNestedLevel(proc->procAttrs->scope->outer), proc->procAttrs->codeAddress);
+}
+
+/******************* Instructions ******************************/
+
+CodeAddress genLA(int level, int offset) {
+  return emitCode(codeBlock, OP_LA, level, offset);
+}
+
+CodeAddress genLV(int level, int offset) {
+  return emitCode(codeBlock, OP_LV, level, offset);
+}
+
+CodeAddress genLC(WORD constant) {
+  return emitCode(codeBlock, OP_LC, 0, constant);
+}
+
+CodeAddress genLI(void) {
+  return emitCode(codeBlock, OP_LI, 0, 0);
+}
+
+CodeAddress genINT(int delta) {
+  return emitCode(codeBlock, OP_INT, 0, delta);
+}
+
+CodeAddress genDCT(int delta) {
+  return emitCode(codeBlock, OP_DCT, 0, delta);
+}
+
+CodeAddress genJ(CodeAddress label) {
+  return emitCode(codeBlock, OP_J, 0, label);
+}
+
+CodeAddress genFJ(CodeAddress label) {
+  return emitCode(codeBlock, OP_FJ, 0, label);
+}
+
+CodeAddress genHL(void) {
+  return emitCode(codeBlock, OP_HL, 0, 0);
+}
+
+CodeAddress genST(void) {
+  return emitCode(codeBlock, OP_ST, 0, 0);
+}
+
+CodeAddress genCALL(int level, CodeAddress label) {
+  return emitCode(codeBlock, OP_CALL, level, label);
+}
+
+CodeAddress genEP(void) {
+  return emitCode(codeBlock, OP_EP, 0, 0);
+}
+
+CodeAddress genEF(void) {
+  return emitCode(codeBlock, OP_EF, 0, 0);
+}
+
+CodeAddress genRC(void) {
+  return emitCode(codeBlock, OP_RC, 0, 0);
+}
+
+CodeAddress genRI(void) {
+  return emitCode(codeBlock, OP_RI, 0, 0);
+}
+
+CodeAddress genWRC(void) {
+  return emitCode(codeBlock, OP_WRC, 0, 0);
+}
+
+CodeAddress genWRI(void) {
+  return emitCode(codeBlock, OP_WRI, 0, 0);
+}
+
+CodeAddress genWLN(void) {
+  return emitCode(codeBlock, OP_WLN, 0, 0);
+}
+
+CodeAddress genAD(void) {
+  return emitCode(codeBlock, OP_AD, 0, 0);
+}
+
+CodeAddress genSB(void) {
+  return emitCode(codeBlock, OP_SB, 0, 0);
+}
+
+CodeAddress genML(void) {
+  return emitCode(codeBlock, OP_ML, 0, 0);
+}
+
+CodeAddress genDV(void) {
+  return emitCode(codeBlock, OP_DV, 0, 0);
+}
+
+CodeAddress genNEG(void) {
+  return emitCode(codeBlock, OP_NEG, 0, 0);
+}
+
+CodeAddress genCV(void) {
+  return emitCode(codeBlock, OP_CV, 0, 0);
+}
+
+CodeAddress genEQ(void) {
+  return emitCode(codeBlock, OP_EQ, 0, 0);
+}
+
+CodeAddress genNE(void) {
+  return emitCode(codeBlock, OP_NE, 0, 0);
+}
+
+CodeAddress genGT(void) {
+  return emitCode(codeBlock, OP_GT, 0, 0);
+}
+
+CodeAddress genLT(void) {
+  return emitCode(codeBlock, OP_LT, 0, 0);
+}
+
+CodeAddress genGE(void) {
+  return emitCode(codeBlock, OP_GE, 0, 0);
+}
+
+CodeAddress genLE(void) {
+  return emitCode(codeBlock, OP_LE, 0, 0);
+}
+
+CodeAddress genCK(WORD size) {
+  return emitCode(codeBlock, OP_CK, 0, size);
+}
+
+/* Whether the code ends with count LC instructions, the operands of an
+ * operator that can be folded */
+int endsWithConstants(int count) {
+  int i;
+
+  if (codeBlock->codeSize < count)
+    return 0;
+  for (i = codeBlock->codeSize - count; i < codeBlock->codeSize; i++)
+    if (codeBlock->code[i].op != OP_LC)
+      return 0;
+  return 1;
+}
+
+/* Removes the last LC instruction and returns its constant */
+WORD popConstant(void) {
+  codeBlock->codeSize--;
+  return codeBlock->code[codeBlock->codeSize].q;
+}
+
+void updateJ(CodeAddress jmp, CodeAddress label) {
+  codeBlock->code[jmp].q = label;
+}
+
+void updateFJ(CodeAddress jmp, CodeAddress label) {
+  codeBlock->code[jmp].q = label;
+}
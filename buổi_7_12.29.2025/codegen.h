@@ -0,0 +1,79 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __CODEGEN_H__
+#define __CODEGEN_H__
+
+#include "instructions.h"
+#include "symtab.h"
+
+#define DC_VALUE 0     // a jump target to be filled in later
+
+extern CodeBlock* codeBlock;
+
+void initCodeBuffer(void);
+void cleanCodeBuffer(void);
+void printCodeBuffer(void);
+
+CodeAddress getCurrentCodeAddress(void);
+int computeNestedLevel(Scope* scope);
+
+void genRoutineEntry(Object* owner);
+void genFrameSlots(Routine* routine, Scope* scope);
+
+void genVariableAddress(Object* var);
+void genVariableValue(Object* var);
+void genParameterAddress(Object* param);
+void genParameterValue(Object* param);
+void genReturnValueAddress(Object* func);
+
+int isPredefinedFunction(Object* func);
+int isPredefinedProcedure(Object* proc);
+void genPredefinedFunctionCall(Object* func);
+void genPredefinedProcedureCall(Object* proc);
+void genFunctionCall(Object* func);
+void genProcedureCall(Object* proc);
+
+CodeAddress genLA(int level, int offset);
+CodeAddress genLV(int level, int offset);
+CodeAddress genLC(WORD constant);
+CodeAddress genLI(void);
+CodeAddress genINT(int delta);
+CodeAddress genDCT(int delta);
+CodeAddress genJ(CodeAddress label);
+CodeAddress genFJ(CodeAddress label);
+CodeAddress genHL(void);
+CodeAddress genST(void);
+CodeAddress genCALL(int level, CodeAddress label);
+CodeAddress genEP(void);
+CodeAddress genEF(void);
+CodeAddress genRC(void);
+CodeAddress genRI(void);
+CodeAddress genWRC(void);
+CodeAddress genWRI(void);
+CodeAddress genWLN(void);
+CodeAddress genAD(void);
+CodeAddress genSB(void);
+CodeAddress genML(void);
+CodeAddress genDV(void);
+CodeAddress genNEG(void);
+CodeAddress genCV(void);
+CodeAddress genEQ(void);
+CodeAddress genNE(void);
+CodeAddress genGT(void);
+CodeAddress genLT(void);
+CodeAddress genGE(void);
+CodeAddress genLE(void);
+CodeAddress genCK(WORD size);
+
+/* Constant operands: an operand whose code ends with LC is that LC */
+int endsWithConstants(int count);
+WORD popConstant(void);
+
+void updateJ(CodeAddress jmp, CodeAddress label);
+void updateFJ(CodeAddress jmp, CodeAddress label);
+
+#endif
@@ -8,14 +8,14 @@
 #include <stdlib.h>
 #include "error.h"
 
-#define NUM_OF_ERRORS 29
+#define NUM_OF_ERRORS 34
 
 struct ErrorMessage {
   ErrorCode errorCode;
   char *message;
 };
 
-struct ErrorMessage errors[29] = {
+struct ErrorMessage errors[34] = {
   {ERR_END_OF_COMMENT, "End of comment expected."},
   {ERR_IDENT_TOO_LONG, "Identifier too long."},
   {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
@@ -44,7 +44,12 @@ struct ErrorMessage errors[29] = {
   {ERR_UNDECLARED_PROCEDURE, "Undeclared procedure."},
   {ERR_DUPLICATE_IDENT, "Duplicate identifier."},
   {ERR_TYPE_INCONSISTENCY, "Type inconsistency"},
-  {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."}
+  {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."},
+  {ERR_EXTERNAL_IDENT, "An imported identifier has no code or storage in this program."},
+  {ERR_DIVISION_BY_ZERO, "Division by zero in a constant expression."},
+  {ERR_CONSTANT_OVERFLOW, "A constant expression overflows."},
+  {ERR_INVALID_ARRAY_SIZE, "An array size must not be negative."},
+  {ERR_INDEX_OUT_OF_RANGE, "A constant index is out of the array range."}
 };
 
 void error(ErrorCode err, int lineNo, int colNo) {
@@ -37,7 +37,12 @@ typedef enum {
   ERR_UNDECLARED_PROCEDURE,
   ERR_DUPLICATE_IDENT,
   ERR_TYPE_INCONSISTENCY,
-  ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY
+  ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY,
+  ERR_EXTERNAL_IDENT,
+  ERR_DIVISION_BY_ZERO,
+  ERR_CONSTANT_OVERFLOW,
+  ERR_INVALID_ARRAY_SIZE,
+  ERR_INDEX_OUT_OF_RANGE
 } ErrorCode;
 
 void error(ErrorCode err, int lineNo, int colNo);
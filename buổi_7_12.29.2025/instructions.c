@@ -0,0 +1,209 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "instructions.h"
+
+#define INITIAL_CODE_SIZE 256
+
+char* opCodeNames[NUM_OF_OPCODES] = {
+  "LA", "LV", "LC", "LI", "INT", "DCT", "J", "FJ", "HL", "ST",
+  "CALL", "EP", "EF", "RC", "RI", "WRC", "WRI", "WLN",
+  "AD", "SB", "ML", "DV", "NEG", "CV",
+  "EQ", "NE", "GT", "LT", "GE", "LE", "CK"
+};
+
+CodeBlock* createCodeBlock(void) {
+  CodeBlock* codeBlock = (CodeBlock*) malloc(sizeof(CodeBlock));
+  codeBlock->code = (Instruction*) malloc(INITIAL_CODE_SIZE * sizeof(Instruction));
+  codeBlock->codeSize = 0;
+  codeBlock->maxSize = INITIAL_CODE_SIZE;
+  codeBlock->routines = NULL;
+  codeBlock->routineCount = 0;
+  return codeBlock;
+}
+
+void freeCodeBlock(CodeBlock* codeBlock) {
+  int i;
+  for (i = 0; i < codeBlock->routineCount; i++)
+    free(codeBlock->routines[i].slots);
+  free(codeBlock->code);
+  free(codeBlock->routines);
+  free(codeBlock);
+}
+
+CodeAddress emitCode(CodeBlock* codeBlock, OpCode op, WORD p, WORD q) {
+  Instruction* inst;
+
+  if (codeBlock->codeSize == codeBlock->maxSize) {
+    codeBlock->maxSize *= 2;
+    codeBlock->code = (Instruction*) realloc(codeBlock->code, codeBlock->maxSize * sizeof(Instruction));
+  }
+
+  inst = &(codeBlock->code[codeBlock->codeSize]);
+  inst->op = op;
+  inst->p = p;
+  inst->q = q;
+  return codeBlock->codeSize++;
+}
+
+Routine* addRoutine(CodeBlock* codeBlock, char* name, enum RoutineKind kind, CodeAddress entry) {
+  Routine* routine;
+
+  codeBlock->routines = (Routine*) realloc(codeBlock->routines, (codeBlock->routineCount + 1) * sizeof(Routine));
+  routine = &(codeBlock->routines[codeBlock->routineCount++]);
+  strcpy(routine->name, name);
+  routine->kind = kind;
+  routine->entry = entry;
+  routine->level = 0;
+  routine->frameSize = 0;
+  routine->paramCount = 0;
+  routine->slots = NULL;
+  routine->slotCount = 0;
+  return routine;
+}
+
+FrameSlot* addFrameSlot(Routine* routine, char* name, enum SlotKind kind, int offset, int size) {
+  FrameSlot* slot;
+  int i;
+
+  routine->slots = (FrameSlot*) realloc(routine->slots, (routine->slotCount + 1) * sizeof(FrameSlot));
+  // Keep the slots sorted by offset
+  for (i = routine->slotCount; i > 0 && routine->slots[i - 1].offset > offset; i--)
+    routine->slots[i] = routine->slots[i - 1];
+  routine->slotCount++;
+
+  slot = &(routine->slots[i]);
+  strcpy(slot->name, name);
+  slot->kind = kind;
+  slot->offset = offset;
+  slot->size = size;
+  slot->isParameter = 0;
+  slot->dimCount = 0;
+  return slot;
+}
+
+/* The slot holding the word at the given offset of the frame */
+FrameSlot* findFrameSlot(Routine* routine, int offset) {
+  int i;
+  for (i = 0; i < routine->slotCount; i++)
+    if (offset >= routine->slots[i].offset && offset < routine->slots[i].offset + routine->slots[i].size)
+      return &(routine->slots[i]);
+  return NULL;
+}
+
+Routine* findRoutine(CodeBlock* codeBlock, CodeAddress entry) {
+  int i;
+  for (i = 0; i < codeBlock->routineCount; i++)
+    if (codeBlock->routines[i].entry == entry)
+      return &(codeBlock->routines[i]);
+  return NULL;
+}
+
+/* Tells which routine every instruction belongs to, by following the
+ * control flow from each routine entry; calls fall through to the next
+ * instruction. The result is indexed by code address and holds a routine
+ * index, or -1 for unreachable code. The caller frees it. */
+int* mapRoutines(CodeBlock* codeBlock) {
+  int* owner = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  CodeAddress* work = (CodeAddress*) malloc((codeBlock->codeSize + 1) * sizeof(CodeAddress));
+  int top, i, r;
+  CodeAddress pc;
+
+  for (i = 0; i < codeBlock->codeSize; i++)
+    owner[i] = -1;
+
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    top = 0;
+    work[top++] = codeBlock->routines[r].entry;
+    while (top > 0) {
+      pc = work[--top];
+      while (pc < codeBlock->codeSize && owner[pc] == -1) {
+        Instruction* inst = &(codeBlock->code[pc]);
+        owner[pc] = r;
+        if (inst->op == OP_J)
+          pc = inst->q;
+        else if (inst->op == OP_EP || inst->op == OP_EF || inst->op == OP_HL)
+          break;
+        else {
+          if (inst->op == OP_FJ)
+            work[top++] = inst->q;
+          pc++;
+        }
+      }
+    }
+  }
+
+  free(work);
+  return owner;
+}
+
+/* The number of display entries: one per nesting level of the routines */
+int displaySize(Routine* routines, int routineCount) {
+  int size = 1;
+  int r;
+
+  for (r = 0; r < routineCount; r++)
+    if (routines[r].level + 1 > size)
+      size = routines[r].level + 1;
+  return size;
+}
+
+/* Routines are laid out in preorder: a nested routine follows its parent's
+ * entry, so the parent is the nearest routine one level up with an
+ * earlier entry. Returns -1 for the program. */
+int findParentRoutine(CodeBlock* codeBlock, int routine) {
+  Routine* r = &(codeBlock->routines[routine]);
+  int i, parent = -1;
+
+  for (i = 0; i < codeBlock->routineCount; i++)
+    if (codeBlock->routines[i].level == r->level - 1 && codeBlock->routines[i].entry < r->entry &&
+        (parent < 0 || codeBlock->routines[i].entry > codeBlock->routines[parent].entry))
+      parent = i;
+  return parent;
+}
+
+/******************* Disassembler ******************************/
+
+char* opCodeName(OpCode op) {
+  return opCodeNames[op];
+}
+
+void printInstruction(Instruction* inst) {
+  switch (inst->op) {
+  case OP_LA:
+  case OP_LV:
+  case OP_CALL:
+    printf("%s %d,%d", opCodeNames[inst->op], inst->p, inst->q);
+    break;
+  case OP_LC:
+  case OP_INT:
+  case OP_DCT:
+  case OP_J:
+  case OP_FJ:
+  case OP_CK:
+    printf("%s %d", opCodeNames[inst->op], inst->q);
+    break;
+  default:
+    printf("%s", opCodeNames[inst->op]);
+    break;
+  }
+}
+
+void printCodeBlock(CodeBlock* codeBlock) {
+  CodeAddress i;
+
+  for (i = 0; i < codeBlock->codeSize; i++) {
+    Routine* routine = findRoutine(codeBlock, i);
+    if (routine != NULL)
+      printf("%s:  ; level %d, frame %d\n", routine->name, routine->level, routine->frameSize);
+    printf("%5d:  ", i);
+    printInstruction(&(codeBlock->code[i]));
+    printf("\n");
+  }
+}
@@ -0,0 +1,131 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __INSTRUCTIONS_H__
+#define __INSTRUCTIONS_H__
+
+#include "token.h"
+
+/* Instructions of the KPL stack machine. s is the stack, t its top,
+ * b the base of the current frame and base(p) the base of the frame p
+ * static links away from the current one. The machines do not follow
+ * the links: they keep a display, the base of the innermost frame of
+ * every nesting level, and find base(p) there in one step; level below
+ * is the nesting level of the routine called or left. */
+typedef enum {
+  OP_LA,   // Load Address:    t := t + 1; s[t] := base(p) + q;
+  OP_LV,   // Load Value:      t := t + 1; s[t] := s[base(p) + q];
+  OP_LC,   // Load Constant:   t := t + 1; s[t] := q;
+  OP_LI,   // Load Indirect:   s[t] := s[s[t]];
+  OP_INT,  // Increment t:     t := t + q;
+  OP_DCT,  // Decrement t:     t := t - q;
+  OP_J,    // Jump:            pc := q;
+  OP_FJ,   // False Jump:      if s[t] = 0 then pc := q; t := t - 1;
+  OP_HL,   // Halt
+  OP_ST,   // Store:           s[s[t-1]] := s[t]; t := t - 2;
+  OP_CALL, // Call:            s[t+2] := b; s[t+3] := pc; s[t+4] := display(level); display(level) := t + 1; b := t + 1; pc := q;
+  OP_EP,   // Exit Procedure:  display(level) := s[b+3]; t := b - 1; pc := s[b+2]; b := s[b+1];
+  OP_EF,   // Exit Function:   display(level) := s[b+3]; t := b; pc := s[b+2]; b := s[b+1];
+  OP_RC,   // Read Char:       t := t + 1; s[t] := the next character;
+  OP_RI,   // Read Integer:    t := t + 1; s[t] := the next integer;
+  OP_WRC,  // Write Char:      write s[t] as a character; t := t - 1;
+  OP_WRI,  // Write Integer:   write s[t] as an integer; t := t - 1;
+  OP_WLN,  // New Line
+  OP_AD,   // Add:             t := t - 1; s[t] := s[t] + s[t+1];
+  OP_SB,   // Subtract:        t := t - 1; s[t] := s[t] - s[t+1];
+  OP_ML,   // Multiply:        t := t - 1; s[t] := s[t] * s[t+1];
+  OP_DV,   // Divide:          t := t - 1; s[t] := s[t] / s[t+1];
+  OP_NEG,  // Negate:          s[t] := - s[t];
+  OP_CV,   // Copy Top:        s[t+1] := s[t]; t := t + 1;
+  OP_EQ,   // Equal:           t := t - 1; s[t] := (s[t] = s[t+1]);
+  OP_NE,   // Not Equal:       t := t - 1; s[t] := (s[t] != s[t+1]);
+  OP_GT,   // Greater:         t := t - 1; s[t] := (s[t] > s[t+1]);
+  OP_LT,   // Less:            t := t - 1; s[t] := (s[t] < s[t+1]);
+  OP_GE,   // Greater or Equal: t := t - 1; s[t] := (s[t] >= s[t+1]);
+  OP_LE,   // Less or Equal:   t := t - 1; s[t] := (s[t] <= s[t+1]);
+  OP_CK    // Check Index:     if s[t] < 0 or s[t] >= q then stop with an error;
+} OpCode;
+
+#define NUM_OF_OPCODES (OP_CK + 1)
+
+typedef int WORD;
+typedef int CodeAddress;
+
+/* The level p of LA and LV naming the frame of the program, at the
+ * bottom of the stack, however deep the code that uses it */
+#define PROGRAM_FRAME -1
+
+/* One instruction fits in 8 bytes: the level operand p is small */
+typedef struct {
+  unsigned int op : 8;
+  signed int p : 24;
+  WORD q;
+} Instruction;
+
+enum RoutineKind {
+  RT_PROGRAM,
+  RT_FUNCTION,
+  RT_PROCEDURE
+};
+
+enum SlotKind {
+  SLOT_SCALAR,
+  SLOT_REFERENCE,           // a VAR parameter, holding an address
+  SLOT_ARRAY
+};
+
+#define MAX_SLOT_DIMS 8
+
+/* A named variable, parameter or function result in a frame. Arrays
+ * nested deeper than MAX_SLOT_DIMS keep their innermost dimensions
+ * merged into the last one. */
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];   // empty for the result of a function
+  enum SlotKind kind;
+  int offset;
+  int size;                 // in words
+  int isParameter;
+  int dimCount;
+  int dims[MAX_SLOT_DIMS];
+} FrameSlot;
+
+/* What the code block knows about each program, function or procedure */
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];
+  enum RoutineKind kind;
+  CodeAddress entry;
+  int level;                // nesting level of the routine's own frame
+  int frameSize;
+  int paramCount;
+  FrameSlot* slots;         // in offset order
+  int slotCount;
+} Routine;
+
+typedef struct {
+  Instruction* code;
+  int codeSize;
+  int maxSize;
+  Routine* routines;
+  int routineCount;
+} CodeBlock;
+
+CodeBlock* createCodeBlock(void);
+void freeCodeBlock(CodeBlock* codeBlock);
+
+CodeAddress emitCode(CodeBlock* codeBlock, OpCode op, WORD p, WORD q);
+Routine* addRoutine(CodeBlock* codeBlock, char* name, enum RoutineKind kind, CodeAddress entry);
+Routine* findRoutine(CodeBlock* codeBlock, CodeAddress entry);
+FrameSlot* addFrameSlot(Routine* routine, char* name, enum SlotKind kind, int offset, int size);
+FrameSlot* findFrameSlot(Routine* routine, int offset);
+int* mapRoutines(CodeBlock* codeBlock);
+int findParentRoutine(CodeBlock* codeBlock, int routine);
+int displaySize(Routine* routines, int routineCount);
+
+char* opCodeName(OpCode op);
+void printInstruction(Instruction* inst);
+void printCodeBlock(CodeBlock* codeBlock);
+
+#endif
@@ -0,0 +1,432 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ir.h"
+
+char* irOpNames[] = {
+  "const", "addr", "load", "store", "add", "sub", "mul", "div", "neg",
+  "eq", "ne", "gt", "lt", "ge", "le", "call",
+  "readi", "readc", "writei", "writec", "writeln", "check", "phi",
+  "jump", "branch", "return", "halt"
+};
+
+/******************* Building and editing ******************************/
+
+IRBlock* newBlock(IRFunction* fn) {
+  IRBlock* block = (IRBlock*) calloc(1, sizeof(IRBlock));
+
+  block->id = fn->nextBlockId++;
+  block->order = -1;
+  if (fn->blockCount == fn->maxBlocks) {
+    fn->maxBlocks = fn->maxBlocks * 2 + 8;
+    fn->blocks = (IRBlock**) realloc(fn->blocks, fn->maxBlocks * sizeof(IRBlock*));
+  }
+  fn->blocks[fn->blockCount++] = block;
+  return block;
+}
+
+IRInstr* newInstr(IRFunction* fn, IROp op, int argCount) {
+  IRInstr* instr = (IRInstr*) calloc(1, sizeof(IRInstr));
+
+  instr->op = op;
+  instr->id = fn->nextId++;
+  instr->argCount = argCount;
+  if (argCount > 0)
+    instr->args = (IRInstr**) calloc(argCount, sizeof(IRInstr*));
+  instr->slot = -1;
+  instr->allocated = fn->instrs;
+  fn->instrs = instr;
+  instr->hasValue = !(op == IR_STORE || op == IR_CALL || (op >= IR_WRITEI && op <= IR_WRITELN) || irIsTerminator(op));
+  return instr;
+}
+
+IRInstr* newConstant(IRFunction* fn, WORD value) {
+  IRInstr* instr = newInstr(fn, IR_CONST, 0);
+  instr->a = value;
+  return instr;
+}
+
+void insertInstr(IRBlock* block, int position, IRInstr* instr) {
+  int i;
+
+  if (block->count == block->maxCount) {
+    block->maxCount = block->maxCount * 2 + 8;
+    block->instrs = (IRInstr**) realloc(block->instrs, block->maxCount * sizeof(IRInstr*));
+  }
+  for (i = block->count; i > position; i--)
+    block->instrs[i] = block->instrs[i - 1];
+  block->instrs[position] = instr;
+  block->count++;
+  instr->block = block;
+}
+
+void appendInstr(IRBlock* block, IRInstr* instr) {
+  insertInstr(block, block->count, instr);
+}
+
+IRInstr* terminatorOf(IRBlock* block) {
+  if (block->count == 0 || !irIsTerminator(block->instrs[block->count - 1]->op))
+    return NULL;
+  return block->instrs[block->count - 1];
+}
+
+/* Records from as a predecessor of to; phis of to get their new
+ * argument from the caller */
+void addEdge(IRBlock* from, IRBlock* to) {
+  if (to->predCount == to->maxPreds) {
+    to->maxPreds = to->maxPreds * 2 + 4;
+    to->preds = (IRBlock**) realloc(to->preds, to->maxPreds * sizeof(IRBlock*));
+  }
+  to->preds[to->predCount++] = from;
+}
+
+int predIndex(IRBlock* block, IRBlock* pred) {
+  int i;
+  for (i = 0; i < block->predCount; i++)
+    if (block->preds[i] == pred)
+      return i;
+  return -1;
+}
+
+/* Forgets from as a predecessor of to, with the phi arguments for it */
+void removeEdge(IRBlock* from, IRBlock* to) {
+  IRInstr* phi;
+  int index = predIndex(to, from);
+  int i, j;
+
+  if (index < 0)
+    return;
+  for (i = index; i < to->predCount - 1; i++)
+    to->preds[i] = to->preds[i + 1];
+  to->predCount--;
+  for (i = 0; i < to->count; i++) {
+    phi = to->instrs[i];
+    if (phi->op != IR_PHI)
+      continue;
+    for (j = index; j < phi->argCount - 1; j++)
+      phi->args[j] = phi->args[j + 1];
+    phi->argCount--;
+  }
+}
+
+void replaceInstr(IRInstr* instr, IRInstr* replacement) {
+  instr->replacement = replacement;
+  instr->block = NULL;
+}
+
+void removeInstr(IRInstr* instr) {
+  instr->block = NULL;
+}
+
+IRInstr* resolveInstr(IRInstr* instr) {
+  while (instr->replacement != NULL)
+    instr = instr->replacement;
+  return instr;
+}
+
+void compactFunction(IRFunction* fn) {
+  IRBlock* block;
+  IRInstr* instr;
+  int i, j, k, count;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    count = 0;
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->block == NULL)
+        continue;
+      for (k = 0; k < instr->argCount; k++)
+        instr->args[k] = resolveInstr(instr->args[k]);
+      block->instrs[count++] = instr;
+    }
+    block->count = count;
+  }
+}
+
+/* A copy of a function with the same blocks, edges and instructions */
+IRFunction* copyFunction(IRFunction* fn) {
+  IRFunction* copy = (IRFunction*) calloc(1, sizeof(IRFunction));
+  IRInstr** copies = (IRInstr**) calloc(fn->nextId + 1, sizeof(IRInstr*));
+  IRBlock* from;
+  IRBlock* to;
+  IRInstr* instr;
+  IRInstr* clone;
+  int i, j, k;
+
+  copy->code = fn->code;
+  copy->routine = fn->routine;
+  for (i = 0; i < fn->blockCount; i++) {
+    fn->blocks[i]->mark = i;
+    newBlock(copy)->order = fn->blocks[i]->order;
+  }
+  for (i = 0; i < fn->blockCount; i++) {
+    from = fn->blocks[i];
+    to = copy->blocks[i];
+    for (j = 0; j < from->count; j++) {
+      instr = from->instrs[j];
+      clone = newInstr(copy, instr->op, instr->argCount);
+      clone->a = instr->a;
+      clone->b = instr->b;
+      clone->hasValue = instr->hasValue;
+      clone->isAddress = instr->isAddress;
+      copies[instr->id] = clone;
+      appendInstr(to, clone);
+    }
+    to->succCount = from->succCount;
+    for (k = 0; k < from->succCount; k++)
+      to->succs[k] = copy->blocks[from->succs[k]->mark];
+    for (k = 0; k < from->predCount; k++)
+      addEdge(copy->blocks[from->preds[k]->mark], to);
+  }
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      for (k = 0; k < instr->argCount; k++)
+        copies[instr->id]->args[k] = copies[resolveInstr(instr->args[k])->id];
+    }
+  free(copies);
+  return copy;
+}
+
+void freeIRFunction(IRFunction* fn) {
+  IRInstr* instr;
+  int i;
+
+  while (fn->instrs != NULL) {
+    instr = fn->instrs;
+    fn->instrs = instr->allocated;
+    free(instr->args);
+    free(instr);
+  }
+  for (i = 0; i < fn->blockCount; i++) {
+    free(fn->blocks[i]->instrs);
+    free(fn->blocks[i]->preds);
+    free(fn->blocks[i]);
+  }
+  free(fn->blocks);
+  free(fn);
+}
+
+void freeIRProgram(IRProgram* program) {
+  int r;
+
+  for (r = 0; r < program->functionCount; r++) {
+    if (program->functions[r] != NULL)
+      freeIRFunction(program->functions[r]);
+    free(program->nonLocal[r]);
+  }
+  free(program->nonLocal);
+  free(program->functions);
+  free(program->parents);
+  free(program);
+}
+
+/******************* Analyses ******************************/
+
+int irHasSideEffects(IROp op) {
+  switch (op) {
+  case IR_STORE:
+  case IR_DIV:
+  case IR_CALL:
+  case IR_READI:
+  case IR_READC:
+  case IR_WRITEI:
+  case IR_WRITEC:
+  case IR_WRITELN:
+  case IR_CHECK:
+    return 1;
+  default:
+    return irIsTerminator(op);
+  }
+}
+
+/* Whether an instruction depends on its arguments only */
+int irIsPure(IROp op) {
+  return !irHasSideEffects(op) && op != IR_LOAD && op != IR_PHI;
+}
+
+/* Like irIsPure(), for an instruction: a division by a constant other
+ * than 0 cannot trap, so the quotient of a / c and a - (a / c) * c can
+ * be shared */
+int irIsPureInstr(IRInstr* instr) {
+  IRInstr* divisor;
+
+  if (instr->op == IR_DIV) {
+    divisor = resolveInstr(instr->args[1]);
+    return divisor->op == IR_CONST && divisor->a != 0;
+  }
+  return irIsPure(instr->op);
+}
+
+int irIsTerminator(IROp op) {
+  return op >= IR_JUMP;
+}
+
+void countUses(IRFunction* fn) {
+  IRBlock* block;
+  int i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      fn->blocks[i]->instrs[j]->useCount = 0;
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++)
+      for (k = 0; k < block->instrs[j]->argCount; k++)
+        block->instrs[j]->args[k]->useCount++;
+  }
+}
+
+void visitPostorder(IRBlock* block, IRBlock** postorder, int* count) {
+  int i;
+
+  block->mark = 1;
+  for (i = 0; i < block->succCount; i++)
+    if (!block->succs[i]->mark)
+      visitPostorder(block->succs[i], postorder, count);
+  postorder[(*count)++] = block;
+}
+
+/* Puts the blocks in reverse postorder and drops the unreachable ones */
+void computeOrder(IRFunction* fn) {
+  IRBlock** postorder = (IRBlock**) malloc((fn->blockCount + 1) * sizeof(IRBlock*));
+  IRBlock* block;
+  int count = 0;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    fn->blocks[i]->mark = 0;
+  visitPostorder(fn->blocks[0], postorder, &count);
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    if (block->mark)
+      continue;
+    for (j = 0; j < block->succCount; j++)
+      removeEdge(block, block->succs[j]);
+    for (j = 0; j < block->count; j++)
+      removeInstr(block->instrs[j]);
+    free(block->instrs);
+    free(block->preds);
+    free(block);
+  }
+
+  for (i = 0; i < count; i++) {
+    fn->blocks[i] = postorder[count - 1 - i];
+    fn->blocks[i]->order = i;
+  }
+  fn->blockCount = count;
+  free(postorder);
+}
+
+IRBlock* intersect(IRBlock* a, IRBlock* b) {
+  while (a != b) {
+    while (a->order > b->order)
+      a = a->idom;
+    while (b->order > a->order)
+      b = b->idom;
+  }
+  return a;
+}
+
+/* The iterative algorithm of Cooper, Harvey and Kennedy; the blocks
+ * must be in reverse postorder */
+void computeDominators(IRFunction* fn) {
+  IRBlock* block;
+  IRBlock* idom;
+  int changed = 1;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    fn->blocks[i]->idom = NULL;
+  fn->blocks[0]->idom = fn->blocks[0];
+
+  while (changed) {
+    changed = 0;
+    for (i = 1; i < fn->blockCount; i++) {
+      block = fn->blocks[i];
+      idom = NULL;
+      for (j = 0; j < block->predCount; j++) {
+        if (block->preds[j]->idom == NULL)
+          continue;
+        idom = (idom == NULL) ? block->preds[j] : intersect(block->preds[j], idom);
+      }
+      if (idom != block->idom) {
+        block->idom = idom;
+        changed = 1;
+      }
+    }
+  }
+}
+
+int dominates(IRBlock* a, IRBlock* b) {
+  while (b != a && b->idom != b)
+    b = b->idom;
+  return a == b;
+}
+
+/******************* Printing ******************************/
+
+char* irOpName(IROp op) {
+  return irOpNames[op];
+}
+
+void printIRInstr(IRInstr* instr) {
+  int i;
+
+  printf("    ");
+  if (instr->hasValue)
+    printf("v%d = ", instr->id);
+  printf("%s", irOpNames[instr->op]);
+  switch (instr->op) {
+  case IR_CONST:
+    printf(" %d", instr->a);
+    break;
+  case IR_ADDR:
+    printf(" %d,%d", instr->a, instr->b);
+    break;
+  case IR_CALL:
+    printf(" %d,#%d", instr->a, instr->b);
+    break;
+  case IR_CHECK:
+    printf(" %d", instr->a);
+    break;
+  default:
+    break;
+  }
+  for (i = 0; i < instr->argCount; i++)
+    printf("%s v%d", (i == 0 && instr->op != IR_CALL && instr->op != IR_CHECK) ? "" : ",", instr->args[i]->id);
+  for (i = 0; i < instr->block->succCount && instr == terminatorOf(instr->block); i++)
+    printf("%s B%d", i == 0 ? " to" : ",", instr->block->succs[i]->id);
+  printf("\n");
+}
+
+void printIRFunction(IRFunction* fn) {
+  Routine* routine = &(fn->code->routines[fn->routine]);
+  IRBlock* block;
+  int i, j;
+
+  printf("%s:\n", routine->name);
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    printf("  B%d:", block->id);
+    for (j = 0; j < block->predCount; j++)
+      printf("%s B%d", j == 0 ? " <-" : ",", block->preds[j]->id);
+    printf("\n");
+    for (j = 0; j < block->count; j++)
+      printIRInstr(block->instrs[j]);
+  }
+}
+
+void printIRProgram(IRProgram* program) {
+  int r;
+  for (r = 0; r < program->functionCount; r++)
+    if (program->functions[r] != NULL)
+      printIRFunction(program->functions[r]);
+}
@@ -0,0 +1,142 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __IR_H__
+#define __IR_H__
+
+#include "instructions.h"
+
+/* The SSA intermediate representation used by the optimizer. Each
+ * routine becomes an IRFunction: a control-flow graph of basic blocks
+ * whose instructions name the values they use directly. The IR is lifted
+ * from the stack code of a checked program (buildIR) and lowered back to
+ * stack code once optimized (lowerIR), so every backend profits. */
+
+typedef enum {
+  IR_CONST,     // the constant a
+  IR_ADDR,      // the address of word b of the frame a static links away
+  IR_LOAD,      // the word at args[0]
+  IR_STORE,     // args[0] := args[1]
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,       // traps when args[1] is 0
+  IR_NEG,
+  IR_EQ,
+  IR_NE,
+  IR_GT,
+  IR_LT,
+  IR_GE,
+  IR_LE,
+  IR_CALL,      // routine b, its static link a static links away; args
+  IR_READI,
+  IR_READC,
+  IR_WRITEI,
+  IR_WRITEC,
+  IR_WRITELN,
+  IR_CHECK,     // args[0], which must lie in 0 .. a - 1
+  IR_PHI,       // one argument per predecessor, in the same order
+  // Terminators
+  IR_JUMP,      // to succs[0]
+  IR_BRANCH,    // to succs[0] if args[0] is not 0, else to succs[1]
+  IR_RETURN,    // from a procedure, or a function returning args[0]
+  IR_HALT
+} IROp;
+
+struct IRBlock;
+
+typedef struct IRInstr {
+  IROp op;
+  int id;
+  int a;
+  int b;
+  struct IRInstr** args;
+  int argCount;
+  struct IRBlock* block;
+  struct IRInstr* replacement;  // set once the instruction is removed
+  int hasValue;                 // calls have one when they call a function
+  int isAddress;                // the value is an address
+  int useCount;                 // as of the last countUses()
+  int slot;                     // lowering: the frame word holding the value
+  int mark;                     // scratch, for passes
+  struct IRInstr* allocated;    // the function's list of instructions
+} IRInstr;
+
+typedef struct IRBlock {
+  int id;
+  IRInstr** instrs;             // the terminator is the last one
+  int count;
+  int maxCount;
+  struct IRBlock* succs[2];
+  int succCount;
+  struct IRBlock** preds;
+  int predCount;
+  int maxPreds;
+  struct IRBlock* idom;         // as of the last computeDominators()
+  int order;                    // reverse postorder index
+  CodeAddress address;          // lowering
+  int mark;                     // scratch, for passes
+} IRBlock;
+
+typedef struct {
+  CodeBlock* code;              // the code the function was built from
+  int routine;                  // its index in code->routines
+  IRBlock** blocks;             // blocks[0] is the entry
+  int blockCount;
+  int maxBlocks;
+  int nextId;
+  int nextBlockId;
+  IRInstr* instrs;              // every instruction ever made, for freeing
+} IRFunction;
+
+typedef struct {
+  CodeBlock* code;
+  IRFunction** functions;       // per routine; NULL if it could not be lifted
+  int functionCount;
+  int* parents;                 // per routine: the enclosing routine, or -1
+  char** nonLocal;              // per routine and frame word: nested routines use it
+} IRProgram;
+
+IRProgram* buildIR(CodeBlock* codeBlock);
+FrameSlot* slotOf(IRProgram* program, int r, int distance, int offset);
+CodeBlock* lowerIR(IRProgram* program);
+IRFunction* copyFunction(IRFunction* fn);
+void freeIRFunction(IRFunction* fn);
+void freeIRProgram(IRProgram* program);
+
+/* Building and editing */
+IRBlock* newBlock(IRFunction* fn);
+IRInstr* newInstr(IRFunction* fn, IROp op, int argCount);
+IRInstr* newConstant(IRFunction* fn, WORD value);
+void appendInstr(IRBlock* block, IRInstr* instr);
+void insertInstr(IRBlock* block, int position, IRInstr* instr);
+IRInstr* terminatorOf(IRBlock* block);
+void addEdge(IRBlock* from, IRBlock* to);
+void removeEdge(IRBlock* from, IRBlock* to);
+int predIndex(IRBlock* block, IRBlock* pred);
+
+/* Removing: uses of a replaced instruction are redirected lazily, and
+ * compactFunction() rewrites them and drops the removed instructions */
+void replaceInstr(IRInstr* instr, IRInstr* replacement);
+void removeInstr(IRInstr* instr);
+IRInstr* resolveInstr(IRInstr* instr);
+void compactFunction(IRFunction* fn);
+
+/* Analyses */
+int irHasSideEffects(IROp op);
+int irIsPure(IROp op);
+int irIsPureInstr(IRInstr* instr);
+int irIsTerminator(IROp op);
+void countUses(IRFunction* fn);
+void computeOrder(IRFunction* fn);
+void computeDominators(IRFunction* fn);
+int dominates(IRBlock* a, IRBlock* b);
+
+char* irOpName(IROp op);
+void printIRFunction(IRFunction* fn);
+void printIRProgram(IRProgram* program);
+
+#endif
@@ -0,0 +1,882 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "ir.h"
+
+/******************* Lifting stack code ******************************/
+
+/* The word a frame slot holds when the stack code addresses it */
+FrameSlot* slotOf(IRProgram* program, int r, int distance, int offset) {
+  if (distance == PROGRAM_FRAME)
+    distance = program->code->routines[r].level;
+  while (distance-- > 0 && r >= 0)
+    r = program->parents[r];
+  if (r < 0)
+    return NULL;
+  return findFrameSlot(&(program->code->routines[r]), offset);
+}
+
+/* Where the body of a routine starts: after the jump over its nested
+ * routines and the allocation of its frame */
+CodeAddress bodyStart(CodeBlock* code, int r) {
+  CodeAddress pc = code->routines[r].entry;
+
+  if (code->code[pc].op == OP_J)
+    pc = code->code[pc].q;
+  if (code->code[pc].op == OP_INT)
+    pc++;
+  return pc;
+}
+
+int routineAt(CodeBlock* code, CodeAddress entry) {
+  int i;
+  for (i = 0; i < code->routineCount; i++)
+    if (code->routines[i].entry == entry)
+      return i;
+  return -1;
+}
+
+IRInstr* emitIR(IRFunction* fn, IRBlock* block, IROp op, int argCount) {
+  IRInstr* instr = newInstr(fn, op, argCount);
+  appendInstr(block, instr);
+  return instr;
+}
+
+void endBlock(IRFunction* fn, IRBlock* block, IRBlock* target) {
+  emitIR(fn, block, IR_JUMP, 0);
+  block->succs[0] = target;
+  block->succCount = 1;
+  addEdge(block, target);
+}
+
+/* Runs the stack code of one routine on a stack of IR values. The code
+ * generator leaves the stack empty at every jump and jump target; a
+ * routine where this does not hold is left unoptimized (NULL). */
+IRFunction* buildFunction(IRProgram* program, int* owner, int r) {
+  CodeBlock* code = program->code;
+  IRFunction* fn = (IRFunction*) calloc(1, sizeof(IRFunction));
+  IRBlock** blockAt = (IRBlock**) calloc(code->codeSize + 1, sizeof(IRBlock*));
+  IRInstr** stack = (IRInstr**) malloc((code->codeSize + 1) * sizeof(IRInstr*));
+  IRInstr* args[256];
+  IRInstr* instr;
+  IRInstr* address;
+  IRBlock* block;
+  IRBlock* entry;
+  Instruction* inst;
+  FrameSlot* slot;
+  CodeAddress start = bodyStart(code, r);
+  CodeAddress pc;
+  int depth = 0;
+  int argCount = 0;
+  int failed = 0;
+  int i, callee;
+
+  fn->code = code;
+  fn->routine = r;
+  entry = newBlock(fn);
+
+  // Blocks start at jump targets and after jumps
+  blockAt[start] = newBlock(fn);
+  for (pc = start; pc < code->codeSize; pc++) {
+    if (owner[pc] != r)
+      continue;
+    inst = &(code->code[pc]);
+    if (inst->op == OP_J || inst->op == OP_FJ) {
+      if (blockAt[inst->q] == NULL)
+        blockAt[inst->q] = newBlock(fn);
+    }
+    if (inst->op == OP_J || inst->op == OP_FJ || inst->op == OP_EP || inst->op == OP_EF || inst->op == OP_HL)
+      if (pc + 1 < code->codeSize && owner[pc + 1] == r && blockAt[pc + 1] == NULL)
+        blockAt[pc + 1] = newBlock(fn);
+  }
+  endBlock(fn, entry, blockAt[start]);
+
+  block = NULL;
+  for (pc = start; pc < code->codeSize && !failed; pc++) {
+    if (owner[pc] != r)
+      continue;
+    if (blockAt[pc] != NULL) {
+      if (depth != 0) {
+        failed = 1;
+        break;
+      }
+      if (block != NULL && terminatorOf(block) == NULL)
+        endBlock(fn, block, blockAt[pc]);
+      block = blockAt[pc];
+    }
+    if (block == NULL)
+      continue;
+    inst = &(code->code[pc]);
+
+    switch (inst->op) {
+    case OP_LA:
+      instr = emitIR(fn, block, IR_ADDR, 0);
+      instr->a = inst->p;
+      instr->b = inst->q;
+      instr->isAddress = 1;
+      stack[depth++] = instr;
+      break;
+    case OP_LV:
+      address = emitIR(fn, block, IR_ADDR, 0);
+      address->a = inst->p;
+      address->b = inst->q;
+      address->isAddress = 1;
+      instr = emitIR(fn, block, IR_LOAD, 1);
+      instr->args[0] = address;
+      slot = slotOf(program, r, inst->p, inst->q);
+      instr->isAddress = (slot != NULL && slot->kind == SLOT_REFERENCE);
+      stack[depth++] = instr;
+      break;
+    case OP_LC:
+      instr = emitIR(fn, block, IR_CONST, 0);
+      instr->a = inst->q;
+      stack[depth++] = instr;
+      break;
+    case OP_LI:
+      if (depth < 1 || stack[depth - 1] == NULL) {
+        failed = 1;
+        break;
+      }
+      instr = emitIR(fn, block, IR_LOAD, 1);
+      instr->args[0] = stack[depth - 1];
+      stack[depth - 1] = instr;
+      break;
+    case OP_INT:
+      for (i = 0; i < inst->q; i++)
+        stack[depth++] = NULL;
+      break;
+    case OP_DCT:
+      argCount = inst->q - RESERVED_WORDS;
+      if (argCount < 0 || depth < inst->q) {
+        failed = 1;
+        break;
+      }
+      for (i = 0; i < argCount; i++)
+        args[i] = stack[depth - argCount + i];
+      depth -= inst->q;
+      break;
+    case OP_CALL:
+      callee = routineAt(code, inst->q);
+      if (callee < 0) {
+        failed = 1;
+        break;
+      }
+      instr = emitIR(fn, block, IR_CALL, argCount);
+      instr->a = inst->p;
+      instr->b = callee;
+      for (i = 0; i < argCount; i++)
+        instr->args[i] = args[i];
+      instr->hasValue = (code->routines[callee].kind == RT_FUNCTION);
+      if (instr->hasValue)
+        stack[depth++] = instr;
+      argCount = 0;
+      break;
+    case OP_J:
+      if (depth != 0) {
+        failed = 1;
+        break;
+      }
+      endBlock(fn, block, blockAt[inst->q]);
+      break;
+    case OP_FJ:
+      if (depth != 1) {
+        failed = 1;
+        break;
+      }
+      depth--;
+      if (blockAt[pc + 1] == blockAt[inst->q]) {
+        endBlock(fn, block, blockAt[inst->q]);
+        break;
+      }
+      instr = emitIR(fn, block, IR_BRANCH, 1);
+      instr->args[0] = stack[0];
+      block->succs[0] = blockAt[pc + 1];
+      block->succs[1] = blockAt[inst->q];
+      block->succCount = 2;
+      addEdge(block, blockAt[pc + 1]);
+      addEdge(block, blockAt[inst->q]);
+      break;
+    case OP_HL:
+      emitIR(fn, block, IR_HALT, 0);
+      break;
+    case OP_ST:
+      if (depth < 2) {
+        failed = 1;
+        break;
+      }
+      instr = emitIR(fn, block, IR_STORE, 2);
+      instr->args[0] = stack[depth - 2];
+      instr->args[1] = stack[depth - 1];
+      depth -= 2;
+      break;
+    case OP_EP:
+      emitIR(fn, block, IR_RETURN, 0);
+      break;
+    case OP_EF:
+      address = emitIR(fn, block, IR_ADDR, 0);
+      address->isAddress = 1;
+      instr = emitIR(fn, block, IR_LOAD, 1);
+      instr->args[0] = address;
+      emitIR(fn, block, IR_RETURN, 1)->args[0] = instr;
+      break;
+    case OP_RC:
+    case OP_RI:
+      stack[depth++] = emitIR(fn, block, inst->op == OP_RC ? IR_READC : IR_READI, 0);
+      break;
+    case OP_WRC:
+    case OP_WRI:
+      if (depth < 1) {
+        failed = 1;
+        break;
+      }
+      emitIR(fn, block, inst->op == OP_WRC ? IR_WRITEC : IR_WRITEI, 1)->args[0] = stack[--depth];
+      break;
+    case OP_WLN:
+      emitIR(fn, block, IR_WRITELN, 0);
+      break;
+    case OP_NEG:
+      if (depth < 1) {
+        failed = 1;
+        break;
+      }
+      instr = emitIR(fn, block, IR_NEG, 1);
+      instr->args[0] = stack[depth - 1];
+      stack[depth - 1] = instr;
+      break;
+    case OP_CV:
+      if (depth < 1) {
+        failed = 1;
+        break;
+      }
+      stack[depth] = stack[depth - 1];
+      depth++;
+      break;
+    case OP_CK:
+      if (depth < 1 || stack[depth - 1] == NULL) {
+        failed = 1;
+        break;
+      }
+      instr = emitIR(fn, block, IR_CHECK, 1);
+      instr->a = inst->q;
+      instr->args[0] = stack[depth - 1];
+      stack[depth - 1] = instr;
+      break;
+    default:
+      if (depth < 2 || stack[depth - 1] == NULL || stack[depth - 2] == NULL) {
+        failed = 1;
+        break;
+      }
+      instr = emitIR(fn, block, (inst->op >= OP_EQ) ? IR_EQ + (inst->op - OP_EQ) : IR_ADD + (inst->op - OP_AD), 2);
+      instr->args[0] = stack[depth - 2];
+      instr->args[1] = stack[depth - 1];
+      instr->isAddress = (inst->op == OP_AD || inst->op == OP_SB) &&
+                         (instr->args[0]->isAddress || instr->args[1]->isAddress);
+      depth--;
+      stack[depth - 1] = instr;
+      break;
+    }
+  }
+
+  // Every block must end in a terminator
+  for (i = 0; i < fn->blockCount && !failed; i++)
+    if (terminatorOf(fn->blocks[i]) == NULL)
+      failed = 1;
+
+  free(stack);
+  free(blockAt);
+  if (failed) {
+    freeIRFunction(fn);
+    return NULL;
+  }
+  computeOrder(fn);
+  return fn;
+}
+
+IRProgram* buildIR(CodeBlock* codeBlock) {
+  IRProgram* program = (IRProgram*) malloc(sizeof(IRProgram));
+  int* owner = mapRoutines(codeBlock);
+  Instruction* inst;
+  CodeAddress pc;
+  int r, i;
+
+  program->code = codeBlock;
+  program->functionCount = codeBlock->routineCount;
+  program->functions = (IRFunction**) calloc(codeBlock->routineCount, sizeof(IRFunction*));
+  program->parents = (int*) malloc(codeBlock->routineCount * sizeof(int));
+  program->nonLocal = (char**) malloc(codeBlock->routineCount * sizeof(char*));
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    program->parents[r] = findParentRoutine(codeBlock, r);
+    program->nonLocal[r] = (char*) calloc(codeBlock->routines[r].frameSize + 1, 1);
+  }
+  for (pc = 0; pc < codeBlock->codeSize; pc++) {
+    inst = &(codeBlock->code[pc]);
+    if ((inst->op != OP_LA && inst->op != OP_LV) || inst->p == 0 || owner[pc] < 0)
+      continue;
+    r = owner[pc];
+    for (i = 0; (i < inst->p || inst->p == PROGRAM_FRAME) && program->parents[r] >= 0; i++)
+      r = program->parents[r];
+    if (r >= 0 && inst->q < codeBlock->routines[r].frameSize)
+      program->nonLocal[r][inst->q] = 1;
+  }
+  for (r = 0; r < codeBlock->routineCount; r++)
+    program->functions[r] = buildFunction(program, owner, r);
+
+  free(owner);
+  return program;
+}
+
+/******************* Lowering to stack code ******************************/
+
+/* Values are emitted as trees of stack code. A value used once, in the
+ * same block, is computed where it is used when nothing between the two
+ * cares; CONST and ADDR are recomputed at every use; all other values
+ * are stored to a frame word of their own, where phis are too. */
+
+enum LowerKind {
+  LW_DEAD,          // not emitted
+  LW_REMAT,         // recomputed at every use
+  LW_ROOT,          // a statement, emitted where it stands
+  LW_INLINE,        // emitted as part of its user
+  LW_SLOT           // stored to a frame word
+};
+
+#define MAX_TREE_DEPTH 64
+
+typedef struct {
+  enum LowerKind kind;
+  IRInstr* user;        // of a value used once
+  int userArg;
+  int position;         // in its block
+  int rootKey;          // emission order of the tree it belongs to
+  int pathLength;       // its place in that tree
+  int path[MAX_TREE_DEPTH];
+} LowerInfo;
+
+typedef struct {
+  CodeAddress address;
+  IRBlock* block;       // a jump to a block
+  int routine;          // or a call of a routine
+} LowerFixup;
+
+CodeBlock* lowered;
+IRProgram* loweredProgram;
+IRFunction* loweredFunction;
+LowerInfo* lowerInfo;
+LowerFixup* fixups;
+int fixupCount;
+int maxFixups;
+
+#define MEM_READ 1
+#define MEM_WRITE 2
+#define MEM_EFFECT 4
+
+int memoryEffects(IROp op) {
+  switch (op) {
+  case IR_LOAD:
+    return MEM_READ;
+  case IR_STORE:
+    return MEM_WRITE;
+  case IR_CALL:
+    return MEM_READ | MEM_WRITE | MEM_EFFECT;
+  case IR_DIV:
+  case IR_READI:
+  case IR_READC:
+  case IR_WRITEI:
+  case IR_WRITEC:
+  case IR_WRITELN:
+  case IR_CHECK:
+    return MEM_EFFECT;
+  default:
+    return 0;
+  }
+}
+
+/* Whether running a after b instead of before it may change anything */
+int mayConflict(IROp a, IROp b) {
+  int ea = memoryEffects(a);
+  int eb = memoryEffects(b);
+  return ((ea & MEM_WRITE) && (eb & (MEM_READ | MEM_WRITE))) ||
+         ((ea & MEM_READ) && (eb & MEM_WRITE)) ||
+         ((ea & MEM_EFFECT) && (eb & MEM_EFFECT));
+}
+
+/* Whether x is emitted before v, both being parts of trees */
+int emittedBefore(LowerInfo* x, LowerInfo* v) {
+  int i;
+
+  if (x->rootKey != v->rootKey)
+    return x->rootKey < v->rootKey;
+  // Postorder: a subtree of an earlier argument comes first
+  for (i = 0; i < x->pathLength && i < v->pathLength; i++)
+    if (x->path[i] != v->path[i])
+      return x->path[i] < v->path[i];
+  return x->pathLength > v->pathLength;
+}
+
+/* Tries to place v in the tree of its user, ending at the given block
+ * position */
+int placeInTree(IRBlock* block, IRInstr* v, LowerInfo* userInfo, int userArg, int end) {
+  LowerInfo* info = &(lowerInfo[v->id]);
+  LowerInfo* other;
+  IRInstr* x;
+  int pos;
+
+  if (userInfo->pathLength >= MAX_TREE_DEPTH)
+    return 0;
+  info->rootKey = userInfo->rootKey;
+  info->pathLength = userInfo->pathLength + 1;
+  memcpy(info->path, userInfo->path, userInfo->pathLength * sizeof(int));
+  info->path[userInfo->pathLength] = userArg;
+
+  for (pos = info->position + 1; pos < end; pos++) {
+    x = block->instrs[pos];
+    if (!mayConflict(v->op, x->op))
+      continue;
+    other = &(lowerInfo[x->id]);
+    switch (other->kind) {
+    case LW_SLOT:
+    case LW_ROOT:
+      return 0;
+    case LW_INLINE:
+      if (emittedBefore(other, info))
+        return 0;
+      break;
+    default:
+      break;
+    }
+  }
+  return 1;
+}
+
+void decideBlock(IRBlock* block) {
+  IRInstr* v;
+  IRInstr* user;
+  LowerInfo* info;
+  LowerInfo copyRoot;
+  int pos, end;
+
+  for (pos = 0; pos < block->count; pos++)
+    lowerInfo[block->instrs[pos]->id].position = pos;
+
+  for (pos = block->count - 1; pos >= 0; pos--) {
+    v = block->instrs[pos];
+    info = &(lowerInfo[v->id]);
+    user = info->user;
+    info->pathLength = 0;
+    info->rootKey = 2 * pos;
+
+    if (v->op == IR_CONST || v->op == IR_ADDR)
+      info->kind = LW_REMAT;
+    else if (!v->hasValue)
+      info->kind = LW_ROOT;
+    else if (v->op == IR_PHI)
+      info->kind = LW_SLOT;
+    else if (v->useCount == 0)
+      info->kind = irHasSideEffects(v->op) ? LW_ROOT : LW_DEAD;
+    else if (v->useCount > 1 || user == NULL)
+      info->kind = LW_SLOT;
+    else if (user->op == IR_PHI) {
+      // Computed by the copy at the end of this block, if it comes from here;
+      // the copies come in the order of the phis
+      info->kind = LW_SLOT;
+      end = block->count - 1;
+      if (user->block->preds[info->userArg] == block) {
+        copyRoot.rootKey = 2 * end - 1;
+        copyRoot.pathLength = 1;
+        copyRoot.path[0] = lowerInfo[user->id].position;
+        if (placeInTree(block, v, &copyRoot, 0, end))
+          info->kind = LW_INLINE;
+      }
+    } else if (user->block == block) {
+      // The tree ends at the position of its root
+      info->kind = LW_SLOT;
+      end = (lowerInfo[user->id].rootKey + 1) / 2;
+      if (placeInTree(block, v, &(lowerInfo[user->id]), info->userArg, end))
+        info->kind = LW_INLINE;
+    } else info->kind = LW_SLOT;
+
+    if (info->kind != LW_INLINE) {
+      info->pathLength = 0;
+      info->rootKey = 2 * pos;
+    }
+  }
+}
+
+void addLowerFixup(CodeAddress address, IRBlock* block, int routine) {
+  if (fixupCount == maxFixups) {
+    maxFixups = maxFixups * 2 + 16;
+    fixups = (LowerFixup*) realloc(fixups, maxFixups * sizeof(LowerFixup));
+  }
+  fixups[fixupCount].address = address;
+  fixups[fixupCount].block = block;
+  fixups[fixupCount].routine = routine;
+  fixupCount++;
+}
+
+void emitTree(IRInstr* v);
+
+/* Whether an address is the first word of an array */
+int isArrayWord(IRInstr* address) {
+  FrameSlot* slot = slotOf(loweredProgram, loweredFunction->routine, address->a, address->b);
+  return slot != NULL && slot->kind == SLOT_ARRAY;
+}
+
+void emitValue(IRInstr* v) {
+  LowerInfo* info = &(lowerInfo[v->id]);
+
+  if (info->kind == LW_SLOT)
+    emitCode(lowered, OP_LV, 0, v->slot);
+  else emitTree(v);
+}
+
+void emitTree(IRInstr* v) {
+  static OpCode binaryOps[] = { OP_AD, OP_SB, OP_ML, OP_DV };
+  int i;
+
+  switch (v->op) {
+  case IR_CONST:
+    emitCode(lowered, OP_LC, 0, v->a);
+    break;
+  case IR_ADDR:
+    emitCode(lowered, OP_LA, v->a, v->b);
+    break;
+  case IR_LOAD:
+    // LV of an array names the whole array to the C and LLVM backends
+    if (v->args[0]->op == IR_ADDR && !isArrayWord(v->args[0]))
+      emitCode(lowered, OP_LV, v->args[0]->a, v->args[0]->b);
+    else {
+      emitValue(v->args[0]);
+      emitCode(lowered, OP_LI, 0, 0);
+    }
+    break;
+  case IR_STORE:
+    emitValue(v->args[0]);
+    emitValue(v->args[1]);
+    emitCode(lowered, OP_ST, 0, 0);
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+    emitValue(v->args[0]);
+    emitValue(v->args[1]);
+    emitCode(lowered, binaryOps[v->op - IR_ADD], 0, 0);
+    break;
+  case IR_NEG:
+    emitValue(v->args[0]);
+    emitCode(lowered, OP_NEG, 0, 0);
+    break;
+  case IR_EQ:
+  case IR_NE:
+  case IR_GT:
+  case IR_LT:
+  case IR_GE:
+  case IR_LE:
+    emitValue(v->args[0]);
+    emitValue(v->args[1]);
+    emitCode(lowered, OP_EQ + (v->op - IR_EQ), 0, 0);
+    break;
+  case IR_CALL:
+    emitCode(lowered, OP_INT, 0, RESERVED_WORDS);
+    for (i = 0; i < v->argCount; i++)
+      emitValue(v->args[i]);
+    emitCode(lowered, OP_DCT, 0, RESERVED_WORDS + v->argCount);
+    addLowerFixup(emitCode(lowered, OP_CALL, v->a, 0), NULL, v->b);
+    break;
+  case IR_READI:
+    emitCode(lowered, OP_RI, 0, 0);
+    break;
+  case IR_READC:
+    emitCode(lowered, OP_RC, 0, 0);
+    break;
+  case IR_WRITEI:
+  case IR_WRITEC:
+    emitValue(v->args[0]);
+    emitCode(lowered, v->op == IR_WRITEI ? OP_WRI : OP_WRC, 0, 0);
+    break;
+  case IR_WRITELN:
+    emitCode(lowered, OP_WLN, 0, 0);
+    break;
+  case IR_CHECK:
+    emitValue(v->args[0]);
+    emitCode(lowered, OP_CK, 0, v->a);
+    break;
+  default:
+    break;
+  }
+}
+
+/* Whether a copy reads a frame word written by an earlier copy */
+int readsSlotOf(IRInstr* v, IRInstr* phi) {
+  int i;
+
+  if (v == phi)
+    return 1;
+  if (lowerInfo[v->id].kind != LW_INLINE)
+    return 0;
+  for (i = 0; i < v->argCount; i++)
+    if (readsSlotOf(v->args[i], phi))
+      return 1;
+  return 0;
+}
+
+int allocateSlot(Routine* routine, int* frameSize, int isAddress) {
+  char name[MAX_IDENT_LEN + 1];
+  sprintf(name, "_T%d", *frameSize);
+  addFrameSlot(routine, name, isAddress ? SLOT_REFERENCE : SLOT_SCALAR, *frameSize, 1);
+  return (*frameSize)++;
+}
+
+/* Stores the phi arguments coming from block into the frame words of
+ * the phis of its successor, as one parallel copy */
+void emitPhiCopies(IRBlock* block, Routine* routine, int* frameSize) {
+  IRBlock* succ = block->succs[0];
+  IRInstr* phis[256];
+  int temps[256];
+  int index = predIndex(succ, block);
+  int phiCount = 0;
+  int parallel = 0;
+  int i, j;
+
+  for (i = 0; i < succ->count && succ->instrs[i]->op == IR_PHI && phiCount < 256; i++)
+    if (lowerInfo[succ->instrs[i]->id].kind != LW_DEAD)
+      phis[phiCount++] = succ->instrs[i];
+
+  for (i = 0; i < phiCount; i++)
+    for (j = 0; j < i; j++)
+      if (readsSlotOf(phis[i]->args[index], phis[j]))
+        parallel = 1;
+
+  for (i = 0; i < phiCount; i++) {
+    if (phis[i]->args[index] == phis[i])
+      continue;
+    temps[i] = parallel ? allocateSlot(routine, frameSize, phis[i]->isAddress) : phis[i]->slot;
+    emitCode(lowered, OP_LA, 0, temps[i]);
+    emitValue(phis[i]->args[index]);
+    emitCode(lowered, OP_ST, 0, 0);
+  }
+  for (i = 0; i < phiCount && parallel; i++) {
+    if (phis[i]->args[index] == phis[i])
+      continue;
+    emitCode(lowered, OP_LA, 0, phis[i]->slot);
+    emitCode(lowered, OP_LV, 0, temps[i]);
+    emitCode(lowered, OP_ST, 0, 0);
+  }
+}
+
+int hasPhis(IRBlock* block) {
+  return block->count > 0 && block->instrs[0]->op == IR_PHI;
+}
+
+/* Gives the edges from a branch to a block with phis a block of their
+ * own, for the copies */
+void splitCriticalEdges(IRFunction* fn) {
+  IRBlock* block;
+  IRBlock* succ;
+  IRBlock* split;
+  int count = fn->blockCount;
+  int i, j;
+
+  for (i = 0; i < count; i++) {
+    block = fn->blocks[i];
+    if (block->succCount < 2)
+      continue;
+    for (j = 0; j < block->succCount; j++) {
+      succ = block->succs[j];
+      if (!hasPhis(succ))
+        continue;
+      split = newBlock(fn);
+      appendInstr(split, newInstr(fn, IR_JUMP, 0));
+      split->succs[0] = succ;
+      split->succCount = 1;
+      addEdge(block, split);
+      succ->preds[predIndex(succ, block)] = split;
+      block->succs[j] = split;
+    }
+  }
+}
+
+void lowerFunction(IRFunction* fn, Routine* routine) {
+  IRBlock* block;
+  IRBlock* next;
+  IRInstr* v;
+  IRInstr* term;
+  LowerInfo* info;
+  int frameSize = routine->frameSize;
+  CodeAddress frame;
+  int i, j, k;
+
+  loweredFunction = fn;
+  splitCriticalEdges(fn);
+  countUses(fn);
+  lowerInfo = (LowerInfo*) calloc(fn->nextId + 1, sizeof(LowerInfo));
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      v = fn->blocks[i]->instrs[j];
+      for (k = 0; k < v->argCount; k++) {
+        lowerInfo[v->args[k]->id].user = v;
+        lowerInfo[v->args[k]->id].userArg = k;
+      }
+    }
+  for (i = 0; i < fn->blockCount; i++)
+    decideBlock(fn->blocks[i]);
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      v = fn->blocks[i]->instrs[j];
+      if (lowerInfo[v->id].kind == LW_SLOT)
+        v->slot = allocateSlot(routine, &frameSize, v->isAddress);
+    }
+
+  frame = emitCode(lowered, OP_INT, 0, frameSize);
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    next = (i + 1 < fn->blockCount) ? fn->blocks[i + 1] : NULL;
+    block->address = lowered->codeSize;
+
+    for (j = 0; j < block->count; j++) {
+      v = block->instrs[j];
+      info = &(lowerInfo[v->id]);
+      if (irIsTerminator(v->op))
+        break;
+      if (info->kind == LW_SLOT && v->op != IR_PHI) {
+        emitCode(lowered, OP_LA, 0, v->slot);
+        emitTree(v);
+        emitCode(lowered, OP_ST, 0, 0);
+      } else if (info->kind == LW_ROOT) {
+        emitTree(v);
+        if (v->hasValue)
+          emitCode(lowered, OP_DCT, 0, 1);
+      }
+    }
+
+    term = terminatorOf(block);
+    switch (term->op) {
+    case IR_JUMP:
+      if (hasPhis(block->succs[0]))
+        emitPhiCopies(block, routine, &frameSize);
+      if (block->succs[0] != next)
+        addLowerFixup(emitCode(lowered, OP_J, 0, 0), block->succs[0], -1);
+      break;
+    case IR_BRANCH:
+      emitValue(term->args[0]);
+      addLowerFixup(emitCode(lowered, OP_FJ, 0, 0), block->succs[1], -1);
+      if (block->succs[0] != next)
+        addLowerFixup(emitCode(lowered, OP_J, 0, 0), block->succs[0], -1);
+      break;
+    case IR_RETURN:
+      if (term->argCount == 0)
+        emitCode(lowered, OP_EP, 0, 0);
+      else {
+        v = term->args[0];
+        if (!(v->op == IR_LOAD && lowerInfo[v->id].kind == LW_INLINE && v->args[0]->op == IR_ADDR &&
+              v->args[0]->a == 0 && v->args[0]->b == 0)) {
+          emitCode(lowered, OP_LA, 0, 0);
+          emitValue(v);
+          emitCode(lowered, OP_ST, 0, 0);
+        }
+        emitCode(lowered, OP_EF, 0, 0);
+      }
+      break;
+    default:
+      emitCode(lowered, OP_HL, 0, 0);
+      break;
+    }
+  }
+
+  lowered->code[frame].q = frameSize;
+  routine->frameSize = frameSize;
+  free(lowerInfo);
+}
+
+/* Copies the body of a routine that was not lifted */
+void copyRoutine(CodeBlock* code, int* owner, int r) {
+  CodeAddress* newAddress = (CodeAddress*) malloc((code->codeSize + 1) * sizeof(CodeAddress));
+  CodeAddress first = lowered->codeSize;
+  CodeAddress pc = code->routines[r].entry;
+  Instruction* inst;
+
+  if (code->code[pc].op == OP_J)
+    pc = code->code[pc].q;
+  for (; pc < code->codeSize; pc++) {
+    if (owner[pc] != r)
+      continue;
+    inst = &(code->code[pc]);
+    newAddress[pc] = emitCode(lowered, inst->op, inst->p, inst->q);
+    if (inst->op == OP_CALL)
+      addLowerFixup(newAddress[pc], NULL, routineAt(code, inst->q));
+  }
+  for (pc = first; pc < lowered->codeSize; pc++) {
+    inst = &(lowered->code[pc]);
+    if (inst->op == OP_J || inst->op == OP_FJ)
+      inst->q = newAddress[inst->q];
+  }
+  free(newAddress);
+}
+
+void lowerRoutine(IRProgram* program, int* owner, int r) {
+  CodeAddress jump = -1;
+  int child;
+
+  lowered->routines[r].entry = lowered->codeSize;
+  for (child = 0; child < program->functionCount; child++) {
+    if (program->parents[child] != r)
+      continue;
+    if (jump < 0)
+      jump = emitCode(lowered, OP_J, 0, 0);
+    lowerRoutine(program, owner, child);
+  }
+  if (jump >= 0)
+    lowered->code[jump].q = lowered->codeSize;
+
+  if (program->functions[r] != NULL)
+    lowerFunction(program->functions[r], &(lowered->routines[r]));
+  else copyRoutine(program->code, owner, r);
+}
+
+CodeBlock* lowerIR(IRProgram* program) {
+  CodeBlock* code = program->code;
+  Routine* source;
+  Routine* routine;
+  FrameSlot* slot;
+  int* owner = mapRoutines(code);
+  int r, i;
+
+  lowered = createCodeBlock();
+  loweredProgram = program;
+  fixupCount = 0;
+  for (r = 0; r < code->routineCount; r++) {
+    source = &(code->routines[r]);
+    routine = addRoutine(lowered, source->name, source->kind, 0);
+    routine->level = source->level;
+    routine->frameSize = source->frameSize;
+    routine->paramCount = source->paramCount;
+    for (i = 0; i < source->slotCount; i++) {
+      slot = addFrameSlot(routine, source->slots[i].name, source->slots[i].kind,
+                          source->slots[i].offset, source->slots[i].size);
+      *slot = source->slots[i];
+    }
+  }
+
+  for (r = 0; r < code->routineCount; r++)
+    if (program->parents[r] < 0)
+      lowerRoutine(program, owner, r);
+
+  for (i = 0; i < fixupCount; i++)
+    if (fixups[i].block != NULL)
+      lowered->code[fixups[i].address].q = fixups[i].block->address;
+    else lowered->code[fixups[i].address].q = lowered->routines[fixups[i].routine].entry;
+
+  free(fixups);
+  fixups = NULL;
+  maxFixups = 0;
+  free(owner);
+  return lowered;
+}
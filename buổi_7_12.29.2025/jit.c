@@ -0,0 +1,88 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "regcode.h"
+#include "x86gen.h"
+#include "kplrt.h"
+#include "vm.h"
+
+typedef void (*NativeProgram)(WORD* stack, WORD* limit);
+
+typedef struct {
+  NativeProgram entry;
+  void* memory;
+  size_t size;
+  int displaySize;          // words below the stack
+} NativeCode;
+
+/* Compiles to machine code in a buffer, then maps it read-only and
+ * executable: the code is never writable and executable at once */
+NativeCode compileNative(CodeBlock* codeBlock) {
+  RegCodeBlock* regCode = translateToRegisters(codeBlock);
+  X86Emitter* e = createBinaryEmitter();
+  NativeCode native;
+
+  genNativeCode(regCode, e);
+  x86ResolveLabels(e);
+
+  native.size = e->size;
+  native.memory = mmap(NULL, native.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (native.memory == MAP_FAILED)
+    kplRuntimeError("Can't allocate memory for the JIT.");
+  memcpy(native.memory, e->code, native.size);
+  if (mprotect(native.memory, native.size, PROT_READ | PROT_EXEC) != 0)
+    kplRuntimeError("Can't make the JIT code executable.");
+  native.entry = (NativeProgram) native.memory;
+  native.displaySize = displaySize(regCode->routines, regCode->routineCount);
+
+  freeEmitter(e);
+  freeRegCodeBlock(regCode);
+  return native;
+}
+
+void freeNative(NativeCode* native) {
+  munmap(native->memory, native->size);
+}
+
+void runNative(NativeCode* native) {
+  WORD* s = (WORD*) calloc(native->displaySize + NATIVE_STACK_SIZE + NATIVE_STACK_SLACK, sizeof(WORD));
+
+  native->entry(s + native->displaySize, s + native->displaySize + NATIVE_STACK_SIZE);
+  fflush(stdout);
+  free(s);
+}
+
+void runJit(CodeBlock* codeBlock) {
+  NativeCode native = compileNative(codeBlock);
+
+  runNative(&native);
+  freeNative(&native);
+}
+
+/* Reports the compile latency and the run time of the machine code */
+void benchmarkJit(CodeBlock* codeBlock) {
+  struct timespec start, compiled, end;
+  NativeCode native;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  native = compileNative(codeBlock);
+  clock_gettime(CLOCK_MONOTONIC, &compiled);
+  runNative(&native);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  fprintf(stderr, "dispatch:      native (jit)\n");
+  fprintf(stderr, "code size:     %ld bytes\n", (long) native.size);
+  fprintf(stderr, "compile time:  %.1f us\n", elapsedSeconds(&start, &compiled) * 1e6);
+  fprintf(stderr, "time:          %.6f s\n", elapsedSeconds(&compiled, &end));
+  freeNative(&native);
+}
@@ -0,0 +1,19 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "instructions.h"
+
+/* The JIT compiles a code block to x86-64 machine code in memory, with
+ * the same code generator as the assembly backend, and runs it in the
+ * compiler's own process. */
+
+void runJit(CodeBlock* codeBlock);
+void benchmarkJit(CodeBlock* codeBlock);
+
+#endif
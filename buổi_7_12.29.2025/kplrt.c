@@ -0,0 +1,52 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "kplrt.h"
+
+int kplSilent = 0;
+
+int kplReadInt(void) {
+  int i;
+  if (scanf("%d", &i) != 1)
+    i = 0;
+  return i;
+}
+
+int kplReadChar(void) {
+  return getchar();
+}
+
+void kplWriteInt(int i) {
+  if (!kplSilent) printf("%d", i);
+}
+
+void kplWriteChar(int ch) {
+  if (!kplSilent) putchar(ch);
+}
+
+void kplWriteLn(void) {
+  if (!kplSilent) putchar('\n');
+}
+
+void kplRuntimeError(char *msg) {
+  fflush(stdout);
+  fprintf(stderr, "Runtime error: %s\n", msg);
+  exit(1);
+}
+
+void kplDivisionByZero(void) {
+  kplRuntimeError("Division by zero.");
+}
+
+void kplIndexOutOfRange(void) {
+  kplRuntimeError("Index out of range.");
+}
+
+void kplStackOverflow(void) {
+  kplRuntimeError("Stack overflow.");
+}
@@ -0,0 +1,40 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __KPLRT_H__
+#define __KPLRT_H__
+
+/* Runtime support for the predefined subprograms READI, READC, WRITEI,
+ * WRITEC and WRITELN, shared by every way of running a KPL program. */
+
+extern int kplSilent;      // discard all output when set
+
+int kplReadInt(void);
+int kplReadChar(void);
+void kplWriteInt(int i);
+void kplWriteChar(int ch);
+void kplWriteLn(void);
+void kplRuntimeError(char *msg);
+void kplDivisionByZero(void);
+void kplIndexOutOfRange(void);
+void kplStackOverflow(void);
+
+/* KPL division, for the C backend: it traps on zero and wraps on
+ * the most negative number divided by -1, as the VM does */
+static inline int kplDiv(int a, int b) {
+  if (b == 0)
+    kplDivisionByZero();
+  return (b == -1) ? (int) (0u - (unsigned) a) : a / b;
+}
+
+/* An array index, checked against the size of the array */
+static inline int kplCheck(int i, int size) {
+  if ((unsigned) i >= (unsigned) size)
+    kplIndexOutOfRange();
+  return i;
+}
+
+#endif
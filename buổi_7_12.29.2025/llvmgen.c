@@ -0,0 +1,810 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reader.h"
+#include "symtab.h"
+#include "cgen.h"
+#include "llvmgen.h"
+
+/* The translator runs the stack code of each routine on a stack of LLVM
+ * values. Every load, store and call is printed where the stack code
+ * does it, so evaluation order is kept as is. Addresses remember the
+ * array they point into: adding a scaled index to them becomes one
+ * getelementptr step into the nested array type. */
+
+enum LEntryKind {
+  LE_RESERVED,      // a frame word reserved for a call
+  LE_VALUE,         // an i32
+  LE_CONDITION,     // an i1
+  LE_ADDRESS        // a pointer into a slot
+};
+
+typedef struct {
+  enum LEntryKind kind;
+  char* text;       // NULL for an index * factor not computed yet
+  char* index;
+  int factor;
+  int isConstant;
+  WORD constant;
+  FrameSlot* slot;  // the array an address points into, or NULL
+  int level;        // the address points at an element of dims[level..]
+} LEntry;
+
+CodeBlock* lCode;
+FILE* lOut;
+int* lOwner;
+int* lParent;
+int** lField;          // per routine and slot: the frame struct field, or -1
+char** lIsUsed;
+int* lHasStruct;
+char** lNames;
+char* lIsLabel;
+
+LEntry* lStack;
+int lDepth;
+int lMaxDepth;
+int lTempCount;
+int lTerminated;
+
+/******************* Types ******************************/
+
+char* levelType(FrameSlot* slot, int level) {
+  char* inner;
+  char* text;
+
+  if (slot == NULL || slot->kind != SLOT_ARRAY || level >= slot->dimCount)
+    return formatText("i32");
+  inner = levelType(slot, level + 1);
+  text = formatText("[%d x %s]", slot->dims[level], inner);
+  free(inner);
+  return text;
+}
+
+char* slotType(FrameSlot* slot) {
+  if (slot->kind == SLOT_REFERENCE)
+    return formatText("i32*");
+  return levelType(slot, 0);
+}
+
+int levelStride(FrameSlot* slot, int level) {
+  int stride = 1;
+  int d;
+  for (d = level + 1; d < slot->dimCount; d++)
+    stride *= slot->dims[d];
+  return stride;
+}
+
+/******************* Routines and frames ******************************/
+
+int isProgramRoutine(int routine) {
+  return lParent[routine] < 0;
+}
+
+int ancestorRoutine(int routine, int distance) {
+  if (distance == PROGRAM_FRAME)
+    distance = lCode->routines[routine].level;
+  while (distance-- > 0)
+    routine = lParent[routine];
+  return routine;
+}
+
+char* newTemp(void) {
+  return formatText("%%t%d", ++lTempCount);
+}
+
+char* llvmSlotName(FrameSlot* slot, int program) {
+  if (slot->name[0] == '\0')
+    return formatText(program ? "@result" : "%%result");
+  return lowerName(program ? "@g_" : "%v_", slot->name);
+}
+
+FrameSlot* llvmSlotAt(int r, int distance, int offset) {
+  FrameSlot* slot = findFrameSlot(&(lCode->routines[ancestorRoutine(r, distance)]), offset);
+  if (slot == NULL) {
+    fprintf(stderr, "llvmgen: no variable at offset %d\n", offset);
+    exit(1);
+  }
+  return slot;
+}
+
+/* The frame struct of the routine distance levels up from r */
+char* framePointer(int r, int distance) {
+  char* frame;
+  char* field;
+  int step;
+
+  if (distance == 0)
+    return formatText("%%f");
+  frame = formatText("%%up");
+  for (step = 1; step < distance; step++) {
+    r = ancestorRoutine(r, 1);
+    field = newTemp();
+    fprintf(lOut, "  %s = getelementptr %%frame.%s, %%frame.%s* %s, i32 0, i32 0\n",
+            field, lNames[r], lNames[r], frame);
+    free(frame);
+    frame = newTemp();
+    fprintf(lOut, "  %s = load %%frame.%s*, %%frame.%s** %s\n",
+            frame, lNames[lParent[r]], lNames[lParent[r]], field);
+    free(field);
+  }
+  return frame;
+}
+
+/* A pointer to the slot, of type slotType(slot)* */
+char* slotPointer(int r, int distance, FrameSlot* slot) {
+  int target = ancestorRoutine(r, distance);
+  int index = slot - lCode->routines[target].slots;
+  char* frame;
+  char* pointer;
+
+  if (isProgramRoutine(target))
+    return llvmSlotName(slot, 1);
+  if (lField[target][index] < 0)
+    return llvmSlotName(slot, 0);
+  frame = framePointer(r, distance);
+  pointer = newTemp();
+  fprintf(lOut, "  %s = getelementptr %%frame.%s, %%frame.%s* %s, i32 0, i32 %d\n",
+          pointer, lNames[target], lNames[target], frame, lField[target][index]);
+  free(frame);
+  return pointer;
+}
+
+/* Marks the slots the code uses, and gives those that nested routines
+ * use a field in the frame struct */
+void layoutFrames(void) {
+  Instruction* inst;
+  FrameSlot* slot;
+  int i, r, target, fields;
+  char* shared;
+
+  for (r = 0; r < lCode->routineCount; r++) {
+    lField[r] = (int*) malloc((lCode->routines[r].slotCount + 1) * sizeof(int));
+    lIsUsed[r] = (char*) calloc(lCode->routines[r].slotCount + 1, 1);
+    lHasStruct[r] = 0;
+  }
+  for (r = 0; r < lCode->routineCount; r++)
+    if (lParent[r] >= 0 && !isProgramRoutine(lParent[r]))
+      lHasStruct[lParent[r]] = 1;
+
+  for (r = 0; r < lCode->routineCount; r++)
+    for (i = 0; i < lCode->routines[r].slotCount; i++)
+      lField[r][i] = -1;
+  for (i = 0; i < lCode->codeSize; i++) {
+    inst = &(lCode->code[i]);
+    if ((inst->op != OP_LA && inst->op != OP_LV) || lOwner[i] < 0)
+      continue;
+    target = ancestorRoutine(lOwner[i], inst->p);
+    slot = llvmSlotAt(lOwner[i], inst->p, inst->q);
+    lIsUsed[target][slot - lCode->routines[target].slots] = 1;
+    if (inst->p > 0 && !isProgramRoutine(target))
+      lField[target][slot - lCode->routines[target].slots] = 0;
+  }
+
+  // Field 0 links to the enclosing frame
+  for (r = 0; r < lCode->routineCount; r++) {
+    fields = 1;
+    for (i = 0; i < lCode->routines[r].slotCount; i++)
+      if (lField[r][i] == 0)
+        lField[r][i] = fields++;
+  }
+
+  for (r = 0; r < lCode->routineCount; r++) {
+    if (!lHasStruct[r])
+      continue;
+    fprintf(lOut, "%%frame.%s = type { ", lNames[r]);
+    if (isProgramRoutine(lParent[r]))
+      fprintf(lOut, "i8*");
+    else fprintf(lOut, "%%frame.%s*", lNames[lParent[r]]);
+    for (i = 0; i < lCode->routines[r].slotCount; i++)
+      if (lField[r][i] > 0) {
+        shared = slotType(&(lCode->routines[r].slots[i]));
+        fprintf(lOut, ", %s", shared);
+        free(shared);
+      }
+    fprintf(lOut, " }\n");
+  }
+}
+
+/******************* The value stack ******************************/
+
+LEntry* pushLEntry(enum LEntryKind kind, char* text) {
+  LEntry* entry;
+
+  if (lDepth == lMaxDepth) {
+    lMaxDepth *= 2;
+    lStack = (LEntry*) realloc(lStack, lMaxDepth * sizeof(LEntry));
+  }
+  entry = &(lStack[lDepth++]);
+  memset(entry, 0, sizeof(LEntry));
+  entry->kind = kind;
+  entry->text = text;
+  return entry;
+}
+
+void dropLEntry(LEntry* entry) {
+  free(entry->text);
+  free(entry->index);
+}
+
+LEntry* popLEntry(void) {
+  return &(lStack[--lDepth]);
+}
+
+/* The i32 an entry stands for */
+char* valueOf(LEntry* entry) {
+  if (entry->kind == LE_CONDITION) {
+    char* value = newTemp();
+    fprintf(lOut, "  %s = zext i1 %s to i32\n", value, entry->text);
+    free(entry->text);
+    entry->text = value;
+    entry->kind = LE_VALUE;
+  } else if (entry->text == NULL) {
+    entry->text = newTemp();
+    fprintf(lOut, "  %s = mul i32 %s, %d\n", entry->text, entry->index, entry->factor);
+  }
+  return entry->text;
+}
+
+/* The i32* an address entry stands for */
+char* wordPointer(LEntry* entry) {
+  char* type;
+  char* element;
+
+  while (entry->slot != NULL && entry->level < entry->slot->dimCount) {
+    type = levelType(entry->slot, entry->level);
+    element = newTemp();
+    fprintf(lOut, "  %s = getelementptr %s, %s* %s, i32 0, i32 0\n", element, type, type, entry->text);
+    free(type);
+    free(entry->text);
+    entry->text = element;
+    entry->level++;
+  }
+  return entry->text;
+}
+
+void checkEmptyLStack(CodeAddress address) {
+  if (lDepth != 0) {
+    fprintf(stderr, "llvmgen: values left on the stack at %d\n", address);
+    exit(1);
+  }
+}
+
+/******************* Blocks ******************************/
+
+void beginBlock(char* name) {
+  if (!lTerminated)
+    fprintf(lOut, "  br label %%%s\n", name);
+  fprintf(lOut, "%s:\n", name);
+  lTerminated = 0;
+}
+
+void printTerminator(const char* text) {
+  fprintf(lOut, "  %s\n", text);
+  lTerminated = 1;
+}
+
+/******************* Translation ******************************/
+
+void translateLoadAddress(int r, Instruction* inst) {
+  FrameSlot* slot = llvmSlotAt(r, inst->p, inst->q);
+  LEntry* entry = pushLEntry(LE_ADDRESS, slotPointer(r, inst->p, slot));
+  char* element;
+  int offset = inst->q - slot->offset;
+
+  entry->slot = slot;
+  entry->level = 0;
+  if (offset != 0) {
+    wordPointer(entry);
+    element = newTemp();
+    fprintf(lOut, "  %s = getelementptr i32, i32* %s, i32 %d\n", element, entry->text, offset);
+    free(entry->text);
+    entry->text = element;
+  }
+}
+
+void translateLoadValue(int r, Instruction* inst) {
+  FrameSlot* slot = llvmSlotAt(r, inst->p, inst->q);
+  char* pointer = slotPointer(r, inst->p, slot);
+  char* value = newTemp();
+
+  if (slot->kind == SLOT_REFERENCE) {
+    fprintf(lOut, "  %s = load i32*, i32** %s\n", value, pointer);
+    pushLEntry(LE_ADDRESS, value);
+  } else {
+    fprintf(lOut, "  %s = load i32, i32* %s\n", value, pointer);
+    pushLEntry(LE_VALUE, value);
+  }
+  free(pointer);
+}
+
+void translateLLVMArithmetic(Instruction* inst) {
+  LEntry right = *popLEntry();
+  LEntry left = *popLEntry();
+  LEntry* entry;
+  LEntry swap;
+  char* type;
+  char* text;
+  char* offset;
+
+  // The optimizer may put the address of a sum second
+  if (inst->op == OP_AD && right.kind == LE_ADDRESS && left.kind != LE_ADDRESS) {
+    swap = left;
+    left = right;
+    right = swap;
+  }
+  if (left.kind == LE_ADDRESS && (inst->op == OP_AD || inst->op == OP_SB)) {
+    entry = pushLEntry(LE_ADDRESS, NULL);
+    entry->slot = left.slot;
+    entry->level = left.level;
+    if (inst->op == OP_AD && left.slot != NULL && left.level < left.slot->dimCount &&
+        right.text == NULL && right.factor == levelStride(left.slot, left.level)) {
+      // One step into the nested array
+      type = levelType(left.slot, left.level);
+      entry->text = newTemp();
+      fprintf(lOut, "  %s = getelementptr %s, %s* %s, i32 0, i32 %s\n",
+              entry->text, type, type, left.text, right.index);
+      entry->level++;
+      free(type);
+    } else {
+      wordPointer(&left);
+      entry->slot = NULL;
+      offset = valueOf(&right);
+      if (inst->op == OP_SB) {
+        offset = newTemp();
+        fprintf(lOut, "  %s = sub i32 0, %s\n", offset, right.text);
+        free(right.text);
+        right.text = offset;
+      }
+      entry->text = newTemp();
+      fprintf(lOut, "  %s = getelementptr i32, i32* %s, i32 %s\n", entry->text, left.text, offset);
+    }
+  } else if (inst->op == OP_ML && right.isConstant) {
+    // Kept as index * factor, in case an address is indexed by it
+    entry = pushLEntry(LE_VALUE, NULL);
+    entry->index = formatText("%s", valueOf(&left));
+    entry->factor = right.constant;
+  } else if (inst->op == OP_DV && !(right.isConstant && right.constant != 0 && right.constant != -1)) {
+    text = newTemp();
+    fprintf(lOut, "  %s = call i32 @kplDiv(i32 %s, i32 %s)\n", text, valueOf(&left), valueOf(&right));
+    pushLEntry(LE_VALUE, text);
+  } else if (inst->op >= OP_EQ) {
+    static char* conditions[] = { "eq", "ne", "sgt", "slt", "sge", "sle" };
+    text = newTemp();
+    fprintf(lOut, "  %s = icmp %s i32 %s, %s\n", text, conditions[inst->op - OP_EQ], valueOf(&left), valueOf(&right));
+    pushLEntry(LE_CONDITION, text);
+  } else {
+    static char* operations[] = { "add", "sub", "mul", "sdiv" };
+    text = newTemp();
+    fprintf(lOut, "  %s = %s i32 %s, %s\n", text, operations[inst->op - OP_AD], valueOf(&left), valueOf(&right));
+    pushLEntry(LE_VALUE, text);
+  }
+  dropLEntry(&left);
+  dropLEntry(&right);
+}
+
+void translateLLVMCall(int r, Instruction* inst, LEntry* args, int argCount) {
+  Routine* routine;
+  FrameSlot* slot;
+  char* up = NULL;
+  char* result = NULL;
+  int callee, i, arg;
+
+  for (callee = 0; callee < lCode->routineCount; callee++)
+    if (lCode->routines[callee].entry == inst->q)
+      break;
+  routine = &(lCode->routines[callee]);
+
+  if (!isProgramRoutine(lParent[callee]))
+    up = framePointer(r, inst->p);
+  // The arguments are ready before the call is printed
+  for (i = 0; i < argCount; i++)
+    if (args[i].kind == LE_ADDRESS)
+      wordPointer(&(args[i]));
+    else valueOf(&(args[i]));
+
+  if (routine->kind == RT_FUNCTION) {
+    result = newTemp();
+    fprintf(lOut, "  %s = call i32 @kpl.%s(", result, lNames[callee]);
+  } else fprintf(lOut, "  call void @kpl.%s(", lNames[callee]);
+  if (up != NULL)
+    fprintf(lOut, "%%frame.%s* %s", lNames[lParent[callee]], up);
+
+  arg = 0;
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    if (!slot->isParameter || arg >= argCount)
+      continue;
+    fprintf(lOut, "%s%s %s", (arg > 0 || up != NULL) ? ", " : "",
+            slot->kind == SLOT_REFERENCE ? "i32*" : "i32", args[arg].text);
+    dropLEntry(&(args[arg]));
+    arg++;
+  }
+  fprintf(lOut, ")\n");
+  free(up);
+
+  if (result != NULL)
+    pushLEntry(LE_VALUE, result);
+}
+
+void translateLLVMCode(int r) {
+  Routine* routine = &(lCode->routines[r]);
+  LEntry args[256];
+  LEntry* entry;
+  LEntry* copy;
+  Instruction* inst;
+  CodeAddress i = routine->entry;
+  char name[32];
+  char* text;
+  char* pointer;
+  int argCount = 0;
+  int k;
+
+  if (lCode->code[i].op == OP_J)
+    i = lCode->code[i].q;
+  if (lCode->code[i].op == OP_INT)
+    i++;
+
+  lDepth = 0;
+  for (; i < lCode->codeSize; i++) {
+    if (lOwner[i] != r)
+      continue;
+    inst = &(lCode->code[i]);
+    if (lIsLabel[i]) {
+      checkEmptyLStack(i);
+      sprintf(name, "L%d", i);
+      beginBlock(name);
+    } else if (lTerminated) {
+      // Code after a jump that nothing jumps to
+      sprintf(name, "D%d", i);
+      beginBlock(name);
+    }
+
+    switch (inst->op) {
+    case OP_LA:
+      translateLoadAddress(r, inst);
+      break;
+    case OP_LV:
+      translateLoadValue(r, inst);
+      break;
+    case OP_LC:
+      entry = pushLEntry(LE_VALUE, formatText("%d", inst->q));
+      entry->isConstant = 1;
+      entry->constant = inst->q;
+      break;
+    case OP_LI:
+      entry = &(lStack[lDepth - 1]);
+      pointer = wordPointer(entry);
+      text = newTemp();
+      fprintf(lOut, "  %s = load i32, i32* %s\n", text, pointer);
+      dropLEntry(entry);
+      memset(entry, 0, sizeof(LEntry));
+      entry->kind = LE_VALUE;
+      entry->text = text;
+      break;
+    case OP_INT:
+      for (k = 0; k < inst->q; k++)
+        pushLEntry(LE_RESERVED, NULL);
+      break;
+    case OP_DCT:
+      argCount = inst->q - RESERVED_WORDS;
+      for (k = 0; k < argCount; k++)
+        args[k] = lStack[lDepth - argCount + k];
+      lDepth -= inst->q;
+      break;
+    case OP_J:
+      checkEmptyLStack(i);
+      text = formatText("br label %%L%d", inst->q);
+      printTerminator(text);
+      free(text);
+      break;
+    case OP_FJ:
+      entry = popLEntry();
+      checkEmptyLStack(i);
+      if (entry->kind != LE_CONDITION) {
+        text = newTemp();
+        fprintf(lOut, "  %s = icmp ne i32 %s, 0\n", text, valueOf(entry));
+        free(entry->text);
+        entry->text = text;
+      }
+      text = formatText("br i1 %s, label %%N%d, label %%L%d", entry->text, i, inst->q);
+      printTerminator(text);
+      free(text);
+      dropLEntry(entry);
+      sprintf(name, "N%d", i);
+      fprintf(lOut, "%s:\n", name);
+      lTerminated = 0;
+      break;
+    case OP_HL:
+      printTerminator("ret i32 0");
+      break;
+    case OP_ST:
+      entry = popLEntry();
+      copy = &(lStack[lDepth - 1]);
+      if (copy->slot != NULL && copy->slot->kind == SLOT_REFERENCE) {
+        // A temporary of the optimizer that holds an address
+        fprintf(lOut, "  store i32* %s, i32** %s\n", wordPointer(entry), copy->text);
+      } else {
+        valueOf(entry);
+        pointer = wordPointer(copy);
+        fprintf(lOut, "  store i32 %s, i32* %s\n", entry->text, pointer);
+      }
+      dropLEntry(entry);
+      dropLEntry(popLEntry());
+      break;
+    case OP_CALL:
+      translateLLVMCall(r, inst, args, argCount);
+      argCount = 0;
+      break;
+    case OP_EP:
+      printTerminator("ret void");
+      break;
+    case OP_EF:
+      pointer = slotPointer(r, 0, &(routine->slots[0]));
+      text = newTemp();
+      fprintf(lOut, "  %s = load i32, i32* %s\n", text, pointer);
+      free(pointer);
+      pointer = formatText("ret i32 %s", text);
+      printTerminator(pointer);
+      free(pointer);
+      free(text);
+      break;
+    case OP_RC:
+    case OP_RI:
+      text = newTemp();
+      fprintf(lOut, "  %s = call i32 @%s()\n", text, inst->op == OP_RC ? "kplReadChar" : "kplReadInt");
+      pushLEntry(LE_VALUE, text);
+      break;
+    case OP_WRC:
+    case OP_WRI:
+      entry = popLEntry();
+      fprintf(lOut, "  call void @%s(i32 %s)\n", inst->op == OP_WRC ? "kplWriteChar" : "kplWriteInt", valueOf(entry));
+      dropLEntry(entry);
+      break;
+    case OP_WLN:
+      fprintf(lOut, "  call void @kplWriteLn()\n");
+      break;
+    case OP_NEG:
+      entry = &(lStack[lDepth - 1]);
+      text = newTemp();
+      fprintf(lOut, "  %s = sub i32 0, %s\n", text, valueOf(entry));
+      dropLEntry(entry);
+      memset(entry, 0, sizeof(LEntry));
+      entry->kind = LE_VALUE;
+      entry->text = text;
+      break;
+    case OP_CK:
+      entry = &(lStack[lDepth - 1]);
+      text = newTemp();
+      fprintf(lOut, "  %s = call i32 @kplCheck(i32 %s, i32 %d)\n", text, valueOf(entry), inst->q);
+      dropLEntry(entry);
+      memset(entry, 0, sizeof(LEntry));
+      entry->kind = LE_VALUE;
+      entry->text = text;
+      break;
+    case OP_CV:
+      entry = &(lStack[lDepth - 1]);
+      if (entry->kind != LE_ADDRESS)
+        valueOf(entry);
+      copy = pushLEntry(LE_VALUE, NULL);
+      *copy = lStack[lDepth - 2];
+      copy->text = formatText("%s", copy->text);
+      copy->index = NULL;
+      break;
+    default:
+      translateLLVMArithmetic(inst);
+      break;
+    }
+  }
+  if (!lTerminated)
+    printTerminator("unreachable");
+}
+
+void printLLVMHeader(int r) {
+  Routine* routine = &(lCode->routines[r]);
+  FrameSlot* slot;
+  char* name;
+  int i, first = 1;
+
+  fprintf(lOut, "define internal %s @kpl.%s(", routine->kind == RT_FUNCTION ? "i32" : "void", lNames[r]);
+  if (!isProgramRoutine(lParent[r])) {
+    fprintf(lOut, "%%frame.%s* %%up", lNames[lParent[r]]);
+    first = 0;
+  }
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    if (!slot->isParameter)
+      continue;
+    name = lowerName("%p_", slot->name);
+    fprintf(lOut, "%s%s %s", first ? "" : ", ", slot->kind == SLOT_REFERENCE ? "i32*" : "i32", name);
+    free(name);
+    first = 0;
+  }
+  fprintf(lOut, ") {\n");
+}
+
+void printLLVMLocals(int r) {
+  Routine* routine = &(lCode->routines[r]);
+  FrameSlot* slot;
+  char* type;
+  char* name;
+  char* param;
+  char* pointer;
+  int i;
+
+  if (lHasStruct[r])
+    fprintf(lOut, "  %%f = alloca %%frame.%s\n", lNames[r]);
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    if (lField[r][i] >= 0 || (!lIsUsed[r][i] && slot->name[0] != '\0'))
+      continue;
+    type = slotType(slot);
+    name = llvmSlotName(slot, 0);
+    fprintf(lOut, "  %s = alloca %s\n", name, type);
+    free(type);
+    free(name);
+  }
+
+  if (lHasStruct[r] && !isProgramRoutine(lParent[r])) {
+    fprintf(lOut, "  %%f.up = getelementptr %%frame.%s, %%frame.%s* %%f, i32 0, i32 0\n", lNames[r], lNames[r]);
+    fprintf(lOut, "  store %%frame.%s* %%up, %%frame.%s** %%f.up\n", lNames[lParent[r]], lNames[lParent[r]]);
+  }
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    if (!slot->isParameter || (lField[r][i] < 0 && !lIsUsed[r][i]))
+      continue;
+    type = slotType(slot);
+    param = lowerName("%p_", slot->name);
+    pointer = slotPointer(r, 0, slot);
+    fprintf(lOut, "  store %s %s, %s* %s\n", type, param, type, pointer);
+    free(type);
+    free(param);
+    free(pointer);
+  }
+}
+
+void translateLLVMRoutine(int r) {
+  lTempCount = 0;
+  lTerminated = 0;
+  fprintf(lOut, "\n; %s\n", lCode->routines[r].name);
+  if (isProgramRoutine(r))
+    fprintf(lOut, "define i32 @main() {\n");
+  else printLLVMHeader(r);
+  fprintf(lOut, "entry:\n");
+  if (!isProgramRoutine(r))
+    printLLVMLocals(r);
+  translateLLVMCode(r);
+  fprintf(lOut, "}\n");
+}
+
+void printLLVMGlobals(int program) {
+  Routine* routine = &(lCode->routines[program]);
+  char* type;
+  char* name;
+  int i;
+
+  for (i = 0; i < routine->slotCount; i++) {
+    if (!lIsUsed[program][i])
+      continue;
+    type = slotType(&(routine->slots[i]));
+    name = llvmSlotName(&(routine->slots[i]), 1);
+    fprintf(lOut, "%s = internal global %s zeroinitializer\n", name, type);
+    free(type);
+    free(name);
+  }
+}
+
+void printRuntime(void) {
+  fprintf(lOut, "\ndeclare i32 @kplReadInt()\n");
+  fprintf(lOut, "declare i32 @kplReadChar()\n");
+  fprintf(lOut, "declare void @kplWriteInt(i32)\n");
+  fprintf(lOut, "declare void @kplWriteChar(i32)\n");
+  fprintf(lOut, "declare void @kplWriteLn()\n");
+  fprintf(lOut, "declare void @kplDivisionByZero() noreturn\n");
+  fprintf(lOut, "declare void @kplIndexOutOfRange() noreturn\n");
+
+  // KPL division traps on zero and wraps on the most negative number / -1
+  fprintf(lOut, "\ndefine internal i32 @kplDiv(i32 %%a, i32 %%b) {\n");
+  fprintf(lOut, "entry:\n");
+  fprintf(lOut, "  %%zero = icmp eq i32 %%b, 0\n");
+  fprintf(lOut, "  br i1 %%zero, label %%trap, label %%check\n");
+  fprintf(lOut, "trap:\n");
+  fprintf(lOut, "  call void @kplDivisionByZero()\n");
+  fprintf(lOut, "  unreachable\n");
+  fprintf(lOut, "check:\n");
+  fprintf(lOut, "  %%minus = icmp eq i32 %%b, -1\n");
+  fprintf(lOut, "  br i1 %%minus, label %%negate, label %%divide\n");
+  fprintf(lOut, "negate:\n");
+  fprintf(lOut, "  %%negated = sub i32 0, %%a\n");
+  fprintf(lOut, "  ret i32 %%negated\n");
+  fprintf(lOut, "divide:\n");
+  fprintf(lOut, "  %%quotient = sdiv i32 %%a, %%b\n");
+  fprintf(lOut, "  ret i32 %%quotient\n");
+  fprintf(lOut, "}\n");
+
+  // An array index must lie in 0 .. size - 1
+  fprintf(lOut, "\ndefine internal i32 @kplCheck(i32 %%i, i32 %%size) {\n");
+  fprintf(lOut, "entry:\n");
+  fprintf(lOut, "  %%outside = icmp uge i32 %%i, %%size\n");
+  fprintf(lOut, "  br i1 %%outside, label %%trap, label %%inside\n");
+  fprintf(lOut, "trap:\n");
+  fprintf(lOut, "  call void @kplIndexOutOfRange()\n");
+  fprintf(lOut, "  unreachable\n");
+  fprintf(lOut, "inside:\n");
+  fprintf(lOut, "  ret i32 %%i\n");
+  fprintf(lOut, "}\n");
+}
+
+char* llvmRoutineName(int r) {
+  char* name = lowerName("", lCode->routines[r].name);
+  char* unique;
+  int i;
+
+  for (i = 0; i < lCode->routineCount; i++)
+    if (i != r && strcmp(lCode->routines[i].name, lCode->routines[r].name) == 0) {
+      unique = formatText("%s.%d", name, r);
+      free(name);
+      return unique;
+    }
+  return name;
+}
+
+int saveLLVM(CodeBlock* codeBlock, char* fileName) {
+  Instruction* inst;
+  int i, r, program = 0;
+
+  lOut = fopen(fileName, "w");
+  if (lOut == NULL)
+    return IO_ERROR;
+
+  lCode = codeBlock;
+  lOwner = mapRoutines(codeBlock);
+  lParent = (int*) malloc(codeBlock->routineCount * sizeof(int));
+  lField = (int**) malloc(codeBlock->routineCount * sizeof(int*));
+  lIsUsed = (char**) malloc(codeBlock->routineCount * sizeof(char*));
+  lHasStruct = (int*) malloc(codeBlock->routineCount * sizeof(int));
+  lNames = (char**) malloc(codeBlock->routineCount * sizeof(char*));
+  lIsLabel = (char*) calloc(codeBlock->codeSize + 1, 1);
+  lMaxDepth = 64;
+  lStack = (LEntry*) malloc(lMaxDepth * sizeof(LEntry));
+
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    lParent[r] = findParentRoutine(codeBlock, r);
+    lNames[r] = llvmRoutineName(r);
+    if (lParent[r] < 0)
+      program = r;
+  }
+  for (i = 0; i < codeBlock->codeSize; i++) {
+    inst = &(codeBlock->code[i]);
+    if ((inst->op == OP_J || inst->op == OP_FJ) && findRoutine(codeBlock, i) == NULL)
+      lIsLabel[inst->q] = 1;
+  }
+
+  fprintf(lOut, "; %s, translated from KPL by kplc\n\n", codeBlock->routines[program].name);
+  layoutFrames();
+  printLLVMGlobals(program);
+  printRuntime();
+  for (r = 0; r < codeBlock->routineCount; r++)
+    translateLLVMRoutine(r);
+
+  fclose(lOut);
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    free(lField[r]);
+    free(lIsUsed[r]);
+    free(lNames[r]);
+  }
+  free(lStack);
+  free(lIsLabel);
+  free(lNames);
+  free(lHasStruct);
+  free(lIsUsed);
+  free(lField);
+  free(lParent);
+  free(lOwner);
+  return IO_SUCCESS;
+}
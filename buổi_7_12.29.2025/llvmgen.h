@@ -0,0 +1,23 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __LLVMGEN_H__
+#define __LLVMGEN_H__
+
+#include "instructions.h"
+
+/* Translates a code block into textual LLVM IR. Every routine becomes a
+ * function whose variables are allocas; program variables are globals,
+ * and the variables used by nested routines live in a frame struct that
+ * the nested routines reach through an environment pointer. Array
+ * elements are addressed with getelementptr on the nested array types.
+ * The IR uses typed pointers (LLVM 14); build it with
+ *   llc -O2 -relocation-model=pic program.ll -o program.s && gcc program.s kplrt.c
+ * or run opt -O2 on it first. */
+
+int saveLLVM(CodeBlock* codeBlock, char* fileName);
+
+#endif
@@ -6,22 +6,129 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reader.h"
 #include "parser.h"
+#include "codegen.h"
+#include "vm.h"
+#include "x86gen.h"
+#include "jit.h"
+#include "cgen.h"
+#include "llvmgen.h"
+#include "passes.h"
 
 /******************************************************************/
 
 int main(int argc, char *argv[]) {
-  if (argc <= 1) {
+  char *inputFileName = NULL;
+  int dumpCode = 0;
+  int runProgram = 0;
+  int benchmark = 0;
+  int useRegisters = 0;
+  int useJit = 0;
+  char *assemblyFileName = NULL;
+  char *cFileName = NULL;
+  char *llvmFileName = NULL;
+  int optimizationLevel = 0;
+  int printTimings = 0;
+  CodeBlock* optimized;
+  RegCodeBlock* regCode = NULL;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+      importFileName = argv[++i];
+    else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+      exportFileName = argv[++i];
+    else if (strcmp(argv[i], "-s") == 0)
+      printSymTab = 2;
+    else if (strcmp(argv[i], "-d") == 0)
+      dumpCode = 1;
+    else if (strcmp(argv[i], "-r") == 0)
+      runProgram = 1;
+    else if (strcmp(argv[i], "-b") == 0)
+      benchmark = 1;
+    else if (strcmp(argv[i], "-R") == 0)
+      useRegisters = 1;
+    else if (strcmp(argv[i], "-j") == 0)
+      useJit = 1;
+    else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+      assemblyFileName = argv[++i];
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      cFileName = argv[++i];
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+      llvmFileName = argv[++i];
+    else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0)
+      optimizationLevel = argv[i][2] - '0';
+    else if (strcmp(argv[i], "-t") == 0)
+      printTimings = 1;
+    else if (strcmp(argv[i], "-p") == 0)
+      printIR = 1;
+    else inputFileName = argv[i];
+  }
+
+  if (inputFileName == NULL) {
     printf("parser: no input file.\n");
+    printf("usage: kplc <input> [-s] [-d] [-r] [-b] [-R] [-j] [-a asm-out] [-c c-out] [-l llvm-out] [-O0|-O1|-O2] [-t] [-p] [-i symtab-in] [-e symtab-out]\n");
     return -1;
   }
 
-  if (compile(argv[1]) == IO_ERROR) {
+  // The symbol table is listed unless some other output is asked for
+  if ((dumpCode || runProgram || benchmark || assemblyFileName != NULL || cFileName != NULL || llvmFileName != NULL) && printSymTab != 2)
+    printSymTab = 0;
+
+  if (compile(inputFileName) == IO_ERROR) {
     printf("Can\'t read input file!\n");
     return -1;
   }
-    
+
+  // -O1 and -O2 rebuild the code through the optimizer
+  if (optimizationLevel > 0) {
+    optimized = optimizeCode(codeBlock, optimizationLevel);
+    freeCodeBlock(codeBlock);
+    codeBlock = optimized;
+    if (printTimings)
+      printPassTimings();
+  }
+
+  if (dumpCode && !useRegisters)
+    printCodeBuffer();
+
+  if (cFileName != NULL && saveC(codeBlock, cFileName) == IO_ERROR)
+    printf("Can\'t write %s!\n", cFileName);
+  if (llvmFileName != NULL && saveLLVM(codeBlock, llvmFileName) == IO_ERROR)
+    printf("Can\'t write %s!\n", llvmFileName);
+
+  // -R runs and dumps the register code translated from the stack code,
+  // which the native backend compiles further
+  if (useRegisters || assemblyFileName != NULL) {
+    regCode = translateToRegisters(codeBlock);
+    if (dumpCode && useRegisters)
+      printRegCodeBlock(regCode);
+    if (assemblyFileName != NULL && saveAssembly(regCode, assemblyFileName) == IO_ERROR)
+      printf("Can\'t write %s!\n", assemblyFileName);
+  }
+
+  if (useJit) {
+    if (runProgram)
+      runJit(codeBlock);
+    else if (benchmark)
+      benchmarkJit(codeBlock);
+  } else if (useRegisters) {
+    if (runProgram)
+      runRegCode(regCode, DEFAULT_STACK_SIZE);
+    else if (benchmark)
+      benchmarkRegCode(regCode, DEFAULT_STACK_SIZE);
+  } else {
+    if (runProgram)
+      runCode(codeBlock, DEFAULT_STACK_SIZE);
+    else if (benchmark)
+      benchmarkCode(codeBlock, DEFAULT_STACK_SIZE);
+  }
+
+  if (regCode != NULL)
+    freeRegCodeBlock(regCode);
+  cleanCodeBuffer();
   return 0;
 }
@@ -28,7 +28,12 @@ void compileFuncDecl(void);
 void compileProcDecl(void);
 ConstantValue* compileUnsignedConstant(void);
 ConstantValue* compileConstant(void);
-ConstantValue* compileConstant2(void);
+int compileConstant2(void);
+int compileConstantTerm(void);
+int compileConstantFactor(void);
+int evaluateOperator(TokenType op, int a, int b);
+void genOperator(TokenType op);
+void genNegation(void);
 Type* compileType(void);
 Type* compileBasicType(void);
 void compileParams(void);
@@ -54,6 +59,10 @@ void compileTerm2(void);
 Type* compileFactor(void);
 Type* compileIndexes(Type* arrayType);
 
+extern char *importFileName;
+extern char *exportFileName;
+extern int printSymTab;
+
 int compile(char *fileName);
 
 #endif
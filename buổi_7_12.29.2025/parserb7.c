@@ -4,6 +4,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "reader.h"
 #include "scanner.h"
@@ -11,10 +12,17 @@
 #include "semantics.h"
 #include "error.h"
 #include "debug.h"
+#include "snapshot.h"
+#include "codegen.h"
 
 Token *currentToken;
 Token *lookAhead;
 
+char *importFileName = NULL;
+char *exportFileName = NULL;
+int printSymTab = 1;
+Scope* importedScope = NULL;
+
 extern Type* intType;
 extern Type* charType;
 extern SymTab* symtab;
@@ -39,6 +47,8 @@ void compileProgram(void) {
   eat(TK_IDENT);
 
   program = createProgramObject(currentToken->string);
+  // Declarations loaded from a snapshot are visible as an enclosing scope
+  program->progAttrs->scope->outer = importedScope;
   enterBlock(program->progAttrs->scope);
 
   eat(SB_SEMICOLON);
@@ -46,6 +56,7 @@ void compileProgram(void) {
   compileBlock();
   eat(SB_PERIOD);
 
+  genHL();
   exitBlock();
 }
 
@@ -65,7 +76,8 @@ void compileBlock(void) {
       eat(SB_EQ);
       constValue = compileConstant();
       
-      constObj->constAttrs->value = constValue;
+      *(constObj->constAttrs->value) = *constValue;
+      free(constValue);
       declareObject(constObj);
       
       eat(SB_SEMICOLON);
@@ -131,7 +143,18 @@ void compileBlock3(void) {
 }
 
 void compileBlock4(void) {
-  compileSubDecls();
+  CodeAddress jmp;
+
+  genRoutineEntry(symtab->currentScope->owner);
+
+  // The code of nested subprograms comes first and is jumped over
+  if ((lookAhead->tokenType == KW_FUNCTION) || (lookAhead->tokenType == KW_PROCEDURE)) {
+    jmp = genJ(DC_VALUE);
+    compileSubDecls();
+    updateJ(jmp, getCurrentCodeAddress());
+  }
+
+  genINT(symtab->currentScope->frameSize);
   compileBlock5();
 }
 
@@ -170,6 +193,7 @@ void compileFuncDecl(void) {
 
   eat(SB_SEMICOLON);
   compileBlock();
+  genEF();
   eat(SB_SEMICOLON);
 
   exitBlock();
@@ -191,13 +215,14 @@ void compileProcDecl(void) {
 
   eat(SB_SEMICOLON);
   compileBlock();
+  genEP();
   eat(SB_SEMICOLON);
 
   exitBlock();
 }
 
 ConstantValue* compileUnsignedConstant(void) {
-  ConstantValue* constValue;
+  ConstantValue* constValue = NULL;
   Object* obj;
 
   switch (lookAhead->tokenType) {
@@ -226,53 +251,148 @@ ConstantValue* compileUnsignedConstant(void) {
 ConstantValue* compileConstant(void) {
   ConstantValue* constValue;
 
+  if (lookAhead->tokenType == TK_CHAR) {
+    eat(TK_CHAR);
+    constValue = makeCharConstant(currentToken->string[0]);
+  } else constValue = makeIntConstant(compileConstant2());
+  return constValue;
+}
+
+/* An integer constant expression, evaluated as it is parsed; as in
+ * compileExpression() the sign applies to the first term only */
+int compileConstant2(void) {
+  int value;
+  TokenType op;
+
   switch (lookAhead->tokenType) {
   case SB_PLUS:
     eat(SB_PLUS);
-    constValue = compileConstant2();
+    value = compileConstantTerm();
     break;
   case SB_MINUS:
     eat(SB_MINUS);
-    constValue = compileConstant2();
-    constValue->intValue = - constValue->intValue;
-    break;
-  case TK_CHAR:
-    eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->string[0]);
+    value = evaluateOperator(SB_MINUS, 0, compileConstantTerm());
     break;
   default:
-    constValue = compileConstant2();
+    value = compileConstantTerm();
     break;
   }
-  return constValue;
+
+  while ((lookAhead->tokenType == SB_PLUS) || (lookAhead->tokenType == SB_MINUS)) {
+    op = lookAhead->tokenType;
+    eat(op);
+    value = evaluateOperator(op, value, compileConstantTerm());
+  }
+  return value;
 }
 
-ConstantValue* compileConstant2(void) {
-  ConstantValue* constValue;
+int compileConstantTerm(void) {
+  int value;
+  TokenType op;
+
+  value = compileConstantFactor();
+  while ((lookAhead->tokenType == SB_TIMES) || (lookAhead->tokenType == SB_SLASH)) {
+    op = lookAhead->tokenType;
+    eat(op);
+    value = evaluateOperator(op, value, compileConstantFactor());
+  }
+  return value;
+}
+
+int compileConstantFactor(void) {
+  int value = 0;
   Object* obj;
 
   switch (lookAhead->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
-    constValue = makeIntConstant(currentToken->value);
+    value = currentToken->value;
     break;
   case TK_IDENT:
     eat(TK_IDENT);
     obj = checkDeclaredConstant(currentToken->string);
     if (obj->constAttrs->value->type == TP_INT)
-      constValue = duplicateConstantValue(obj->constAttrs->value);
+      value = obj->constAttrs->value->intValue;
     else
       error(ERR_UNDECLARED_INT_CONSTANT,currentToken->lineNo, currentToken->colNo);
     break;
+  case SB_LPAR:
+    eat(SB_LPAR);
+    value = compileConstant2();
+    eat(SB_RPAR);
+    break;
   default:
     error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
     break;
   }
-  return constValue;
+  return value;
+}
+
+/* The value of a op b at compile time. A division by zero or a result
+ * that does not fit in an integer is an error, reported where the right
+ * operand ends. */
+int evaluateOperator(TokenType op, int a, int b) {
+  long long value;
+
+  switch (op) {
+  case SB_PLUS:  value = (long long) a + b; break;
+  case SB_MINUS: value = (long long) a - b; break;
+  case SB_TIMES: value = (long long) a * b; break;
+  case SB_SLASH:
+    if (b == 0)
+      error(ERR_DIVISION_BY_ZERO, currentToken->lineNo, currentToken->colNo);
+    value = (long long) a / b;
+    break;
+  case SB_EQ:  return a == b;
+  case SB_NEQ: return a != b;
+  case SB_LE:  return a <= b;
+  case SB_LT:  return a < b;
+  case SB_GE:  return a >= b;
+  case SB_GT:  return a > b;
+  default:
+    value = 0;
+    break;
+  }
+  if ((value < INT_MIN) || (value > INT_MAX))
+    error(ERR_CONSTANT_OVERFLOW, currentToken->lineNo, currentToken->colNo);
+  return (int) value;
+}
+
+/* Generates the operator op, or its result when both operands are
+ * constants: no foldable arithmetic is left for run time */
+void genOperator(TokenType op) {
+  WORD a, b;
+
+  if (endsWithConstants(2)) {
+    b = popConstant();
+    a = popConstant();
+    genLC(evaluateOperator(op, a, b));
+    return;
+  }
+
+  switch (op) {
+  case SB_PLUS:  genAD(); break;
+  case SB_MINUS: genSB(); break;
+  case SB_TIMES: genML(); break;
+  case SB_SLASH: genDV(); break;
+  case SB_EQ:  genEQ(); break;
+  case SB_NEQ: genNE(); break;
+  case SB_LE:  genLE(); break;
+  case SB_LT:  genLT(); break;
+  case SB_GE:  genGE(); break;
+  case SB_GT:  genGT(); break;
+  default: break;
+  }
+}
+
+void genNegation(void) {
+  if (endsWithConstants(1))
+    genLC(evaluateOperator(SB_MINUS, 0, popConstant()));
+  else genNEG();
 }
 
 Type* compileType(void) {
-  Type* type;
+  Type* type = NULL;
   Type* elementType;
   int arraySize;
   Object* obj;
@@ -289,10 +409,9 @@ Type* compileType(void) {
   case KW_ARRAY:
     eat(KW_ARRAY);
     eat(SB_LSEL);
-    eat(TK_NUMBER);
-
-    arraySize = currentToken->value;
-
+    arraySize = compileConstant2();
+    if (arraySize < 0)
+      error(ERR_INVALID_ARRAY_SIZE, currentToken->lineNo, currentToken->colNo);
     eat(SB_RSEL);
     eat(KW_OF);
     elementType = compileType();
@@ -311,7 +430,7 @@ Type* compileType(void) {
 }
 
 Type* compileBasicType(void) {
-  Type* type;
+  Type* type = NULL;
 
   switch (lookAhead->tokenType) {
   case KW_INTEGER: 
@@ -344,7 +463,7 @@ void compileParams(void) {
 void compileParam(void) {
   Object* param;
   Type* type;
-  enum ParamKind paramKind;
+  enum ParamKind paramKind = PARAM_VALUE;
 
   switch (lookAhead->tokenType) {
   case TK_IDENT:
@@ -410,13 +529,14 @@ void compileStatement(void) {
 
 Type* compileLValue(void) {
   Object* var;
-  Type* varType;
+  Type* varType = NULL;
 
   eat(TK_IDENT);
   var = checkDeclaredLValueIdent(currentToken->string);
 
   switch (var->kind) {
   case OBJ_VARIABLE:
+    genVariableAddress(var);
     if (var->varAttrs->type->typeClass == TP_ARRAY) {
       varType = compileIndexes(var->varAttrs->type);
     } else {
@@ -424,9 +544,11 @@ Type* compileLValue(void) {
     }
     break;
   case OBJ_PARAMETER:
+    genParameterAddress(var);
     varType = var->paramAttrs->type;
     break;
   case OBJ_FUNCTION:
+    genReturnValueAddress(var);
     varType = var->funcAttrs->returnType;
     break;
   default: 
@@ -441,12 +563,14 @@ void compileAssignSt(void) {
   Type* rType;
 
   lType = compileLValue();
+  checkBasicType(lType);
   
   eat(SB_ASSIGN);
   
   rType = compileExpression();
 
   checkTypeEquality(lType, rType);
+  genST();
 }
 
 void compileCallSt(void) {
@@ -457,7 +581,14 @@ void compileCallSt(void) {
 
   proc = checkDeclaredProcedure(currentToken->string);
 
-  compileArguments(proc->procAttrs->paramList);
+  if (isPredefinedProcedure(proc)) {
+    compileArguments(proc->procAttrs->paramList);
+    genPredefinedProcedureCall(proc);
+  } else {
+    genINT(RESERVED_WORDS);
+    compileArguments(proc->procAttrs->paramList);
+    genProcedureCall(proc);
+  }
 }
 
 void compileGroupSt(void) {
@@ -467,12 +598,23 @@ void compileGroupSt(void) {
 }
 
 void compileIfSt(void) {
+  CodeAddress fjInstruction;
+  CodeAddress jInstruction;
+
   eat(KW_IF);
   compileCondition();
   eat(KW_THEN);
+
+  fjInstruction = genFJ(DC_VALUE);
   compileStatement();
-  if (lookAhead->tokenType == KW_ELSE) 
+  if (lookAhead->tokenType == KW_ELSE) {
+    jInstruction = genJ(DC_VALUE);
+    updateFJ(fjInstruction, getCurrentCodeAddress());
     compileElseSt();
+    updateJ(jInstruction, getCurrentCodeAddress());
+  } else {
+    updateFJ(fjInstruction, getCurrentCodeAddress());
+  }
 }
 
 void compileElseSt(void) {
@@ -481,13 +623,22 @@ void compileElseSt(void) {
 }
 
 void compileWhileSt(void) {
+  CodeAddress beginWhile;
+  CodeAddress fjInstruction;
+
+  beginWhile = getCurrentCodeAddress();
   eat(KW_WHILE);
   compileCondition();
+  fjInstruction = genFJ(DC_VALUE);
   eat(KW_DO);
   compileStatement();
+  genJ(beginWhile);
+  updateFJ(fjInstruction, getCurrentCodeAddress());
 }
 
 void compileForSt(void) {
+  CodeAddress beginLoop;
+  CodeAddress fjInstruction;
   Type* varType;
   Type* type;
 
@@ -499,16 +650,31 @@ void compileForSt(void) {
   varType = var->varAttrs->type;
   checkBasicType(varType);
 
+  genVariableAddress(var);
   eat(SB_ASSIGN);
   type = compileExpression();
   checkTypeEquality(varType, type);
+  genST();
 
+  // The bound is evaluated before every iteration
+  beginLoop = getCurrentCodeAddress();
+  genVariableValue(var);
   eat(KW_TO);
   type = compileExpression();
   checkTypeEquality(varType, type);
+  genLE();
+  fjInstruction = genFJ(DC_VALUE);
 
   eat(KW_DO);
   compileStatement();
+
+  genVariableAddress(var);
+  genVariableValue(var);
+  genLC(1);
+  genAD();
+  genST();
+  genJ(beginLoop);
+  updateFJ(fjInstruction, getCurrentCodeAddress());
 }
 
 void compileArgument(Object* param) {
@@ -570,10 +736,12 @@ void compileArguments(ObjectNode* paramList) {
 void compileCondition(void) {
   Type* type1;
   Type* type2;
+  TokenType op;
 
   type1 = compileExpression();
   checkBasicType(type1);
 
+  op = lookAhead->tokenType;
   switch (lookAhead->tokenType) {
   case SB_EQ:  eat(SB_EQ);  break;
   case SB_NEQ: eat(SB_NEQ); break;
@@ -587,6 +755,8 @@ void compileCondition(void) {
 
   type2 = compileExpression();
   checkTypeEquality(type1, type2);
+
+  genOperator(op);
 }
 
 Type* compileExpression(void) {
@@ -599,9 +769,12 @@ Type* compileExpression(void) {
     checkIntType(type);
     break;
   case SB_MINUS:
+    // The sign applies to the first term only
     eat(SB_MINUS);
-    type = compileExpression2();
+    type = compileTerm();
     checkIntType(type);
+    genNegation();
+    compileExpression3();
     break;
   default:
     type = compileExpression2();
@@ -627,12 +800,14 @@ void compileExpression3(void) {
     eat(SB_PLUS);
     type = compileTerm();
     checkIntType(type);
+    genOperator(SB_PLUS);
     compileExpression3();
     break;
   case SB_MINUS:
     eat(SB_MINUS);
     type = compileTerm();
     checkIntType(type);
+    genOperator(SB_MINUS);
     compileExpression3();
     break;
     // check the FOLLOW set
@@ -674,12 +849,14 @@ void compileTerm2(void) {
     eat(SB_TIMES);
     type = compileFactor();
     checkIntType(type);
+    genOperator(SB_TIMES);
     compileTerm2();
     break;
   case SB_SLASH:
     eat(SB_SLASH);
     type = compileFactor();
     checkIntType(type);
+    genOperator(SB_SLASH);
     compileTerm2();
     break;
     // check the FOLLOW set
@@ -708,16 +885,18 @@ void compileTerm2(void) {
 
 Type* compileFactor(void) {
   Object* obj;
-  Type* type;
+  Type* type = NULL;
 
   switch (lookAhead->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
     type = intType;
+    genLC(currentToken->value);
     break;
   case TK_CHAR:
     eat(TK_CHAR);
     type = charType;
+    genLC(currentToken->string[0]);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
@@ -725,21 +904,38 @@ Type* compileFactor(void) {
 
     switch (obj->kind) {
     case OBJ_CONSTANT:
-      if (obj->constAttrs->value->type == TP_INT) type = intType;
-      else if (obj->constAttrs->value->type == TP_CHAR) type = charType;
+      if (obj->constAttrs->value->type == TP_INT) {
+        type = intType;
+        genLC(obj->constAttrs->value->intValue);
+      } else if (obj->constAttrs->value->type == TP_CHAR) {
+        type = charType;
+        genLC(obj->constAttrs->value->charValue);
+      }
       break;
     case OBJ_VARIABLE:
       if (obj->varAttrs->type->typeClass == TP_ARRAY) {
+        genVariableAddress(obj);
         type = compileIndexes(obj->varAttrs->type);
+        if (type->typeClass != TP_ARRAY)
+          genLI();
       } else {
         type = obj->varAttrs->type;
+        genVariableValue(obj);
       }
       break;
     case OBJ_PARAMETER:
       type = obj->paramAttrs->type;
+      genParameterValue(obj);
       break;
     case OBJ_FUNCTION:
-      compileArguments(obj->funcAttrs->paramList);
+      if (isPredefinedFunction(obj)) {
+        compileArguments(obj->funcAttrs->paramList);
+        genPredefinedFunctionCall(obj);
+      } else {
+        genINT(RESERVED_WORDS);
+        compileArguments(obj->funcAttrs->paramList);
+        genFunctionCall(obj);
+      }
       type = obj->funcAttrs->returnType;
       break;
     default: 
@@ -768,10 +964,22 @@ Type* compileIndexes(Type* arrayType) {
     
     Type* indexType = compileExpression();
     checkIntType(indexType);
+
+    // A constant index is checked now, any other one when it is used
+    if (endsWithConstants(1)) {
+      WORD index = popConstant();
+      if (index < 0 || index >= currentType->arraySize)
+        error(ERR_INDEX_OUT_OF_RANGE, currentToken->lineNo, currentToken->colNo);
+      genLC(index);
+    } else genCK(currentType->arraySize);
     
     eat(SB_RSEL);
     
-    currentType = currentType->arrayAttrs->elementType;
+    // Arrays are indexed from 0: address := address + index * element size
+    currentType = currentType->elementType;
+    genLC(sizeOfType(currentType));
+    genOperator(SB_TIMES);
+    genAD();
   }
   
   return currentType;
@@ -785,12 +993,29 @@ int compile(char *fileName) {
   lookAhead = getValidToken();
 
   initSymTab();
+  initCodeBuffer();
+
+  if (importFileName != NULL) {
+    importedScope = loadSnapshot(importFileName);
+    if (importedScope == NULL) {
+      printf("Can\'t read symbol table %s!\n", importFileName);
+      exit(0);
+    }
+  }
 
   compileProgram();
 
-  printObject(symtab->program,0);
+  if (exportFileName != NULL) {
+    if (saveSnapshot(symtab->program->progAttrs->scope, exportFileName) == IO_ERROR)
+      printf("Can\'t write symbol table %s!\n", exportFileName);
+  }
+
+  if (printSymTab)
+    printObject(symtab->program,0);
 
   cleanSymTab();
+  if (importedScope != NULL)
+    freeSnapshot(importedScope);
 
   free(currentToken);
   free(lookAhead);
@@ -0,0 +1,3154 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "symtab.h"
+#include "vm.h"
+#include "passes.h"
+
+int printIR = 0;
+
+Pass passes[] = {
+  { "simplifycfg", simplifyControlFlow, 0 },
+  { "tailcall", eliminateTailCalls, 0 },
+  { "lift", liftRoutines, 0 },
+  { "inline", inlineCalls, 0 },
+  { "valueresult", passByValueResult, 0 },
+  { "specialize", specializeCalls, 0 },
+  { "evaluate", evaluateCalls, 0 },
+  { "prune", removeUnusedRoutines, 0 },
+  { "loopvars", promoteLoopVariables, 0 },
+  { "fold", foldConstants, 0 },
+  { "mem2reg", promoteVariables, 0 },
+  { "cse", removeCommonSubexpressions, 0 },
+  { "bce", removeBoundsChecks, 0 },
+  { "licm", hoistLoopInvariants, 0 },
+  { "static", allocateStaticFrames, 0 },
+  { "dce", removeDeadCode, 0 }
+};
+
+#define NUM_OF_PASSES (sizeof(passes) / sizeof(Pass))
+
+/* The pipelines, by pass name */
+char* pipelineO1[] = { "simplifycfg", "tailcall", "fold", "dce", "simplifycfg", NULL };
+char* pipelineO2[] = { "simplifycfg", "tailcall", "lift", "inline", "valueresult", "mem2reg", "fold", "specialize", "evaluate", "prune", "loopvars", "mem2reg", "cse", "bce", "licm", "static", "fold", "dce", "simplifycfg", NULL };
+
+double buildSeconds = 0;
+double lowerSeconds = 0;
+
+Pass* findPass(char* name) {
+  unsigned int i;
+  for (i = 0; i < NUM_OF_PASSES; i++)
+    if (strcmp(passes[i].name, name) == 0)
+      return &(passes[i]);
+  return NULL;
+}
+
+void runPass(Pass* pass, IRProgram* program) {
+  struct timespec start, end;
+  int r;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (r = 0; r < program->functionCount; r++)
+    if (program->functions[r] != NULL)
+      pass->run(program, program->functions[r]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pass->seconds += elapsedSeconds(&start, &end);
+}
+
+CodeBlock* optimizeCode(CodeBlock* codeBlock, int level) {
+  struct timespec start, end;
+  IRProgram* program;
+  CodeBlock* optimized;
+  char** pipeline = (level >= 2) ? pipelineO2 : pipelineO1;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  program = buildIR(codeBlock);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  buildSeconds += elapsedSeconds(&start, &end);
+
+  for (i = 0; pipeline[i] != NULL; i++)
+    runPass(findPass(pipeline[i]), program);
+  if (printIR)
+    printIRProgram(program);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  optimized = lowerIR(program);
+  freeIRProgram(program);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  lowerSeconds += elapsedSeconds(&start, &end);
+  return optimized;
+}
+
+void printPassTimings(void) {
+  unsigned int i;
+
+  printf("%-12s %10.1f us\n", "build", buildSeconds * 1e6);
+  for (i = 0; i < NUM_OF_PASSES; i++)
+    printf("%-12s %10.1f us\n", passes[i].name, passes[i].seconds * 1e6);
+  printf("%-12s %10.1f us\n", "lower", lowerSeconds * 1e6);
+}
+
+/******************* Control flow ******************************/
+
+/* Turns a branch into a jump to one of its targets */
+void jumpInstead(IRFunction* fn, IRBlock* block, int taken) {
+  IRInstr* term = terminatorOf(block);
+  IRBlock* target = block->succs[taken];
+  IRBlock* other = block->succs[1 - taken];
+
+  removeEdge(block, other);
+  removeInstr(term);
+  block->count--;
+  appendInstr(block, newInstr(fn, IR_JUMP, 0));
+  block->succs[0] = target;
+  block->succCount = 1;
+}
+
+/* Replaces the phis of a block with a single predecessor by their value */
+void removeSinglePhis(IRBlock* block) {
+  IRInstr* phi;
+  int i;
+
+  for (i = 0; i < block->count && block->instrs[i]->op == IR_PHI; i++) {
+    phi = block->instrs[i];
+    replaceInstr(phi, resolveInstr(phi->args[0]));
+  }
+}
+
+void redirectPredecessor(IRBlock* succ, IRBlock* from, IRBlock* to) {
+  int i;
+  for (i = 0; i < succ->predCount; i++)
+    if (succ->preds[i] == from)
+      succ->preds[i] = to;
+}
+
+/* Merges blocks that always run one after the other, and skips blocks
+ * that only jump elsewhere */
+void simplifyControlFlow(IRProgram* program, IRFunction* fn) {
+  IRBlock* block;
+  IRBlock* pred;
+  IRBlock* target;
+  int changed = 1;
+  int i, j, k;
+
+  computeOrder(fn);
+  while (changed) {
+    changed = 0;
+    for (i = 1; i < fn->blockCount; i++) {
+      block = fn->blocks[i];
+      if (block->predCount != 1)
+        continue;
+      pred = block->preds[0];
+      if (pred == block || pred->succCount != 1)
+        continue;
+
+      // Append the block to its predecessor
+      removeSinglePhis(block);
+      removeInstr(terminatorOf(pred));
+      pred->count--;
+      for (j = 0; j < block->count; j++)
+        if (block->instrs[j]->block != NULL)
+          appendInstr(pred, block->instrs[j]);
+      block->count = 0;
+      pred->succCount = block->succCount;
+      for (j = 0; j < block->succCount; j++) {
+        pred->succs[j] = block->succs[j];
+        redirectPredecessor(block->succs[j], block, pred);
+      }
+      block->succCount = 0;
+      block->predCount = 0;
+      changed = 1;
+    }
+
+    for (i = 1; i < fn->blockCount; i++) {
+      block = fn->blocks[i];
+      if (block->count != 1 || block->succCount != 1 || block->predCount == 0)
+        continue;
+      target = block->succs[0];
+      if (target == block || (target->count > 0 && target->instrs[0]->op == IR_PHI))
+        continue;
+
+      // Send the predecessors straight to the target
+      for (j = 0; j < block->predCount; j++) {
+        pred = block->preds[j];
+        for (k = 0; k < pred->succCount; k++)
+          if (pred->succs[k] == block)
+            pred->succs[k] = target;
+        addEdge(pred, target);
+        if (pred->succCount == 2 && pred->succs[0] == pred->succs[1])
+          jumpInstead(fn, pred, 0);
+      }
+      removeEdge(block, target);
+      block->predCount = 0;
+      changed = 1;
+    }
+    compactFunction(fn);
+    computeOrder(fn);
+  }
+}
+
+/******************* Constants ******************************/
+
+int isConstant(IRInstr* instr, WORD value) {
+  return instr->op == IR_CONST && instr->a == value;
+}
+
+void makeConstant(IRInstr* instr, WORD value) {
+  instr->op = IR_CONST;
+  instr->a = value;
+  instr->argCount = 0;
+  instr->isAddress = 0;
+}
+
+/* The value of an operation on constants, computed as the VM does */
+int foldOperation(IROp op, WORD x, WORD y, WORD* result) {
+  switch (op) {
+  case IR_ADD: *result = (WORD) ((unsigned) x + (unsigned) y); return 1;
+  case IR_SUB: *result = (WORD) ((unsigned) x - (unsigned) y); return 1;
+  case IR_MUL: *result = (WORD) ((unsigned) x * (unsigned) y); return 1;
+  case IR_DIV:
+    if (y == 0)
+      return 0;
+    *result = (y == -1) ? (WORD) (0u - (unsigned) x) : x / y;
+    return 1;
+  case IR_EQ: *result = (x == y); return 1;
+  case IR_NE: *result = (x != y); return 1;
+  case IR_GT: *result = (x > y); return 1;
+  case IR_LT: *result = (x < y); return 1;
+  case IR_GE: *result = (x >= y); return 1;
+  case IR_LE: *result = (x <= y); return 1;
+  default: return 0;
+  }
+}
+
+/* The value an instruction may be replaced by, or NULL */
+IRInstr* simplifyInstr(IRInstr* instr) {
+  IRInstr* x = (instr->argCount > 0) ? instr->args[0] : NULL;
+  IRInstr* y = (instr->argCount > 1) ? instr->args[1] : NULL;
+  IRInstr* same = NULL;
+  int i;
+
+  switch (instr->op) {
+  case IR_ADD:
+    if (isConstant(y, 0)) return x;
+    if (isConstant(x, 0)) return y;
+    return NULL;
+  case IR_SUB:
+    return isConstant(y, 0) ? x : NULL;
+  case IR_MUL:
+    if (isConstant(y, 1)) return x;
+    if (isConstant(x, 1)) return y;
+    return NULL;
+  case IR_DIV:
+    return isConstant(y, 1) ? x : NULL;
+  case IR_PHI:
+    // A phi of one value, or of itself and one value
+    for (i = 0; i < instr->argCount; i++) {
+      if (instr->args[i] == instr || instr->args[i] == same)
+        continue;
+      if (same != NULL)
+        return NULL;
+      same = instr->args[i];
+    }
+    return same;
+  default:
+    return NULL;
+  }
+}
+
+void foldConstants(IRProgram* program, IRFunction* fn) {
+  IRBlock* block;
+  IRInstr* instr;
+  IRInstr* value;
+  WORD result;
+  int changed = 1;
+  int branches = 0;
+  int i, j, k;
+
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < fn->blockCount; i++) {
+      block = fn->blocks[i];
+      for (j = 0; j < block->count; j++) {
+        instr = block->instrs[j];
+        if (instr->block == NULL)
+          continue;
+        for (k = 0; k < instr->argCount; k++)
+          instr->args[k] = resolveInstr(instr->args[k]);
+
+        if (instr->op == IR_NEG && instr->args[0]->op == IR_CONST) {
+          makeConstant(instr, (WORD) (0u - (unsigned) instr->args[0]->a));
+          changed = 1;
+        } else if (instr->argCount == 2 && instr->op != IR_STORE && instr->op != IR_CALL &&
+                   instr->args[0]->op == IR_CONST && instr->args[1]->op == IR_CONST &&
+                   foldOperation(instr->op, instr->args[0]->a, instr->args[1]->a, &result)) {
+          makeConstant(instr, result);
+          changed = 1;
+        } else if (instr->op == IR_MUL && (isConstant(instr->args[0], 0) || isConstant(instr->args[1], 0))) {
+          makeConstant(instr, 0);
+          changed = 1;
+        } else if (instr->op == IR_BRANCH && instr->args[0]->op == IR_CONST) {
+          jumpInstead(fn, block, instr->args[0]->a != 0 ? 0 : 1);
+          branches = changed = 1;
+        } else if ((value = simplifyInstr(instr)) != NULL && value != instr) {
+          replaceInstr(instr, value);
+          changed = 1;
+        }
+      }
+    }
+  }
+  compactFunction(fn);
+  if (branches)
+    computeOrder(fn);
+}
+
+/******************* Promoting variables to SSA values ******************************/
+
+typedef struct {
+  IRInstr** values;       // the definitions in scope, innermost last
+  int depth;
+  int maxDepth;
+} VariableStack;
+
+int* variableOf;          // per frame word: the variable, or -1
+int variableCount;
+VariableStack* variables;
+IRBlock*** domChildren;
+int* domChildCount;
+
+void pushDefinition(int var, IRInstr* value) {
+  VariableStack* stack = &(variables[var]);
+  if (stack->depth == stack->maxDepth) {
+    stack->maxDepth = stack->maxDepth * 2 + 8;
+    stack->values = (IRInstr**) realloc(stack->values, stack->maxDepth * sizeof(IRInstr*));
+  }
+  stack->values[stack->depth++] = value;
+}
+
+/* The promoted variable an address names, or -1 */
+int variableAt(IRInstr* address) {
+  address = resolveInstr(address);
+  if (address->op != IR_ADDR || address->a != 0)
+    return -1;
+  return variableOf[address->b];
+}
+
+void renameBlock(IRBlock* block) {
+  IRInstr* instr;
+  IRBlock* succ;
+  int* saved;
+  int var, i, j, k;
+
+  saved = (int*) malloc((variableCount + 1) * sizeof(int));
+  for (var = 0; var < variableCount; var++)
+    saved[var] = variables[var].depth;
+
+  for (i = 0; i < block->count; i++) {
+    instr = block->instrs[i];
+    if (instr->op == IR_PHI && instr->mark)
+      pushDefinition(instr->a, instr);
+    else if (instr->op == IR_LOAD && !instr->mark && (var = variableAt(instr->args[0])) >= 0)
+      replaceInstr(instr, variables[var].values[variables[var].depth - 1]);
+    else if (instr->op == IR_STORE && (var = variableAt(instr->args[0])) >= 0) {
+      pushDefinition(var, resolveInstr(instr->args[1]));
+      removeInstr(instr);
+    }
+  }
+
+  for (i = 0; i < block->succCount; i++) {
+    succ = block->succs[i];
+    for (j = 0; j < succ->predCount; j++) {
+      if (succ->preds[j] != block)
+        continue;
+      for (k = 0; k < succ->count && succ->instrs[k]->op == IR_PHI; k++)
+        if (succ->instrs[k]->mark)
+          succ->instrs[k]->args[j] = variables[succ->instrs[k]->a].values[variables[succ->instrs[k]->a].depth - 1];
+    }
+  }
+
+  for (i = 0; i < domChildCount[block->order]; i++)
+    renameBlock(domChildren[block->order][i]);
+
+  for (var = 0; var < variableCount; var++)
+    variables[var].depth = saved[var];
+  free(saved);
+}
+
+/* The variables whose address is only ever loaded from or stored to */
+int findPromotable(IRProgram* program, IRFunction* fn, int frameSize) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  FrameSlot* slot;
+  IRBlock* block;
+  IRInstr* instr;
+  IRInstr* arg;
+  char* escapes = (char*) calloc(frameSize + 1, 1);
+  int count = 0;
+  int q, i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      for (k = 0; k < instr->argCount; k++) {
+        arg = instr->args[k];
+        if (arg->op == IR_ADDR && arg->a == 0 && arg->b < frameSize &&
+            !((instr->op == IR_LOAD || instr->op == IR_STORE) && k == 0))
+          escapes[arg->b] = 1;
+      }
+    }
+  }
+
+  for (q = 0; q < frameSize; q++) {
+    variableOf[q] = -1;
+    slot = findFrameSlot(routine, q);
+    if (slot == NULL || slot->kind != SLOT_SCALAR || slot->size != 1 || escapes[q] ||
+        program->nonLocal[fn->routine][q])
+      continue;
+    variableOf[q] = count++;
+  }
+  free(escapes);
+  return count;
+}
+
+void computeFrontiers(IRFunction* fn, char** frontier) {
+  IRBlock* block;
+  IRBlock* runner;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    if (block->predCount < 2)
+      continue;
+    for (j = 0; j < block->predCount; j++)
+      for (runner = block->preds[j]; runner != block->idom; runner = runner->idom)
+        frontier[runner->order][block->order] = 1;
+  }
+}
+
+/* Turns the scalar variables of a routine that no nested routine uses
+ * and whose address never escapes into SSA values, with phis placed on
+ * the iterated dominance frontiers (Cytron et al.) */
+void promoteVariables(IRProgram* program, IRFunction* fn) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  int frameSize = routine->frameSize;
+  int n = fn->blockCount;
+  char** frontier;
+  char* hasPhi;
+  char* defines;
+  int* work;
+  IRBlock* entry = fn->blocks[0];
+  IRBlock* block;
+  IRInstr* instr;
+  IRInstr* initial;
+  FrameSlot* slot;
+  int count, var, q, i, j, top;
+
+  variableOf = (int*) malloc((frameSize + 1) * sizeof(int));
+  count = variableCount = findPromotable(program, fn, frameSize);
+  if (count == 0) {
+    free(variableOf);
+    return;
+  }
+
+  computeDominators(fn);
+  frontier = (char**) malloc(n * sizeof(char*));
+  for (i = 0; i < n; i++)
+    frontier[i] = (char*) calloc(n, 1);
+  computeFrontiers(fn, frontier);
+  domChildren = (IRBlock***) malloc(n * sizeof(IRBlock**));
+  domChildCount = (int*) calloc(n, sizeof(int));
+  for (i = 0; i < n; i++)
+    domChildren[i] = (IRBlock**) malloc(n * sizeof(IRBlock*));
+  for (i = 1; i < n; i++)
+    domChildren[fn->blocks[i]->idom->order][domChildCount[fn->blocks[i]->idom->order]++] = fn->blocks[i];
+
+  variables = (VariableStack*) calloc(count, sizeof(VariableStack));
+  hasPhi = (char*) malloc(n);
+  defines = (char*) malloc(n);
+  work = (int*) malloc(2 * n * sizeof(int));
+
+  for (q = 0; q < frameSize; q++) {
+    if ((var = variableOf[q]) < 0)
+      continue;
+
+    // Parameters start with the value the caller stored
+    slot = findFrameSlot(routine, q);
+    if (slot->isParameter) {
+      instr = newInstr(fn, IR_ADDR, 0);
+      instr->b = q;
+      instr->isAddress = 1;
+      insertInstr(entry, 0, instr);
+      initial = newInstr(fn, IR_LOAD, 1);
+      initial->args[0] = instr;
+      initial->mark = 1;
+      insertInstr(entry, 1, initial);
+    } else {
+      initial = newConstant(fn, 0);
+      insertInstr(entry, 0, initial);
+    }
+    pushDefinition(var, initial);
+
+    memset(hasPhi, 0, n);
+    memset(defines, 0, n);
+    top = 0;
+    for (i = 0; i < n; i++) {
+      block = fn->blocks[i];
+      for (j = 0; j < block->count; j++)
+        if (block->instrs[j]->op == IR_STORE && variableAt(block->instrs[j]->args[0]) == var) {
+          defines[i] = 1;
+          work[top++] = i;
+          break;
+        }
+    }
+    while (top > 0) {
+      i = work[--top];
+      for (j = 0; j < n; j++) {
+        if (!frontier[i][j] || hasPhi[j])
+          continue;
+        hasPhi[j] = 1;
+        block = fn->blocks[j];
+        instr = newInstr(fn, IR_PHI, block->predCount);
+        instr->a = var;
+        instr->mark = 1;
+        insertInstr(block, 0, instr);
+        if (!defines[j]) {
+          defines[j] = 1;
+          work[top++] = j;
+        }
+      }
+    }
+  }
+
+  renameBlock(entry);
+
+  // The marks are only meaningful during renaming
+  for (i = 0; i < n; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      fn->blocks[i]->instrs[j]->mark = 0;
+  compactFunction(fn);
+
+  for (i = 0; i < n; i++) {
+    free(frontier[i]);
+    free(domChildren[i]);
+  }
+  for (var = 0; var < count; var++)
+    free(variables[var].values);
+  free(frontier);
+  free(domChildren);
+  free(domChildCount);
+  free(variables);
+  free(hasPhi);
+  free(defines);
+  free(work);
+  free(variableOf);
+}
+
+/******************* Common subexpressions ******************************/
+
+/* Whether two instructions compute the same value */
+int sameValue(IRInstr* x, IRInstr* y) {
+  int i;
+
+  if (x->op != y->op || x->a != y->a || x->b != y->b || x->argCount != y->argCount)
+    return 0;
+  for (i = 0; i < x->argCount; i++)
+    if (x->args[i] != y->args[i])
+      return 0;
+  return 1;
+}
+
+int isCommutative(IROp op) {
+  return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE;
+}
+
+/* Reuses pure values computed in a dominating block, and loads of an
+ * address already loaded from or stored to in the same block with no
+ * store or call in between */
+void removeCommonSubexpressions(IRProgram* program, IRFunction* fn) {
+  IRInstr** available = NULL;
+  IRInstr** memory = (IRInstr**) malloc(16 * sizeof(IRInstr*));
+  IRInstr* instr;
+  IRInstr* swap;
+  IRBlock* block;
+  int availableCount = 0;
+  int memoryCount = 0;
+  int maxAvailable = 0;
+  int maxMemory = 16;
+  int i, j, k, found;
+
+  computeDominators(fn);
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    memoryCount = 0;
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      for (k = 0; k < instr->argCount; k++)
+        instr->args[k] = resolveInstr(instr->args[k]);
+      if (isCommutative(instr->op) && instr->args[0]->id > instr->args[1]->id) {
+        swap = instr->args[0];
+        instr->args[0] = instr->args[1];
+        instr->args[1] = swap;
+      }
+
+      // A check of an index already checked against the same size passes
+      if (irIsPureInstr(instr) || instr->op == IR_CHECK) {
+        found = 0;
+        for (k = 0; k < availableCount && !found; k++)
+          if (sameValue(available[k], instr) && available[k]->block != NULL && dominates(available[k]->block, block)) {
+            replaceInstr(instr, available[k]);
+            found = 1;
+          }
+        if (found)
+          continue;
+        if (availableCount == maxAvailable) {
+          maxAvailable = maxAvailable * 2 + 64;
+          available = (IRInstr**) realloc(available, maxAvailable * sizeof(IRInstr*));
+        }
+        available[availableCount++] = instr;
+      } else if (instr->op == IR_LOAD) {
+        found = 0;
+        for (k = 0; k < memoryCount && !found; k++)
+          if (memory[k]->op == IR_LOAD && memory[k]->args[0] == instr->args[0]) {
+            replaceInstr(instr, memory[k]);
+            found = 1;
+          } else if (memory[k]->op == IR_STORE && memory[k]->args[0] == instr->args[0]) {
+            replaceInstr(instr, resolveInstr(memory[k]->args[1]));
+            found = 1;
+          }
+        if (!found) {
+          if (memoryCount == maxMemory) {
+            maxMemory *= 2;
+            memory = (IRInstr**) realloc(memory, maxMemory * sizeof(IRInstr*));
+          }
+          memory[memoryCount++] = instr;
+        }
+      } else if (instr->op == IR_STORE) {
+        // Any other address may be the same word
+        memory[0] = instr;
+        memoryCount = 1;
+      } else if (instr->op == IR_CALL)
+        memoryCount = 0;
+    }
+  }
+  compactFunction(fn);
+  free(available);
+  free(memory);
+}
+
+/******************* Loop invariants ******************************/
+
+/* The words an address may name: words low to high - 1 of the frame
+ * level static links away, or, for level -1, any word a VAR parameter
+ * may point to. Indexing is assumed to stay inside the array. */
+typedef struct {
+  int level;
+  int low;
+  int high;
+} MemoryRange;
+
+MemoryRange rangeOf(IRProgram* program, IRFunction* fn, IRInstr* address) {
+  MemoryRange range;
+  IRInstr* base;
+  FrameSlot* slot;
+
+  address = resolveInstr(address);
+  range.level = -1;
+  range.low = 0;
+  range.high = 0;
+  if (address->op == IR_ADDR) {
+    range.level = address->a;
+    if (address->a == PROGRAM_FRAME)
+      range.level = program->code->routines[fn->routine].level;
+    range.low = address->b;
+    range.high = address->b + 1;
+  } else if (address->op == IR_ADD && address->isAddress) {
+    base = address->args[0]->isAddress ? address->args[0] : address->args[1];
+    range = rangeOf(program, fn, base);
+    if (range.level < 0)
+      return range;
+    if (address->args[1]->op == IR_CONST && range.high == range.low + 1) {
+      range.low += address->args[1]->a;
+      range.high = range.low + 1;
+    } else if (range.high == range.low + 1) {
+      // Some element of the array base points into
+      slot = slotOf(program, fn->routine, range.level, range.low);
+      if (slot != NULL) {
+        range.low = slot->offset;
+        range.high = slot->offset + slot->size;
+      } else {
+        range.low = 0;
+        range.high = 1 << 30;
+      }
+    }
+  }
+  return range;
+}
+
+/* A VAR parameter points into a caller's frame, never into the frame of
+ * the routine itself */
+int mayAlias(MemoryRange x, MemoryRange y) {
+  if (x.level < 0 || y.level < 0)
+    return x.level != 0 && y.level != 0;
+  return x.level == y.level && x.low < y.high && y.low < x.high;
+}
+
+/* Whether loading from an address outside the loop that contains it is
+ * harmless: a word of a frame, or the word a VAR parameter points to */
+int isSafeAddress(IRProgram* program, IRFunction* fn, IRInstr* address) {
+  FrameSlot* slot;
+  IRInstr* pointer;
+
+  if (address->op == IR_ADDR)
+    return 1;
+  if (address->op == IR_ADD && address->args[1]->op == IR_CONST)
+    return rangeOf(program, fn, address).high == rangeOf(program, fn, address).low + 1;
+  if (address->op == IR_LOAD) {
+    pointer = address->args[0];
+    if (pointer->op != IR_ADDR)
+      return 0;
+    slot = slotOf(program, fn->routine, pointer->a, pointer->b);
+    return slot != NULL && slot->kind == SLOT_REFERENCE;
+  }
+  return 0;
+}
+
+/* A function whose result depends on its arguments only and that always
+ * returns: it calls nothing, has no loops, does no input or output,
+ * cannot trap and touches its own frame only */
+int isPureFunction(IRProgram* program, int r) {
+  IRFunction* fn = program->functions[r];
+  IRBlock* block;
+  IRInstr* instr;
+  int i, j;
+
+  if (fn == NULL || program->code->routines[r].kind != RT_FUNCTION)
+    return 0;
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->succCount; j++)
+      if (block->succs[j]->order <= block->order)
+        return 0;
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      switch (instr->op) {
+      case IR_LOAD:
+      case IR_STORE:
+        if (rangeOf(program, fn, instr->args[0]).level != 0)
+          return 0;
+        break;
+      case IR_HALT:
+        return 0;
+      default:
+        if (irHasSideEffects(instr->op) && !irIsTerminator(instr->op) && !irIsPureInstr(instr))
+          return 0;
+        break;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Gives the loop headed by header a block that jumps to it from outside
+ * the loop, and returns it */
+IRBlock* makePreheader(IRFunction* fn, IRBlock* header, char* inLoop) {
+  IRBlock* preheader;
+  IRBlock* pred = NULL;
+  IRInstr* phi;
+  IRInstr* value;
+  IRBlock** preds = (IRBlock**) malloc(header->predCount * sizeof(IRBlock*));
+  int outside = 0;
+  int count = 0;
+  int i, j, k;
+
+  for (i = 0; i < header->predCount; i++)
+    if (!inLoop[header->preds[i]->order]) {
+      pred = header->preds[i];
+      outside++;
+    }
+  if (outside == 1 && pred->succCount == 1) {
+    free(preds);
+    return pred;
+  }
+
+  preheader = newBlock(fn);
+  for (i = 0; i < header->predCount; i++) {
+    pred = header->preds[i];
+    if (inLoop[pred->order])
+      continue;
+    for (j = 0; j < pred->succCount; j++)
+      if (pred->succs[j] == header)
+        pred->succs[j] = preheader;
+    addEdge(pred, preheader);
+  }
+
+  // The phis of the header take the values from outside in the preheader
+  for (k = 0; k < header->count && header->instrs[k]->op == IR_PHI; k++) {
+    phi = header->instrs[k];
+    value = NULL;
+    if (outside > 1) {
+      value = newInstr(fn, IR_PHI, outside);
+      value->isAddress = phi->isAddress;
+      appendInstr(preheader, value);
+    }
+    count = 0;
+    j = 0;
+    for (i = 0; i < header->predCount; i++) {
+      if (inLoop[header->preds[i]->order])
+        phi->args[count++] = phi->args[i];
+      else if (outside > 1)
+        value->args[j++] = phi->args[i];
+      else value = phi->args[i];
+    }
+    phi->args[count++] = value;
+    phi->argCount = count;
+  }
+
+  count = 0;
+  for (i = 0; i < header->predCount; i++)
+    if (inLoop[header->preds[i]->order])
+      preds[count++] = header->preds[i];
+  for (i = 0; i < count; i++)
+    header->preds[i] = preds[i];
+  header->predCount = count;
+  addEdge(preheader, header);
+  appendInstr(preheader, newInstr(fn, IR_JUMP, 0));
+  preheader->succs[0] = header;
+  preheader->succCount = 1;
+  free(preds);
+  return preheader;
+}
+
+/* Marks the blocks of the natural loops headed by header: those that
+ * reach one of its back edges without going through it */
+int findLoop(IRFunction* fn, IRBlock* header, char* inLoop, IRBlock** work) {
+  IRBlock* block;
+  int size = 1;
+  int top = 0;
+  int i;
+
+  memset(inLoop, 0, fn->blockCount);
+  inLoop[header->order] = 1;
+  for (i = 0; i < header->predCount; i++)
+    if (dominates(header, header->preds[i]) && !inLoop[header->preds[i]->order]) {
+      inLoop[header->preds[i]->order] = 1;
+      work[top++] = header->preds[i];
+      size++;
+    }
+  while (top > 0) {
+    block = work[--top];
+    for (i = 0; i < block->predCount; i++)
+      if (!inLoop[block->preds[i]->order]) {
+        inLoop[block->preds[i]->order] = 1;
+        work[top++] = block->preds[i];
+        size++;
+      }
+  }
+  return size;
+}
+
+int isLoopHeader(IRBlock* block) {
+  int i;
+  for (i = 0; i < block->predCount; i++)
+    if (dominates(block, block->preds[i]))
+      return 1;
+  return 0;
+}
+
+/* Whether an instruction of the loop computes the same value on every
+ * iteration and can run before the loop even if the loop would not have
+ * run it */
+int isInvariant(IRProgram* program, IRFunction* fn, IRInstr* instr, char* inLoop,
+                MemoryRange* stores, int storeCount, int hasCall) {
+  MemoryRange range;
+  int i;
+
+  for (i = 0; i < instr->argCount; i++)
+    if (instr->args[i]->block != NULL && instr->args[i]->block->order >= 0 &&
+        inLoop[instr->args[i]->block->order])
+      return 0;
+
+  switch (instr->op) {
+  case IR_LOAD:
+    if (hasCall || !isSafeAddress(program, fn, instr->args[0]))
+      return 0;
+    range = rangeOf(program, fn, instr->args[0]);
+    for (i = 0; i < storeCount; i++)
+      if (mayAlias(range, stores[i]))
+        return 0;
+    return 1;
+  case IR_CALL:
+    return instr->hasValue && isPureFunction(program, instr->b);
+  case IR_PHI:
+    return 0;
+  default:
+    return irIsPureInstr(instr);
+  }
+}
+
+/* Moves the invariant instructions of the loop into its preheader */
+void hoistFromLoop(IRProgram* program, IRFunction* fn, IRBlock* preheader, char* inLoop) {
+  MemoryRange* stores = NULL;
+  IRBlock* block;
+  IRInstr* instr;
+  int storeCount = 0;
+  int hasCall = 0;
+  int i, j, count;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    if (!inLoop[i])
+      continue;
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->op == IR_STORE) {
+        stores = (MemoryRange*) realloc(stores, (storeCount + 1) * sizeof(MemoryRange));
+        stores[storeCount++] = rangeOf(program, fn, instr->args[0]);
+      } else if (instr->op == IR_CALL && !(instr->hasValue && isPureFunction(program, instr->b)))
+        hasCall = 1;
+    }
+  }
+
+  // Definitions come before their uses in reverse postorder
+  for (i = 0; i < fn->blockCount; i++) {
+    if (!inLoop[i])
+      continue;
+    block = fn->blocks[i];
+    count = 0;
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->hasValue && isInvariant(program, fn, instr, inLoop, stores, storeCount, hasCall)) {
+        insertInstr(preheader, preheader->count - 1, instr);
+        instr->block = preheader;
+      } else block->instrs[count++] = instr;
+    }
+    block->count = count;
+  }
+  free(stores);
+}
+
+/* Hoists the computations that do not change from one iteration to the
+ * next out of each natural loop, inner loops first. Loads move only if
+ * no store of the loop may write the word, through a VAR parameter
+ * included, and no call may; calls move only to pure functions. */
+void hoistLoopInvariants(IRProgram* program, IRFunction* fn) {
+  IRBlock** headers;
+  IRBlock** work;
+  IRBlock* preheader;
+  IRBlock* swap;
+  char* inLoop;
+  int* sizes;
+  int headerCount = 0;
+  int n, i, j;
+
+  computeOrder(fn);
+  computeDominators(fn);
+  n = fn->blockCount;
+  headers = (IRBlock**) malloc((n + 1) * sizeof(IRBlock*));
+  for (i = 0; i < n; i++)
+    if (isLoopHeader(fn->blocks[i]))
+      headers[headerCount++] = fn->blocks[i];
+  if (headerCount == 0) {
+    free(headers);
+    return;
+  }
+
+  inLoop = (char*) malloc(2 * n + headerCount + 1);
+  work = (IRBlock**) malloc((2 * n + headerCount + 1) * sizeof(IRBlock*));
+  sizes = (int*) malloc(headerCount * sizeof(int));
+  for (i = 0; i < headerCount; i++) {
+    findLoop(fn, headers[i], inLoop, work);
+    if (makePreheader(fn, headers[i], inLoop)->order < 0) {
+      computeOrder(fn);
+      computeDominators(fn);
+    }
+  }
+
+  // A loop nested in another has fewer blocks
+  for (i = 0; i < headerCount; i++)
+    sizes[i] = findLoop(fn, headers[i], inLoop, work);
+  for (i = 1; i < headerCount; i++)
+    for (j = i; j > 0 && sizes[j - 1] > sizes[j]; j--) {
+      n = sizes[j]; sizes[j] = sizes[j - 1]; sizes[j - 1] = n;
+      swap = headers[j]; headers[j] = headers[j - 1]; headers[j - 1] = swap;
+    }
+
+  for (i = 0; i < headerCount; i++) {
+    findLoop(fn, headers[i], inLoop, work);
+    preheader = makePreheader(fn, headers[i], inLoop);
+    hoistFromLoop(program, fn, preheader, inLoop);
+  }
+
+  free(headers);
+  free(work);
+  free(inLoop);
+  free(sizes);
+}
+
+/******************* Variables in loops ******************************/
+
+IRInstr* insertFrameWord(IRFunction* fn, IRBlock* block, int position, int offset);
+
+/* Whether an address is that of a scalar word */
+int isScalarWord(IRProgram* program, IRFunction* fn, IRInstr* address) {
+  FrameSlot* slot;
+
+  address = resolveInstr(address);
+  if (address->op != IR_ADDR)
+    return 0;
+  slot = slotOf(program, fn->routine, address->a, address->b);
+  return slot != NULL && slot->kind == SLOT_SCALAR && slot->size == 1;
+}
+
+int sameRange(MemoryRange x, MemoryRange y) {
+  return x.level == y.level && x.low == y.low && x.high == y.high;
+}
+
+/* Whether the loop may keep the word in a new local variable instead:
+ * it calls nothing, names the word only to load and store it, and
+ * accesses no other word that may be the same one */
+int canPromoteInLoop(IRProgram* program, IRFunction* fn, char* inLoop, MemoryRange word) {
+  IRBlock* block;
+  IRInstr* instr;
+  IRInstr* arg;
+  int i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    if (!inLoop[i])
+      continue;
+    block = fn->blocks[i];
+    if (block->succCount == 2 && block->succs[0] == block->succs[1])
+      return 0;
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->op == IR_CALL)
+        return 0;
+      for (k = 0; k < instr->argCount; k++) {
+        arg = resolveInstr(instr->args[k]);
+        if (arg->op == IR_ADDR && sameRange(rangeOf(program, fn, arg), word) &&
+            !((instr->op == IR_LOAD || instr->op == IR_STORE) && k == 0))
+          return 0;
+      }
+      if ((instr->op == IR_LOAD || instr->op == IR_STORE) &&
+          !(isScalarWord(program, fn, instr->args[0]) && sameRange(rangeOf(program, fn, instr->args[0]), word)) &&
+          mayAlias(rangeOf(program, fn, instr->args[0]), word))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/* A word the loop loads that is not a local variable of its own, or
+ * NULL. Words from first on are the variables this pass made. */
+IRInstr* findLoopWord(IRProgram* program, IRFunction* fn, char* inLoop, int first) {
+  IRInstr* instr;
+  IRInstr* address;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    if (!inLoop[i])
+      continue;
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      if (instr->op != IR_LOAD || !isScalarWord(program, fn, instr->args[0]))
+        continue;
+      address = resolveInstr(instr->args[0]);
+      if ((address->a != 0 || address->b < first) &&
+          canPromoteInLoop(program, fn, inLoop, rangeOf(program, fn, address)))
+        return address;
+    }
+  }
+  return NULL;
+}
+
+IRInstr* copyAddress(IRFunction* fn, IRBlock* block, int position, IRInstr* address) {
+  IRInstr* copy = newInstr(fn, IR_ADDR, 0);
+
+  copy->a = address->a;
+  copy->b = address->b;
+  copy->isAddress = 1;
+  insertInstr(block, position, copy);
+  return copy;
+}
+
+/* Keeps the word at address in a new local variable while the loop
+ * runs: loaded into it before the loop, and stored back on every edge
+ * that leaves the loop */
+void promoteInLoop(IRProgram* program, IRFunction* fn, IRBlock* preheader, char* inLoop, IRInstr* address) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  MemoryRange word = rangeOf(program, fn, address);
+  IRBlock** exits = (IRBlock**) malloc((2 * fn->blockCount + 1) * sizeof(IRBlock*));
+  IRBlock* block;
+  IRBlock* exit;
+  IRInstr* instr;
+  IRInstr* value;
+  IRInstr* store;
+  char name[MAX_IDENT_LEN + 1];
+  int local = routine->frameSize;
+  int exitCount = 0;
+  int i, j, k;
+
+  routine->frameSize++;
+  program->nonLocal[fn->routine] = (char*) realloc(program->nonLocal[fn->routine], routine->frameSize + 1);
+  program->nonLocal[fn->routine][local] = 0;
+  sprintf(name, "_L%d", local);
+  addFrameSlot(routine, name, SLOT_SCALAR, local, 1);
+
+  // A preheader just made has no order yet, and is outside the loop
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    if (block->order < 0 || !inLoop[block->order])
+      continue;
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if ((instr->op == IR_LOAD || instr->op == IR_STORE) && isScalarWord(program, fn, instr->args[0]) &&
+          sameRange(rangeOf(program, fn, instr->args[0]), word)) {
+        instr->args[0] = insertFrameWord(fn, block, j, local);
+        j++;
+      }
+    }
+    for (k = 0; k < block->succCount; k++)
+      if (!inLoop[block->succs[k]->order]) {
+        exits[exitCount++] = block;
+        exits[exitCount++] = block->succs[k];
+      }
+  }
+
+  value = newInstr(fn, IR_LOAD, 1);
+  value->args[0] = copyAddress(fn, preheader, preheader->count - 1, address);
+  insertInstr(preheader, preheader->count - 1, value);
+  store = newInstr(fn, IR_STORE, 2);
+  store->args[0] = insertFrameWord(fn, preheader, preheader->count - 1, local);
+  store->args[1] = value;
+  insertInstr(preheader, preheader->count - 1, store);
+
+  for (i = 0; i < exitCount; i += 2) {
+    block = exits[i];
+    exit = newBlock(fn);
+    value = newInstr(fn, IR_LOAD, 1);
+    value->args[0] = insertFrameWord(fn, exit, 0, local);
+    appendInstr(exit, value);
+    store = newInstr(fn, IR_STORE, 2);
+    store->args[0] = copyAddress(fn, exit, exit->count, address);
+    store->args[1] = value;
+    appendInstr(exit, store);
+    appendInstr(exit, newInstr(fn, IR_JUMP, 0));
+    exit->succs[0] = exits[i + 1];
+    exit->succCount = 1;
+    for (k = 0; k < block->succCount; k++)
+      if (block->succs[k] == exits[i + 1])
+        block->succs[k] = exit;
+    redirectPredecessor(exits[i + 1], block, exit);
+    addEdge(block, exit);
+  }
+  free(exits);
+}
+
+/* A loop that calls nothing keeps the words of other frames, and the
+ * words of its own whose address escapes, in new local variables, which
+ * mem2reg then turns into SSA values: the loop variable of a FOR over a
+ * global array becomes an induction variable the bounds checks can be
+ * proved against */
+void promoteLoopVariables(IRProgram* program, IRFunction* fn) {
+  IRBlock** headers;
+  IRBlock** work;
+  IRBlock* preheader;
+  IRInstr* address;
+  char* inLoop;
+  int first = program->code->routines[fn->routine].frameSize;
+  int headerCount = 0;
+  int n, i;
+
+  computeOrder(fn);
+  computeDominators(fn);
+  n = fn->blockCount;
+  headers = (IRBlock**) malloc((n + 1) * sizeof(IRBlock*));
+  for (i = 0; i < n; i++)
+    if (isLoopHeader(fn->blocks[i]))
+      headers[headerCount++] = fn->blocks[i];
+
+  for (i = 0; i < headerCount; i++) {
+    computeOrder(fn);
+    computeDominators(fn);
+    inLoop = (char*) malloc(fn->blockCount + 1);
+    work = (IRBlock**) malloc((fn->blockCount + 1) * sizeof(IRBlock*));
+    findLoop(fn, headers[i], inLoop, work);
+    while ((address = findLoopWord(program, fn, inLoop, first)) != NULL) {
+      preheader = makePreheader(fn, headers[i], inLoop);
+      promoteInLoop(program, fn, preheader, inLoop, address);
+      computeOrder(fn);
+      computeDominators(fn);
+      free(inLoop);
+      free(work);
+      inLoop = (char*) malloc(fn->blockCount + 1);
+      work = (IRBlock**) malloc((fn->blockCount + 1) * sizeof(IRBlock*));
+      findLoop(fn, headers[i], inLoop, work);
+    }
+    free(inLoop);
+    free(work);
+  }
+  free(headers);
+}
+
+/******************* Lambda lifting ******************************/
+
+#define MAX_CAPTURED 3
+
+typedef struct {
+  int level;            // of the frame holding the word
+  int offset;
+  int isReference;      // passed on as is rather than by address
+} CapturedWord;
+
+int isInSubtree(IRProgram* program, int r, int top) {
+  while (r >= 0 && r != top)
+    r = program->parents[r];
+  return r == top;
+}
+
+int levelOf(IRProgram* program, int r) {
+  return program->code->routines[r].level;
+}
+
+int findCaptured(CapturedWord* captured, int count, int level, int offset) {
+  int k;
+  for (k = 0; k < count; k++)
+    if (captured[k].level == level && captured[k].offset == offset)
+      return k;
+  return -1;
+}
+
+/* Whether the captured addresses, VAR parameters of enclosing routines,
+ * are only loaded from, so their values may be passed on */
+int areReferencesLoaded(IRProgram* program, int top, CapturedWord* captured, int count) {
+  IRFunction* fn;
+  IRInstr* instr;
+  IRInstr* arg;
+  int r, i, j, k, index;
+
+  for (r = 0; r < program->functionCount; r++) {
+    if (!isInSubtree(program, r, top))
+      continue;
+    fn = program->functions[r];
+    for (i = 0; i < fn->blockCount; i++)
+      for (j = 0; j < fn->blocks[i]->count; j++) {
+        instr = fn->blocks[i]->instrs[j];
+        for (k = 0; k < instr->argCount; k++) {
+          arg = resolveInstr(instr->args[k]);
+          if (arg->op != IR_ADDR || arg->a == PROGRAM_FRAME || (instr->op == IR_LOAD && k == 0))
+            continue;
+          index = findCaptured(captured, count, levelOf(program, r) - arg->a, arg->b);
+          if (index >= 0 && captured[index].isReference)
+            return 0;
+        }
+      }
+  }
+  return 1;
+}
+
+/* Finds the words of enclosing frames other than the program's that the
+ * routine top and the routines nested in it use. Fails when one is an
+ * array, when there are too many, or when they call a routine that
+ * needs an enclosing frame as its static link. */
+int findCaptures(IRProgram* program, int top, CapturedWord* captured, int* count) {
+  IRFunction* fn;
+  IRInstr* instr;
+  FrameSlot* slot;
+  int level = levelOf(program, top);
+  int target, r, i, j;
+
+  *count = 0;
+  for (r = 0; r < program->functionCount; r++) {
+    if (!isInSubtree(program, r, top))
+      continue;
+    fn = program->functions[r];
+    for (i = 0; i < fn->blockCount; i++)
+      for (j = 0; j < fn->blocks[i]->count; j++) {
+        instr = fn->blocks[i]->instrs[j];
+        if (instr->op == IR_CALL) {
+          target = levelOf(program, r) - instr->a;
+          if (instr->b != top && target > 0 && target < level)
+            return 0;
+        }
+        if (instr->op != IR_ADDR || instr->a == PROGRAM_FRAME)
+          continue;
+        target = levelOf(program, r) - instr->a;
+        if (target <= 0 || target >= level)
+          continue;
+        slot = slotOf(program, r, instr->a, instr->b);
+        if (slot == NULL || slot->kind == SLOT_ARRAY)
+          return 0;
+        if (findCaptured(captured, *count, target, instr->b) >= 0)
+          continue;
+        if (*count == MAX_CAPTURED)
+          return 0;
+        captured[*count].level = target;
+        captured[*count].offset = instr->b;
+        captured[*count].isReference = (slot->kind == SLOT_REFERENCE);
+        (*count)++;
+      }
+  }
+  return areReferencesLoaded(program, top, captured, *count);
+}
+
+IRInstr* insertAddress(IRFunction* fn, IRBlock* block, int position, int distance, int offset) {
+  IRInstr* address = newInstr(fn, IR_ADDR, 0);
+
+  address->a = distance;
+  address->b = offset;
+  address->isAddress = 1;
+  insertInstr(block, position, address);
+  return address;
+}
+
+/* Passes the captured words to a call of the lifted routine: scalars by
+ * address, VAR parameters by value */
+void addCapturedArguments(IRProgram* program, IRFunction* fn, IRBlock* block, int position,
+                          int top, CapturedWord* captured, int count) {
+  IRInstr* call = block->instrs[position];
+  IRInstr* address;
+  IRInstr* load;
+  int first = RESERVED_WORDS + program->code->routines[top].paramCount;
+  int i;
+
+  call->args = (IRInstr**) realloc(call->args, (call->argCount + count) * sizeof(IRInstr*));
+  for (i = 0; i < count; i++) {
+    if (isInSubtree(program, fn->routine, top)) {
+      // From inside, the addresses are in the parameters of top
+      address = insertAddress(fn, block, position++, levelOf(program, fn->routine) - levelOf(program, top),
+                              first + i);
+      load = newInstr(fn, IR_LOAD, 1);
+      load->args[0] = address;
+      load->isAddress = 1;
+      insertInstr(block, position++, load);
+      call->args[call->argCount++] = load;
+    } else {
+      address = insertAddress(fn, block, position++, levelOf(program, fn->routine) - captured[i].level,
+                              captured[i].offset);
+      if (captured[i].isReference) {
+        load = newInstr(fn, IR_LOAD, 1);
+        load->args[0] = address;
+        load->isAddress = 1;
+        insertInstr(block, position++, load);
+        address = load;
+      }
+      call->args[call->argCount++] = address;
+    }
+  }
+}
+
+/* Rewrites the code of r, nested in the lifted routine top or top itself,
+ * or calling it */
+void liftInFunction(IRProgram* program, int r, int top, CapturedWord* captured, int count) {
+  IRFunction* fn = program->functions[r];
+  IRBlock* block;
+  IRInstr* instr;
+  IRInstr* load;
+  int level = levelOf(program, r);
+  int topLevel = levelOf(program, top);
+  int delta = topLevel - 1;
+  int inside = isInSubtree(program, r, top);
+  int first = RESERVED_WORDS + program->code->routines[top].paramCount;
+  int target, added, i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->op == IR_CALL && instr->b == top) {
+        instr->a = inside ? level - delta : level;
+        added = block->count;
+        addCapturedArguments(program, fn, block, j, top, captured, count);
+        j += block->count - added;
+        continue;
+      }
+      if (!inside)
+        continue;
+      if (instr->op == IR_CALL) {
+        // Calls of routines nested in top keep their static links
+        if (level - instr->a < topLevel)
+          instr->a -= delta;
+        continue;
+      }
+      if (instr->op != IR_ADDR || instr->a == PROGRAM_FRAME)
+        continue;
+      target = level - instr->a;
+      if (target == topLevel && instr->b >= first)
+        instr->b += count;
+      else if (target == 0)
+        instr->a -= delta;
+      else if (target < topLevel) {
+        k = findCaptured(captured, count, target, instr->b);
+        if (r != top)
+          program->nonLocal[top][first + k] = 1;
+        if (captured[k].isReference) {
+          // The parameter holds the same address
+          instr->a = level - topLevel;
+          instr->b = first + k;
+          continue;
+        }
+        load = newInstr(fn, IR_LOAD, 1);
+        load->args[0] = insertAddress(fn, block, j, level - topLevel, first + k);
+        load->isAddress = 1;
+        insertInstr(block, j + 1, load);
+        replaceInstr(instr, load);
+        j += 2;
+      }
+    }
+  }
+  compactFunction(fn);
+}
+
+/* Lambda lifting: a nested routine that uses no enclosing frame but the
+ * program's moves to the top level, so that it needs no static link and
+ * its enclosing routine may be inlined. The few scalars of enclosing
+ * frames it may use become extra VAR parameters. */
+void liftRoutines(IRProgram* program, IRFunction* fn) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  CapturedWord captured[MAX_CAPTURED];
+  FrameSlot* slot;
+  char name[MAX_IDENT_LEN + 1];
+  int top = fn->routine;
+  int first = RESERVED_WORDS + routine->paramCount;
+  int delta = routine->level - 1;
+  int count, r, i;
+
+  if (program->parents[top] < 0 || program->parents[program->parents[top]] < 0)
+    return;
+  for (r = 0; r < program->functionCount; r++)
+    if (program->functions[r] == NULL)
+      return;
+  if (!findCaptures(program, top, captured, &count))
+    return;
+
+  // The captured addresses go after the parameters
+  program->nonLocal[top] = (char*) realloc(program->nonLocal[top], routine->frameSize + count + 1);
+  memmove(program->nonLocal[top] + first + count, program->nonLocal[top] + first, routine->frameSize - first + 1);
+  for (i = 0; i < count; i++)
+    program->nonLocal[top][first + i] = 0;
+  for (r = 0; r < program->functionCount; r++)
+    liftInFunction(program, r, top, captured, count);
+
+  for (i = 0; i < routine->slotCount; i++)
+    if (routine->slots[i].offset >= first)
+      routine->slots[i].offset += count;
+  for (i = 0; i < count; i++) {
+    sprintf(name, "_C%d", first + i);
+    slot = addFrameSlot(routine, name, SLOT_REFERENCE, first + i, 1);
+    slot->isParameter = 1;
+  }
+  routine->paramCount += count;
+  routine->frameSize += count;
+
+  for (r = 0; r < program->functionCount; r++)
+    if (isInSubtree(program, r, top) && r != top)
+      program->code->routines[r].level -= delta;
+  routine->level = 1;
+  while (program->parents[program->parents[top]] >= 0)
+    program->parents[top] = program->parents[program->parents[top]];
+}
+
+/******************* Inlining ******************************/
+
+#define INLINE_SIZE 16          // callees this small are inlined at every call
+#define INLINE_LOOP_SIZE 48     // and this small at the calls in loops
+#define INLINE_GROWTH 400       // instructions inlining may add to a routine
+
+int functionSize(IRFunction* fn) {
+  int size = 0;
+  int i;
+
+  for (i = 0; i < fn->blockCount; i++)
+    size += fn->blocks[i]->count;
+  return size;
+}
+
+/* Per routine: whether it may end up calling itself. A routine the IR
+ * could not be built for may call anything. */
+char* findRecursive(IRProgram* program) {
+  int n = program->functionCount;
+  char* reach = (char*) calloc(n * n + 1, 1);
+  char* recursive = (char*) calloc(n + 1, 1);
+  IRFunction* fn;
+  IRInstr* instr;
+  int r, i, j, k;
+
+  for (r = 0; r < n; r++) {
+    fn = program->functions[r];
+    if (fn == NULL) {
+      memset(reach + r * n, 1, n);
+      continue;
+    }
+    for (i = 0; i < fn->blockCount; i++)
+      for (j = 0; j < fn->blocks[i]->count; j++) {
+        instr = fn->blocks[i]->instrs[j];
+        if (instr->op == IR_CALL)
+          reach[r * n + instr->b] = 1;
+      }
+  }
+  for (k = 0; k < n; k++)
+    for (i = 0; i < n; i++)
+      if (reach[i * n + k])
+        for (j = 0; j < n; j++)
+          reach[i * n + j] |= reach[k * n + j];
+  for (r = 0; r < n; r++)
+    recursive[r] = reach[r * n + r];
+  free(reach);
+  return recursive;
+}
+
+/* Whether a call of the routine may be replaced by a copy of its body */
+int canInline(IRProgram* program, int callee, char* recursive) {
+  IRFunction* body = program->functions[callee];
+  int i, j;
+
+  if (body == NULL || recursive[callee] || program->code->routines[callee].kind == RT_PROGRAM ||
+      body->blocks[0]->predCount > 0)
+    return 0;
+  // A nested routine would need the frame of its own
+  for (i = 0; i < program->functionCount; i++)
+    if (program->parents[i] == callee)
+      return 0;
+  for (i = 0; i < body->blockCount; i++)
+    for (j = 0; j < body->blocks[i]->count; j++)
+      if (body->blocks[i]->instrs[j]->op == IR_HALT)
+        return 0;
+  return 1;
+}
+
+/* Marks the blocks that belong to a loop, by their order */
+void markLoopBlocks(IRFunction* fn, char* inAnyLoop) {
+  char* inLoop = (char*) malloc(fn->blockCount + 1);
+  IRBlock** work = (IRBlock**) malloc((fn->blockCount + 1) * sizeof(IRBlock*));
+  int i, j;
+
+  memset(inAnyLoop, 0, fn->blockCount);
+  for (i = 0; i < fn->blockCount; i++) {
+    if (!isLoopHeader(fn->blocks[i]))
+      continue;
+    findLoop(fn, fn->blocks[i], inLoop, work);
+    for (j = 0; j < fn->blockCount; j++)
+      inAnyLoop[j] |= inLoop[j];
+  }
+  free(inLoop);
+  free(work);
+}
+
+/* Moves the instructions of a block after position to a new block,
+ * which takes over its successors */
+IRBlock* splitBlockAfter(IRFunction* fn, IRBlock* block, int position) {
+  IRBlock* after = newBlock(fn);
+  int i;
+
+  for (i = position + 1; i < block->count; i++)
+    appendInstr(after, block->instrs[i]);
+  block->count = position + 1;
+  after->succCount = block->succCount;
+  for (i = 0; i < block->succCount; i++) {
+    after->succs[i] = block->succs[i];
+    redirectPredecessor(block->succs[i], block, after);
+  }
+  block->succCount = 0;
+  return after;
+}
+
+/* Whether the word at offset of the frame is only ever loaded from */
+int isOnlyLoaded(IRFunction* fn, int offset) {
+  IRInstr* instr;
+  IRInstr* arg;
+  int i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      for (k = 0; k < instr->argCount; k++) {
+        arg = instr->args[k];
+        if (arg->op == IR_ADDR && arg->a == 0 && arg->b == offset && !(instr->op == IR_LOAD && k == 0))
+          return 0;
+      }
+    }
+  return 1;
+}
+
+/* Replaces a call by a copy of the callee's body. The callee's frame
+ * becomes part of the caller's, the frames it reaches through static
+ * links are counted from the caller, and its returns jump to the code
+ * after the call. */
+void inlineCall(IRProgram* program, IRFunction* fn, IRBlock* block, int position) {
+  IRInstr* call = block->instrs[position];
+  IRFunction* body = program->functions[call->b];
+  Routine* routine = &(program->code->routines[fn->routine]);
+  Routine* source = &(program->code->routines[call->b]);
+  IRBlock** blocks = (IRBlock**) malloc(body->blockCount * sizeof(IRBlock*));
+  IRInstr** copies = (IRInstr**) calloc(body->nextId + 1, sizeof(IRInstr*));
+  IRInstr** results = (IRInstr**) malloc((body->blockCount + 1) * sizeof(IRInstr*));
+  IRBlock* after;
+  IRBlock* from;
+  IRInstr* instr;
+  IRInstr* copy;
+  IRInstr* address;
+  FrameSlot* slot;
+  char name[MAX_IDENT_LEN + 1];
+  int base = routine->frameSize;
+  int resultCount = 0;
+  int i, j, k;
+
+  // The callee's frame, at the end of the caller's
+  routine->frameSize += source->frameSize;
+  program->nonLocal[fn->routine] = (char*) realloc(program->nonLocal[fn->routine], routine->frameSize + 1);
+  memset(program->nonLocal[fn->routine] + base, 0, source->frameSize + 1);
+  for (i = 0; i < source->slotCount; i++) {
+    sprintf(name, "_I%d", base + source->slots[i].offset);
+    slot = addFrameSlot(routine, name, source->slots[i].kind, base + source->slots[i].offset, source->slots[i].size);
+    slot->dimCount = source->slots[i].dimCount;
+    memcpy(slot->dims, source->slots[i].dims, sizeof(slot->dims));
+  }
+
+  after = splitBlockAfter(fn, block, position);
+  removeInstr(call);
+  block->count--;
+
+  for (i = 0; i < body->blockCount; i++) {
+    body->blocks[i]->mark = i;
+    blocks[i] = newBlock(fn);
+  }
+  for (i = 0; i < body->blockCount; i++)
+    for (j = 0; j < body->blocks[i]->count; j++) {
+      instr = body->blocks[i]->instrs[j];
+      if (instr->op == IR_RETURN) {
+        if (instr->argCount > 0)
+          results[resultCount++] = instr->args[0];
+        appendInstr(blocks[i], newInstr(fn, IR_JUMP, 0));
+        blocks[i]->succs[0] = after;
+        blocks[i]->succCount = 1;
+        addEdge(blocks[i], after);
+        continue;
+      }
+      copy = newInstr(fn, instr->op, instr->argCount);
+      copy->a = instr->a;
+      copy->b = instr->b;
+      copy->hasValue = instr->hasValue;
+      copy->isAddress = instr->isAddress;
+      if ((instr->op == IR_ADDR || instr->op == IR_CALL) && instr->a > 0)
+        copy->a = instr->a + call->a - 1;
+      else if (instr->op == IR_ADDR && instr->a == 0)
+        copy->b = base + instr->b;
+      copies[instr->id] = copy;
+      appendInstr(blocks[i], copy);
+    }
+  for (i = 0; i < body->blockCount; i++) {
+    from = body->blocks[i];
+    for (j = 0; j < from->count; j++) {
+      instr = from->instrs[j];
+      if (instr->op != IR_RETURN)
+        for (k = 0; k < instr->argCount; k++)
+          copies[instr->id]->args[k] = copies[resolveInstr(instr->args[k])->id];
+    }
+    if (blocks[i]->succCount == 0) {
+      blocks[i]->succCount = from->succCount;
+      for (k = 0; k < from->succCount; k++)
+        blocks[i]->succs[k] = blocks[from->succs[k]->mark];
+    }
+    for (k = 0; k < from->predCount; k++)
+      addEdge(blocks[from->preds[k]->mark], blocks[i]);
+  }
+
+  // The arguments go to the parameter words, except that a VAR parameter
+  // the callee only reads is its argument
+  for (i = 0; i < call->argCount; i++) {
+    slot = findFrameSlot(source, RESERVED_WORDS + i);
+    if (slot != NULL && slot->kind == SLOT_REFERENCE && isOnlyLoaded(body, RESERVED_WORDS + i)) {
+      for (j = 0; j < body->blockCount; j++)
+        for (k = 0; k < body->blocks[j]->count; k++) {
+          instr = body->blocks[j]->instrs[k];
+          if (instr->op == IR_LOAD && instr->args[0]->op == IR_ADDR && instr->args[0]->a == 0 &&
+              instr->args[0]->b == RESERVED_WORDS + i)
+            replaceInstr(copies[instr->id], call->args[i]);
+        }
+      continue;
+    }
+    address = newInstr(fn, IR_ADDR, 0);
+    address->b = base + RESERVED_WORDS + i;
+    address->isAddress = 1;
+    appendInstr(block, address);
+    copy = newInstr(fn, IR_STORE, 2);
+    copy->args[0] = address;
+    copy->args[1] = call->args[i];
+    appendInstr(block, copy);
+  }
+  appendInstr(block, newInstr(fn, IR_JUMP, 0));
+  block->succs[0] = blocks[0];
+  block->succCount = 1;
+  addEdge(block, blocks[0]);
+
+  if (call->hasValue) {
+    if (resultCount == 1)
+      replaceInstr(call, copies[resolveInstr(results[0])->id]);
+    else {
+      copy = newInstr(fn, IR_PHI, resultCount);
+      for (i = 0; i < resultCount; i++)
+        copy->args[i] = copies[resolveInstr(results[i])->id];
+      insertInstr(after, 0, copy);
+      replaceInstr(call, copy);
+    }
+  }
+  free(blocks);
+  free(copies);
+  free(results);
+}
+
+/* Inlines the calls of small routines that cannot call themselves,
+ * those in loops more readily, the routines they call in turn too,
+ * until the routine has grown by INLINE_GROWTH instructions */
+void inlineCalls(IRProgram* program, IRFunction* fn) {
+  char* recursive = findRecursive(program);
+  char* inAnyLoop;
+  IRInstr* instr;
+  int budget = INLINE_GROWTH;
+  int found = 1;
+  int size, i, j;
+
+  while (found) {
+    found = 0;
+    computeOrder(fn);
+    computeDominators(fn);
+    inAnyLoop = (char*) malloc(fn->blockCount + 1);
+    markLoopBlocks(fn, inAnyLoop);
+    for (i = 0; i < fn->blockCount && !found; i++)
+      for (j = 0; j < fn->blocks[i]->count && !found; j++) {
+        instr = fn->blocks[i]->instrs[j];
+        if (instr->op != IR_CALL || !canInline(program, instr->b, recursive))
+          continue;
+        size = functionSize(program->functions[instr->b]);
+        if (size > budget || size > (inAnyLoop[i] ? INLINE_LOOP_SIZE : INLINE_SIZE))
+          continue;
+        inlineCall(program, fn, fn->blocks[i], j);
+        compactFunction(fn);
+        budget -= size;
+        found = 1;
+      }
+    free(inAnyLoop);
+  }
+  free(recursive);
+}
+
+/******************* Value-result parameters ******************************/
+
+int hasCalls(IRFunction* fn) {
+  int i, j;
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      if (fn->blocks[i]->instrs[j]->op == IR_CALL)
+        return 1;
+  return 0;
+}
+
+/* The VAR parameter whose address the instruction loads, or -1 */
+int referenceParameterOf(Routine* routine, IRInstr* address) {
+  FrameSlot* slot;
+  IRInstr* base;
+
+  address = resolveInstr(address);
+  if (address->op != IR_LOAD)
+    return -1;
+  base = resolveInstr(address->args[0]);
+  if (base->op != IR_ADDR || base->a != 0)
+    return -1;
+  slot = findFrameSlot(routine, base->b);
+  if (slot == NULL || !slot->isParameter || slot->kind != SLOT_REFERENCE)
+    return -1;
+  return base->b;
+}
+
+/* Whether the address in VAR parameter offset is only loaded, and only
+ * used to load and store the word it points to */
+int isOnlyDereferenced(Routine* routine, IRFunction* fn, int offset) {
+  IRInstr* instr;
+  IRInstr* arg;
+  int i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      for (k = 0; k < instr->argCount; k++) {
+        arg = resolveInstr(instr->args[k]);
+        if (arg->op == IR_ADDR && arg->a == 0 && arg->b == offset && !(instr->op == IR_LOAD && k == 0))
+          return 0;
+        if (referenceParameterOf(routine, arg) == offset &&
+            !((instr->op == IR_LOAD || instr->op == IR_STORE) && k == 0))
+          return 0;
+      }
+    }
+  return 1;
+}
+
+/* The words an address may name, with the level counted from the
+ * program instead of from the function */
+MemoryRange absoluteRange(IRProgram* program, IRFunction* fn, IRInstr* address) {
+  MemoryRange range = rangeOf(program, fn, address);
+
+  if (range.level >= 0)
+    range.level = levelOf(program, fn->routine) - range.level;
+  return range;
+}
+
+/* Whether the word a call passes for VAR parameter offset may also be
+ * used by the callee under another name: through another VAR parameter
+ * or as a word of an enclosing frame. The callee calls nothing. */
+int mayBeAliased(IRProgram* program, IRFunction* callee, int offset, IRFunction* caller, IRInstr* call) {
+  Routine* routine = &(program->code->routines[callee->routine]);
+  MemoryRange passed = absoluteRange(program, caller, call->args[offset - RESERVED_WORDS]);
+  MemoryRange used;
+  IRInstr* instr;
+  int other, i, j;
+
+  for (i = 0; i < callee->blockCount; i++)
+    for (j = 0; j < callee->blocks[i]->count; j++) {
+      instr = callee->blocks[i]->instrs[j];
+      if (instr->op != IR_LOAD && instr->op != IR_STORE)
+        continue;
+      other = referenceParameterOf(routine, instr->args[0]);
+      if (other == offset)
+        continue;
+      if (other >= 0)
+        used = absoluteRange(program, caller, call->args[other - RESERVED_WORDS]);
+      else {
+        used = rangeOf(program, callee, instr->args[0]);
+        // The callee's own frame is new
+        if (used.level == 0)
+          continue;
+        if (used.level > 0)
+          used.level = levelOf(program, callee->routine) - used.level;
+      }
+      if (passed.level < 0 || used.level < 0)
+        return 1;
+      if (passed.level == used.level && passed.low < used.high && used.low < passed.high)
+        return 1;
+    }
+  return 0;
+}
+
+int isAliasedAtSomeCall(IRProgram* program, IRFunction* callee, int offset) {
+  IRFunction* caller;
+  IRInstr* instr;
+  int r, i, j;
+
+  for (r = 0; r < program->functionCount; r++) {
+    caller = program->functions[r];
+    for (i = 0; i < caller->blockCount; i++)
+      for (j = 0; j < caller->blocks[i]->count; j++) {
+        instr = caller->blocks[i]->instrs[j];
+        if (instr->op == IR_CALL && instr->b == callee->routine &&
+            mayBeAliased(program, callee, offset, caller, instr))
+          return 1;
+      }
+  }
+  return 0;
+}
+
+IRInstr* insertFrameWord(IRFunction* fn, IRBlock* block, int position, int offset) {
+  IRInstr* address = newInstr(fn, IR_ADDR, 0);
+
+  address->b = offset;
+  address->isAddress = 1;
+  insertInstr(block, position, address);
+  return address;
+}
+
+/* Copies the word VAR parameter offset points to into a new local
+ * variable on entry, and back before every return */
+void copyInOut(IRProgram* program, IRFunction* fn, int offset) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  IRBlock* block;
+  IRInstr* instr;
+  IRInstr* pointer;
+  IRInstr* value;
+  IRInstr* store;
+  char name[MAX_IDENT_LEN + 1];
+  int copy = routine->frameSize;
+  int i, j;
+
+  routine->frameSize++;
+  program->nonLocal[fn->routine] = (char*) realloc(program->nonLocal[fn->routine], routine->frameSize + 1);
+  program->nonLocal[fn->routine][copy] = 0;
+  sprintf(name, "_V%d", copy);
+  addFrameSlot(routine, name, SLOT_SCALAR, copy, 1);
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->block != NULL && referenceParameterOf(routine, instr) == offset) {
+        replaceInstr(instr, insertFrameWord(fn, block, j, copy));
+        j++;
+      }
+    }
+  }
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    if (terminatorOf(block) == NULL || terminatorOf(block)->op != IR_RETURN)
+      continue;
+    j = block->count - 1;
+    pointer = newInstr(fn, IR_LOAD, 1);
+    pointer->args[0] = insertFrameWord(fn, block, j++, offset);
+    pointer->isAddress = 1;
+    insertInstr(block, j++, pointer);
+    value = newInstr(fn, IR_LOAD, 1);
+    value->args[0] = insertFrameWord(fn, block, j++, copy);
+    insertInstr(block, j++, value);
+    store = newInstr(fn, IR_STORE, 2);
+    store->args[0] = pointer;
+    store->args[1] = value;
+    insertInstr(block, j, store);
+  }
+
+  block = fn->blocks[0];
+  pointer = newInstr(fn, IR_LOAD, 1);
+  pointer->args[0] = insertFrameWord(fn, block, 0, offset);
+  pointer->isAddress = 1;
+  insertInstr(block, 1, pointer);
+  value = newInstr(fn, IR_LOAD, 1);
+  value->args[0] = pointer;
+  insertInstr(block, 2, value);
+  store = newInstr(fn, IR_STORE, 2);
+  store->args[0] = insertFrameWord(fn, block, 3, copy);
+  store->args[1] = value;
+  insertInstr(block, 4, store);
+  compactFunction(fn);
+}
+
+/* A routine that calls nothing works on a local copy of the word a VAR
+ * parameter points to, which mem2reg may then keep in a register, when
+ * no call may pass it a word the routine also uses under another name:
+ * the copy is stored back on return, so the caller sees no difference. */
+void passByValueResult(IRProgram* program, IRFunction* fn) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  FrameSlot* slot;
+  int offset, r, i;
+
+  if (routine->kind == RT_PROGRAM || fn->blocks[0]->predCount > 0 || hasCalls(fn))
+    return;
+  for (r = 0; r < program->functionCount; r++)
+    if (program->functions[r] == NULL)
+      return;
+
+  for (i = 0; i < routine->slotCount; i++) {
+    slot = &(routine->slots[i]);
+    if (!slot->isParameter || slot->kind != SLOT_REFERENCE)
+      continue;
+    offset = slot->offset;
+    if (program->nonLocal[fn->routine][offset] || !isOnlyDereferenced(routine, fn, offset) ||
+        isAliasedAtSomeCall(program, fn, offset))
+      continue;
+    copyInOut(program, fn, offset);
+  }
+}
+
+/******************* Constant arguments ******************************/
+
+#define SPECIALIZE_SIZE 120     // routines this small get copies for constant arguments
+#define SPECIALIZE_GROWTH 600   // instructions the copies may add to the program
+#define MAX_SPECIALIZED 4       // copies of one routine
+#define MAX_SPECIALIZED_PARAMS 8
+#define MAX_DECISION_DEPTH 3
+
+typedef struct {
+  int routine;          // the routine copied
+  int copy;             // or -1 if the copy would fold nothing
+  unsigned mask;        // the parameters it has constants for, by index
+  WORD values[MAX_SPECIALIZED_PARAMS];
+} Specialization;
+
+/* Whether every load of the parameter word at offset yields the argument:
+ * the routine never stores to it and no nested routine sees it */
+int isReadOnlyParameter(IRProgram* program, IRFunction* fn, int offset) {
+  FrameSlot* slot = findFrameSlot(&(program->code->routines[fn->routine]), offset);
+
+  return slot != NULL && slot->isParameter && slot->kind == SLOT_SCALAR &&
+    !program->nonLocal[fn->routine][offset] && isOnlyLoaded(fn, offset);
+}
+
+/* Whether a value ends up, maybe after some arithmetic, in a comparison,
+ * a branch, a phi, a division or an index check: what a constant lets
+ * the later passes fold or prove */
+int feedsDecision(IRFunction* fn, IRInstr* value, int depth) {
+  IRInstr* user;
+  int i, j, k;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      user = fn->blocks[i]->instrs[j];
+      for (k = 0; k < user->argCount; k++) {
+        if (resolveInstr(user->args[k]) != value)
+          continue;
+        if ((user->op >= IR_EQ && user->op <= IR_LE) || user->op == IR_BRANCH || user->op == IR_PHI ||
+            user->op == IR_DIV || user->op == IR_CHECK)
+          return 1;
+        if ((user->op == IR_ADD || user->op == IR_SUB || user->op == IR_MUL || user->op == IR_NEG) &&
+            depth < MAX_DECISION_DEPTH && feedsDecision(fn, user, depth + 1))
+          return 1;
+      }
+    }
+  return 0;
+}
+
+int isParameterLoad(IRInstr* instr, int offset) {
+  IRInstr* address;
+
+  if (instr->op != IR_LOAD)
+    return 0;
+  address = resolveInstr(instr->args[0]);
+  return address->op == IR_ADDR && address->a == 0 && address->b == offset;
+}
+
+int isWorthSpecializing(IRFunction* fn, int offset) {
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      if (isParameterLoad(fn->blocks[i]->instrs[j], offset) && feedsDecision(fn, fn->blocks[i]->instrs[j], 0))
+        return 1;
+  return 0;
+}
+
+/* Makes every load of the parameter word at offset the constant value,
+ * and returns how many there were */
+int substituteParameter(IRFunction* fn, int offset, WORD value) {
+  int count = 0;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      if (isParameterLoad(fn->blocks[i]->instrs[j], offset)) {
+        makeConstant(fn->blocks[i]->instrs[j], value);
+        count++;
+      }
+  return count;
+}
+
+/* Whether every call of the routine passes the same constant as argument
+ * index, and which */
+int findConstantArgument(IRProgram* program, int callee, int index, WORD* value) {
+  IRFunction* caller;
+  IRInstr* instr;
+  IRInstr* arg;
+  int found = 0;
+  int r, i, j;
+
+  for (r = 0; r < program->functionCount; r++) {
+    caller = program->functions[r];
+    for (i = 0; i < caller->blockCount; i++)
+      for (j = 0; j < caller->blocks[i]->count; j++) {
+        instr = caller->blocks[i]->instrs[j];
+        if (instr->op != IR_CALL || instr->b != callee)
+          continue;
+        arg = resolveInstr(instr->args[index]);
+        if (arg->op != IR_CONST || (found && arg->a != *value))
+          return 0;
+        *value = arg->a;
+        found = 1;
+      }
+  }
+  return found;
+}
+
+/* One round of propagation over the call graph; returns whether some
+ * parameter became a constant */
+int propagateConstantArguments(IRProgram* program) {
+  Routine* routine;
+  IRFunction* fn;
+  WORD value;
+  int changed = 0;
+  int r, i;
+
+  for (r = 0; r < program->functionCount; r++) {
+    fn = program->functions[r];
+    routine = &(program->code->routines[r]);
+    if (routine->kind == RT_PROGRAM)
+      continue;
+    for (i = 0; i < routine->paramCount; i++)
+      if (isReadOnlyParameter(program, fn, RESERVED_WORDS + i) && findConstantArgument(program, r, i, &value) &&
+          substituteParameter(fn, RESERVED_WORDS + i, value) > 0) {
+        foldConstants(program, fn);
+        changed = 1;
+      }
+  }
+  return changed;
+}
+
+/* The decisions left to run time: branches, index checks and divisions
+ * that may trap */
+int countDecisions(IRFunction* fn) {
+  IRInstr* instr;
+  int count = 0;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      if (instr->op == IR_BRANCH || instr->op == IR_CHECK ||
+          (instr->op == IR_DIV && resolveInstr(instr->args[1])->op != IR_CONST))
+        count++;
+    }
+  return count;
+}
+
+/* A copy of the function of routine r whose parameters in mask are the
+ * constants in values, folded and with the index checks it can prove */
+IRFunction* specializeBody(IRProgram* program, int r, unsigned mask, WORD* values) {
+  IRFunction* fn = copyFunction(program->functions[r]);
+  int i;
+
+  for (i = 0; i < MAX_SPECIALIZED_PARAMS; i++)
+    if (mask & (1u << i))
+      substituteParameter(fn, RESERVED_WORDS + i, values[i]);
+  foldConstants(program, fn);
+  removeBoundsChecks(program, fn);
+  return fn;
+}
+
+/* Adds routine r with the specialized body fn, and returns its index */
+int addSpecializedRoutine(IRProgram* program, int r, IRFunction* fn) {
+  CodeBlock* code = program->code;
+  Routine* source;
+  Routine* routine;
+  FrameSlot* slot;
+  char name[MAX_IDENT_LEN + 1];
+  int copy = code->routineCount;
+  int i;
+
+  strcpy(name, code->routines[r].name);
+  routine = addRoutine(code, name, code->routines[r].kind, code->routines[r].entry);
+  source = &(code->routines[r]);
+  routine->level = source->level;
+  routine->frameSize = source->frameSize;
+  routine->paramCount = source->paramCount;
+  for (i = 0; i < source->slotCount; i++) {
+    slot = addFrameSlot(routine, source->slots[i].name, source->slots[i].kind,
+                        source->slots[i].offset, source->slots[i].size);
+    *slot = source->slots[i];
+  }
+
+  program->functionCount++;
+  program->functions = (IRFunction**) realloc(program->functions, program->functionCount * sizeof(IRFunction*));
+  program->parents = (int*) realloc(program->parents, program->functionCount * sizeof(int));
+  program->nonLocal = (char**) realloc(program->nonLocal, program->functionCount * sizeof(char*));
+  program->parents[copy] = program->parents[r];
+  program->nonLocal[copy] = (char*) malloc(routine->frameSize + 1);
+  memcpy(program->nonLocal[copy], program->nonLocal[r], routine->frameSize + 1);
+  fn->routine = copy;
+  program->functions[copy] = fn;
+  return copy;
+}
+
+Specialization* specializations;  // the copies made, and the ones not worth it
+int specializationCount;
+int maxSpecializations;
+
+/* Points a call that passes constants worth knowing at the copy of its
+ * callee for them, made if need be; returns the instructions added. A
+ * copy is only made when it has fewer decisions left than the callee,
+ * and never of a recursive routine, where it would only serve the
+ * outermost call. */
+int specializeCall(IRProgram* program, IRInstr* call, int budget) {
+  IRFunction* callee = program->functions[call->b];
+  Routine* routine = &(program->code->routines[call->b]);
+  Specialization* found;
+  IRFunction* body;
+  IRInstr* arg;
+  char* recursive;
+  unsigned mask = 0;
+  int size = functionSize(callee);
+  int copies = 0;
+  int isRecursive, i, s;
+
+  if (routine->kind == RT_PROGRAM || size > SPECIALIZE_SIZE)
+    return 0;
+  for (i = 0; i < program->functionCount; i++)
+    if (program->parents[i] == call->b)
+      return 0;
+
+  if (specializationCount == maxSpecializations) {
+    maxSpecializations = maxSpecializations * 2 + 8;
+    specializations = (Specialization*) realloc(specializations, maxSpecializations * sizeof(Specialization));
+  }
+  found = &(specializations[specializationCount]);
+  found->routine = call->b;
+  for (i = 0; i < routine->paramCount && i < MAX_SPECIALIZED_PARAMS; i++) {
+    arg = resolveInstr(call->args[i]);
+    if (arg->op == IR_CONST && isReadOnlyParameter(program, callee, RESERVED_WORDS + i) &&
+        isWorthSpecializing(callee, RESERVED_WORDS + i)) {
+      mask |= 1u << i;
+      found->values[i] = arg->a;
+    }
+  }
+  if (mask == 0)
+    return 0;
+  found->mask = mask;
+
+  for (s = 0; s < specializationCount; s++) {
+    if (specializations[s].routine != call->b)
+      continue;
+    if (specializations[s].copy >= 0)
+      copies++;
+    if (specializations[s].mask != mask)
+      continue;
+    for (i = 0; i < MAX_SPECIALIZED_PARAMS; i++)
+      if ((mask & (1u << i)) && specializations[s].values[i] != found->values[i])
+        break;
+    if (i == MAX_SPECIALIZED_PARAMS) {
+      if (specializations[s].copy >= 0)
+        call->b = specializations[s].copy;
+      return 0;
+    }
+  }
+  if (copies >= MAX_SPECIALIZED || size > budget)
+    return 0;
+
+  recursive = findRecursive(program);
+  isRecursive = recursive[call->b];
+  free(recursive);
+  body = isRecursive ? NULL : specializeBody(program, call->b, mask, found->values);
+  specializationCount++;
+  if (body == NULL || countDecisions(body) >= countDecisions(callee)) {
+    if (body != NULL)
+      freeIRFunction(body);
+    found->copy = -1;
+    return 0;
+  }
+  found->copy = addSpecializedRoutine(program, call->b, body);
+  call->b = found->copy;
+  return size;
+}
+
+/* Interprocedural constant propagation. A parameter every call passes
+ * the same constant becomes that constant in the routine, which may make
+ * the arguments it passes on constant in turn. A call passing constants
+ * that let the routine fold branches, index checks or divisions calls a
+ * copy of it specialized for them, within SPECIALIZE_GROWTH instructions.
+ * The call graph is the whole program's, so the pass works once, when
+ * it meets the program's function. */
+void specializeCalls(IRProgram* program, IRFunction* fn) {
+  IRFunction* caller;
+  IRInstr* instr;
+  int budget = SPECIALIZE_GROWTH;
+  int r, i, j;
+
+  if (program->code->routines[fn->routine].kind != RT_PROGRAM)
+    return;
+  for (r = 0; r < program->functionCount; r++)
+    if (program->functions[r] == NULL)
+      return;
+
+  while (propagateConstantArguments(program))
+    ;
+
+  specializations = NULL;
+  specializationCount = maxSpecializations = 0;
+  for (r = 0; r < program->functionCount; r++) {
+    caller = program->functions[r];
+    for (i = 0; i < caller->blockCount; i++)
+      for (j = 0; j < caller->blocks[i]->count; j++) {
+        instr = caller->blocks[i]->instrs[j];
+        if (instr->op == IR_CALL)
+          budget -= specializeCall(program, instr, budget);
+      }
+  }
+  free(specializations);
+
+  // The copies may pass constants on, and the routines they replace may
+  // be left with calls that agree
+  while (propagateConstantArguments(program))
+    ;
+}
+
+/******************* Compile-time evaluation ******************************/
+
+#define MAX_EVALUATION_STEPS 1000000    // instructions one evaluation may run
+#define MAX_EVALUATION_DEPTH 100        // calls it may nest
+#define MAX_EVALUATION_ARGS 256
+#define EVALUATION_CACHE_SIZE 4096
+#define MAX_CACHED_ARGS 4
+
+/* The results of the calls evaluated so far: a pure function called
+ * again on the same arguments, as a recursive one often is, returns the
+ * same result without running */
+typedef struct {
+  int routine;          // -1 if the entry is free
+  int argCount;
+  WORD args[MAX_CACHED_ARGS];
+  WORD result;
+} CachedResult;
+
+CachedResult evaluationCache[EVALUATION_CACHE_SIZE];
+long evaluationSteps;
+
+/* Whether the instructions of a function can run at compile time: it
+ * takes values only, touches its own frame only and does no input or
+ * output. The functions it calls are checked by findEvaluable(). */
+int canEvaluate(IRProgram* program, int r) {
+  IRFunction* fn = program->functions[r];
+  Routine* routine = &(program->code->routines[r]);
+  IRInstr* instr;
+  int i, j;
+
+  if (fn == NULL || routine->kind != RT_FUNCTION)
+    return 0;
+  for (i = 0; i < routine->slotCount; i++)
+    if (routine->slots[i].isParameter && routine->slots[i].kind != SLOT_SCALAR)
+      return 0;
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      switch (instr->op) {
+      case IR_ADDR:
+        if (instr->a != 0)
+          return 0;
+        break;
+      case IR_LOAD:
+      case IR_STORE:
+        if (rangeOf(program, fn, instr->args[0]).level != 0)
+          return 0;
+        break;
+      case IR_CALL:
+        if (!instr->hasValue)
+          return 0;
+        break;
+      case IR_READI:
+      case IR_READC:
+      case IR_WRITEI:
+      case IR_WRITEC:
+      case IR_WRITELN:
+      case IR_HALT:
+        return 0;
+      default:
+        break;
+      }
+    }
+  return 1;
+}
+
+/* Per routine: whether it is a function canEvaluate() accepts that calls
+ * such functions only */
+char* findEvaluable(IRProgram* program) {
+  char* evaluable = (char*) malloc(program->functionCount + 1);
+  IRFunction* fn;
+  int changed = 1;
+  int r, i, j;
+
+  for (r = 0; r < program->functionCount; r++)
+    evaluable[r] = canEvaluate(program, r);
+  while (changed) {
+    changed = 0;
+    for (r = 0; r < program->functionCount; r++) {
+      if (!evaluable[r])
+        continue;
+      fn = program->functions[r];
+      for (i = 0; i < fn->blockCount && evaluable[r]; i++)
+        for (j = 0; j < fn->blocks[i]->count; j++)
+          if (fn->blocks[i]->instrs[j]->op == IR_CALL && !evaluable[fn->blocks[i]->instrs[j]->b]) {
+            evaluable[r] = 0;
+            changed = 1;
+            break;
+          }
+    }
+  }
+  return evaluable;
+}
+
+int evaluateFunction(IRProgram* program, int r, WORD* args, WORD* result, int depth);
+
+CachedResult* cachedResult(int r, WORD* args, int argCount) {
+  unsigned hash = (unsigned) r;
+  int i;
+
+  for (i = 0; i < argCount && i < MAX_CACHED_ARGS; i++)
+    hash = hash * 31 + (unsigned) args[i];
+  return &(evaluationCache[hash % EVALUATION_CACHE_SIZE]);
+}
+
+/* Evaluates a call of function r, looking its result up first */
+int evaluateCall(IRProgram* program, int r, WORD* args, int argCount, WORD* result, int depth) {
+  CachedResult* cached = cachedResult(r, args, argCount);
+  int i;
+
+  if (argCount <= MAX_CACHED_ARGS && cached->routine == r && cached->argCount == argCount) {
+    for (i = 0; i < argCount && cached->args[i] == args[i]; i++)
+      ;
+    if (i == argCount) {
+      *result = cached->result;
+      return 1;
+    }
+  }
+  if (!evaluateFunction(program, r, args, result, depth))
+    return 0;
+  if (argCount <= MAX_CACHED_ARGS) {
+    cached->routine = r;
+    cached->argCount = argCount;
+    memcpy(cached->args, args, argCount * sizeof(WORD));
+    cached->result = *result;
+  }
+  return 1;
+}
+
+/* Runs function r on the arguments as the VM would, with addresses
+ * counted in words from the start of the frame. Returns 0, leaving the
+ * call to run time, if it would trap or runs out of steps or depth. */
+int evaluateFunction(IRProgram* program, int r, WORD* args, WORD* result, int depth) {
+  IRFunction* fn = program->functions[r];
+  Routine* routine = &(program->code->routines[r]);
+  WORD* frame = (WORD*) calloc(routine->frameSize + 1, sizeof(WORD));
+  WORD* values = (WORD*) calloc(fn->nextId + 1, sizeof(WORD));
+  WORD* phis = NULL;
+  WORD callArgs[MAX_EVALUATION_ARGS];
+  IRBlock* block = fn->blocks[0];
+  IRBlock* from = NULL;
+  IRBlock* next = NULL;
+  IRInstr* instr;
+  WORD x, y, value;
+  int done = 0;
+  int ok = 1;
+  int phiCount, i, k;
+
+  for (i = 0; i < routine->paramCount; i++)
+    frame[RESERVED_WORDS + i] = args[i];
+
+  while (!done && ok) {
+    // The phis of a block take their values at once
+    for (phiCount = 0; phiCount < block->count && block->instrs[phiCount]->op == IR_PHI; phiCount++)
+      ;
+    phis = (WORD*) realloc(phis, (phiCount + 1) * sizeof(WORD));
+    for (i = 0; i < phiCount; i++)
+      phis[i] = values[resolveInstr(block->instrs[i]->args[predIndex(block, from)])->id];
+    for (i = 0; i < phiCount; i++)
+      values[block->instrs[i]->id] = phis[i];
+
+    for (i = phiCount; i < block->count && ok; i++) {
+      instr = block->instrs[i];
+      if (++evaluationSteps > MAX_EVALUATION_STEPS) {
+        ok = 0;
+        break;
+      }
+      x = (instr->argCount > 0) ? values[resolveInstr(instr->args[0])->id] : 0;
+      y = (instr->argCount > 1) ? values[resolveInstr(instr->args[1])->id] : 0;
+      value = 0;
+      switch (instr->op) {
+      case IR_CONST:
+        value = instr->a;
+        break;
+      case IR_ADDR:
+        value = instr->b;
+        break;
+      case IR_LOAD:
+        if (x < 0 || x >= routine->frameSize)
+          ok = 0;
+        else value = frame[x];
+        break;
+      case IR_STORE:
+        if (x < 0 || x >= routine->frameSize)
+          ok = 0;
+        else frame[x] = y;
+        break;
+      case IR_NEG:
+        value = (WORD) (0u - (unsigned) x);
+        break;
+      case IR_CHECK:
+        ok = (x >= 0 && x < instr->a);
+        value = x;
+        break;
+      case IR_CALL:
+        if (depth >= MAX_EVALUATION_DEPTH || instr->argCount > MAX_EVALUATION_ARGS) {
+          ok = 0;
+          break;
+        }
+        for (k = 0; k < instr->argCount; k++)
+          callArgs[k] = values[resolveInstr(instr->args[k])->id];
+        ok = evaluateCall(program, instr->b, callArgs, instr->argCount, &value, depth + 1);
+        break;
+      case IR_JUMP:
+        next = block->succs[0];
+        break;
+      case IR_BRANCH:
+        next = block->succs[x != 0 ? 0 : 1];
+        break;
+      case IR_RETURN:
+        *result = x;
+        done = 1;
+        break;
+      default:
+        ok = foldOperation(instr->op, x, y, &value);
+        break;
+      }
+      values[instr->id] = value;
+    }
+    from = block;
+    block = next;
+  }
+  free(frame);
+  free(values);
+  free(phis);
+  return ok;
+}
+
+/* Replaces the calls of functions that only compute with values by
+ * their results, when the arguments are constants: the evaluation runs
+ * the callee's IR here, within MAX_EVALUATION_STEPS instructions */
+void evaluateCalls(IRProgram* program, IRFunction* fn) {
+  char* evaluable = findEvaluable(program);
+  IRInstr* instr;
+  WORD args[MAX_EVALUATION_ARGS];
+  WORD result;
+  int changed = 0;
+  int i, j, k;
+
+  // The functions may have changed since the last evaluation
+  for (i = 0; i < EVALUATION_CACHE_SIZE; i++)
+    evaluationCache[i].routine = -1;
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      if (instr->op != IR_CALL || !evaluable[instr->b] || instr->argCount > MAX_EVALUATION_ARGS)
+        continue;
+      for (k = 0; k < instr->argCount; k++) {
+        if (resolveInstr(instr->args[k])->op != IR_CONST)
+          break;
+        args[k] = resolveInstr(instr->args[k])->a;
+      }
+      evaluationSteps = 0;
+      if (k == instr->argCount && evaluateCall(program, instr->b, args, k, &result, 0)) {
+        makeConstant(instr, result);
+        changed = 1;
+      }
+    }
+  free(evaluable);
+  if (changed)
+    foldConstants(program, fn);
+}
+
+/******************* Unused routines ******************************/
+
+void markCalled(IRProgram* program, int r, char* used) {
+  IRFunction* fn = program->functions[r];
+  IRInstr* instr;
+  int i, j;
+
+  used[r] = 1;
+  if (program->parents[r] >= 0 && !used[program->parents[r]])
+    markCalled(program, program->parents[r], used);
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      if (instr->op == IR_CALL && !used[instr->b])
+        markCalled(program, instr->b, used);
+    }
+}
+
+/* Drops the routines the program can no longer call: those inlined,
+ * evaluated or specialized at every call. The routines left are
+ * renumbered, in their order. */
+void removeUnusedRoutines(IRProgram* program, IRFunction* fn) {
+  CodeBlock* code = program->code;
+  IRFunction* other;
+  IRInstr* instr;
+  char* used;
+  int* number;
+  int count = 0;
+  int r, i, j;
+
+  if (code->routines[fn->routine].kind != RT_PROGRAM)
+    return;
+  for (r = 0; r < program->functionCount; r++)
+    if (program->functions[r] == NULL)
+      return;
+
+  used = (char*) calloc(program->functionCount + 1, 1);
+  number = (int*) malloc((program->functionCount + 1) * sizeof(int));
+  markCalled(program, fn->routine, used);
+  for (r = 0; r < program->functionCount; r++) {
+    if (!used[r]) {
+      number[r] = -1;
+      freeIRFunction(program->functions[r]);
+      free(program->nonLocal[r]);
+      free(code->routines[r].slots);
+      continue;
+    }
+    number[r] = count;
+    code->routines[count] = code->routines[r];
+    program->functions[count] = program->functions[r];
+    program->parents[count] = program->parents[r];
+    program->nonLocal[count] = program->nonLocal[r];
+    count++;
+  }
+  code->routineCount = program->functionCount = count;
+
+  for (r = 0; r < count; r++) {
+    if (program->parents[r] >= 0)
+      program->parents[r] = number[program->parents[r]];
+    other = program->functions[r];
+    other->routine = r;
+    for (i = 0; i < other->blockCount; i++)
+      for (j = 0; j < other->blocks[i]->count; j++) {
+        instr = other->blocks[i]->instrs[j];
+        if (instr->op == IR_CALL)
+          instr->b = number[instr->b];
+      }
+  }
+  free(used);
+  free(number);
+}
+
+/******************* Tail calls ******************************/
+
+int isResultWord(IRInstr* address) {
+  address = resolveInstr(address);
+  return address->op == IR_ADDR && address->a == 0 && address->b == 0;
+}
+
+/* Whether an address passed to a VAR parameter lies outside the frame,
+ * which the tail call reuses: a VAR parameter passed on points to an
+ * older frame */
+int pointsOutsideFrame(Routine* routine, IRInstr* address) {
+  FrameSlot* slot;
+  IRInstr* base;
+
+  address = resolveInstr(address);
+  switch (address->op) {
+  case IR_ADDR:
+    return address->a != 0;
+  case IR_LOAD:
+    base = resolveInstr(address->args[0]);
+    if (base->op != IR_ADDR)
+      return 0;
+    if (base->a != 0)
+      return 1;
+    slot = findFrameSlot(routine, base->b);
+    return slot != NULL && slot->isParameter && slot->kind == SLOT_REFERENCE;
+  case IR_ADD:
+  case IR_SUB:
+    return pointsOutsideFrame(routine, address->args[resolveInstr(address->args[0])->isAddress ? 0 : 1]);
+  default:
+    return 0;
+  }
+}
+
+/* Whether a call of the routine itself is the last thing it does: what
+ * follows only stores its value as the result and returns */
+int isTailCall(IRFunction* fn, Routine* routine, IRBlock* block, int position) {
+  IRInstr* call = block->instrs[position];
+  IRInstr* instr;
+  int stored = !call->hasValue;
+  int hops = 0;
+  int i;
+
+  if (call->op != IR_CALL || call->b != fn->routine)
+    return 0;
+  for (i = 0; i < call->argCount; i++)
+    if (call->args[i]->isAddress && !pointsOutsideFrame(routine, call->args[i]))
+      return 0;
+
+  for (i = position + 1; i < block->count; i++) {
+    instr = block->instrs[i];
+    switch (instr->op) {
+    case IR_CONST:
+    case IR_ADDR:
+      break;
+    case IR_STORE:
+      if (stored || !isResultWord(instr->args[0]) || resolveInstr(instr->args[1]) != call)
+        return 0;
+      stored = 1;
+      break;
+    case IR_LOAD:
+      if (!stored || !isResultWord(instr->args[0]))
+        return 0;
+      break;
+    case IR_RETURN:
+      return stored;
+    case IR_JUMP:
+      // On to the block of the return, which has no phis
+      block = block->succs[0];
+      if (hops++ == 8 || (block->count > 0 && block->instrs[0]->op == IR_PHI))
+        return 0;
+      i = -1;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return 0;
+}
+
+int findTailCall(IRFunction* fn, Routine* routine, IRBlock** block, int* position) {
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      if (isTailCall(fn, routine, fn->blocks[i], j)) {
+        *block = fn->blocks[i];
+        *position = j;
+        return 1;
+      }
+  return 0;
+}
+
+/* Turns the calls of a routine to itself that end it into stores of the
+ * arguments to its parameters and a jump back to its start, so that
+ * tail recursion runs in constant stack space */
+void eliminateTailCalls(IRProgram* program, IRFunction* fn) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  IRBlock* entry = fn->blocks[0];
+  IRBlock* start;
+  IRBlock* block;
+  IRInstr* call;
+  IRInstr* address;
+  IRInstr* store;
+  int position, i;
+
+  if (!findTailCall(fn, routine, &block, &position))
+    return;
+
+  // Nothing may jump to the entry block, so the loop starts after it
+  start = splitBlockAfter(fn, entry, -1);
+  appendInstr(entry, newInstr(fn, IR_JUMP, 0));
+  entry->succs[0] = start;
+  entry->succCount = 1;
+  addEdge(entry, start);
+
+  while (findTailCall(fn, routine, &block, &position)) {
+    call = block->instrs[position];
+    for (i = position; i < block->count; i++)
+      removeInstr(block->instrs[i]);
+    block->count = position;
+    for (i = 0; i < block->succCount; i++)
+      removeEdge(block, block->succs[i]);
+
+    // The arguments are all computed before the first store
+    for (i = 0; i < call->argCount; i++) {
+      address = newInstr(fn, IR_ADDR, 0);
+      address->b = RESERVED_WORDS + i;
+      address->isAddress = 1;
+      appendInstr(block, address);
+      store = newInstr(fn, IR_STORE, 2);
+      store->args[0] = address;
+      store->args[1] = resolveInstr(call->args[i]);
+      appendInstr(block, store);
+    }
+    appendInstr(block, newInstr(fn, IR_JUMP, 0));
+    block->succs[0] = start;
+    block->succCount = 1;
+    addEdge(block, start);
+  }
+  compactFunction(fn);
+  computeOrder(fn);
+}
+
+/******************* Static frames ******************************/
+
+/* Whether the frames of a routine and of all the routines nested in it
+ * are in the IR, so every address of the routine's words can be found */
+int isLiftedTree(IRProgram* program, int r) {
+  int child;
+
+  if (program->functions[r] == NULL)
+    return 0;
+  for (child = 0; child < program->functionCount; child++)
+    if (program->parents[child] == r && !isLiftedTree(program, child))
+      return 0;
+  return 1;
+}
+
+/* Points the addresses of words first .. first + count - 1 of the frame
+ * distance static links up from routine r at the program frame, from
+ * word base on, in r and in the routines nested in it */
+void moveFrameWords(IRProgram* program, int r, int distance, int first, int count, int base) {
+  IRFunction* fn = program->functions[r];
+  IRInstr* instr;
+  int child, i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++) {
+      instr = fn->blocks[i]->instrs[j];
+      if (instr->op == IR_ADDR && instr->a == distance && instr->b >= first && instr->b < first + count) {
+        instr->a = PROGRAM_FRAME;
+        instr->b = base + instr->b - first;
+      }
+    }
+  for (child = 0; child < program->functionCount; child++)
+    if (program->parents[child] == r)
+      moveFrameWords(program, child, distance + 1, first, count, base);
+}
+
+/* A routine that cannot call itself never has two frames at once: its
+ * local variables move to the end of the program frame, where the code
+ * reaches them without following static links. Parameters stay in the
+ * frame the caller builds. */
+void allocateStaticFrames(IRProgram* program, IRFunction* fn) {
+  Routine* routine = &(program->code->routines[fn->routine]);
+  Routine* outer;
+  FrameSlot* slot;
+  char* recursive;
+  char name[MAX_IDENT_LEN + 1];
+  int root = fn->routine;
+  int first = RESERVED_WORDS + routine->paramCount;
+  int count = routine->frameSize - first;
+  int base, i;
+
+  if (routine->kind == RT_PROGRAM || count <= 0 || !isLiftedTree(program, fn->routine))
+    return;
+  recursive = findRecursive(program);
+  if (recursive[fn->routine]) {
+    free(recursive);
+    return;
+  }
+  free(recursive);
+
+  while (program->parents[root] >= 0)
+    root = program->parents[root];
+  outer = &(program->code->routines[root]);
+  base = outer->frameSize;
+  outer->frameSize += count;
+  program->nonLocal[root] = (char*) realloc(program->nonLocal[root], outer->frameSize + 1);
+  memset(program->nonLocal[root] + base, 1, count + 1);
+
+  for (i = 0; i < routine->slotCount; i++) {
+    if (routine->slots[i].offset < first)
+      continue;
+    sprintf(name, "_S%d", base + routine->slots[i].offset - first);
+    slot = addFrameSlot(outer, name, routine->slots[i].kind, base + routine->slots[i].offset - first,
+                        routine->slots[i].size);
+    slot->dimCount = routine->slots[i].dimCount;
+    memcpy(slot->dims, routine->slots[i].dims, sizeof(slot->dims));
+  }
+  // The slots are in offset order
+  while (routine->slotCount > 0 && routine->slots[routine->slotCount - 1].offset >= first)
+    routine->slotCount--;
+  routine->frameSize = first;
+
+  moveFrameWords(program, fn->routine, 0, first, count, base);
+}
+
+/******************* Bounds checks ******************************/
+
+#define MAX_RANGE_DEPTH 8
+
+typedef struct {
+  long long low;
+  long long high;
+} Interval;
+
+Interval makeInterval(long long low, long long high) {
+  Interval interval;
+  interval.low = low;
+  interval.high = high;
+  return interval;
+}
+
+Interval fullInterval(void) {
+  return makeInterval(INT_MIN, INT_MAX);
+}
+
+/* The interval of a result computed as if words did not wrap around;
+ * one that does not fit in a word may have wrapped */
+Interval fitInterval(long long low, long long high) {
+  if (low < INT_MIN || high > INT_MAX)
+    return fullInterval();
+  return makeInterval(low, high);
+}
+
+Interval intersectIntervals(Interval x, Interval y) {
+  return makeInterval(x.low > y.low ? x.low : y.low, x.high < y.high ? x.high : y.high);
+}
+
+Interval intervalOf(IRInstr* v, IRBlock* block, int depth);
+
+/* The predecessor of a block other than the ones it dominates, if there
+ * is only one: whatever the branch there tells holds in the block */
+IRBlock* entryEdge(IRBlock* block) {
+  IRBlock* from = NULL;
+  int i;
+
+  for (i = 0; i < block->predCount; i++) {
+    if (dominates(block, block->preds[i]))
+      continue;
+    if (from != NULL)
+      return NULL;
+    from = block->preds[i];
+  }
+  return from;
+}
+
+IROp swapComparison(IROp op) {
+  switch (op) {
+  case IR_GT: return IR_LT;
+  case IR_LT: return IR_GT;
+  case IR_GE: return IR_LE;
+  case IR_LE: return IR_GE;
+  default: return op;
+  }
+}
+
+IROp negateComparison(IROp op) {
+  switch (op) {
+  case IR_EQ: return IR_NE;
+  case IR_NE: return IR_EQ;
+  case IR_GT: return IR_LE;
+  case IR_LT: return IR_GE;
+  case IR_GE: return IR_LT;
+  default: return IR_GT;
+  }
+}
+
+/* Narrows the interval of v by the comparison that leads into block */
+Interval applyEdgeFact(Interval interval, IRInstr* v, IRBlock* block, int depth) {
+  IRBlock* from = entryEdge(block);
+  IRInstr* term;
+  IRInstr* condition;
+  IRInstr* other;
+  Interval bound;
+  IROp op;
+
+  if (from == NULL || from->succCount != 2 || from->succs[0] == from->succs[1])
+    return interval;
+  term = terminatorOf(from);
+  if (term == NULL || term->op != IR_BRANCH)
+    return interval;
+  condition = resolveInstr(term->args[0]);
+  if (condition->op < IR_EQ || condition->op > IR_LE)
+    return interval;
+
+  op = condition->op;
+  if (resolveInstr(condition->args[0]) == v)
+    other = condition->args[1];
+  else if (resolveInstr(condition->args[1]) == v) {
+    other = condition->args[0];
+    op = swapComparison(op);
+  } else return interval;
+  if (from->succs[1] == block)
+    op = negateComparison(op);
+
+  bound = intervalOf(other, from, depth - 1);
+  switch (op) {
+  case IR_EQ:
+    return intersectIntervals(interval, bound);
+  case IR_LT:
+    return intersectIntervals(interval, makeInterval(INT_MIN, bound.high - 1));
+  case IR_LE:
+    return intersectIntervals(interval, makeInterval(INT_MIN, bound.high));
+  case IR_GT:
+    return intersectIntervals(interval, makeInterval(bound.low + 1, INT_MAX));
+  case IR_GE:
+    return intersectIntervals(interval, makeInterval(bound.low, INT_MAX));
+  default:
+    return interval;
+  }
+}
+
+/* What the branches on the way to block tell about v */
+Interval edgeFacts(IRInstr* v, IRBlock* block, int depth) {
+  Interval interval = fullInterval();
+
+  for (;;) {
+    interval = applyEdgeFact(interval, v, block, depth);
+    if (block->idom == block)
+      return interval;
+    block = block->idom;
+  }
+}
+
+/* Whether value is phi plus or minus another value; gives the interval
+ * of the step */
+int stepOf(IRInstr* value, IRInstr* phi, Interval* step, int depth) {
+  IRInstr* other;
+
+  if (value->op != IR_ADD && value->op != IR_SUB)
+    return 0;
+  if (resolveInstr(value->args[0]) == phi)
+    other = value->args[1];
+  else if (value->op == IR_ADD && resolveInstr(value->args[1]) == phi)
+    other = value->args[0];
+  else return 0;
+  *step = intervalOf(other, value->block, depth);
+  if (value->op == IR_SUB)
+    *step = makeInterval(-step->high, -step->low);
+  return 1;
+}
+
+/* The interval of a phi: the union of its arguments, or for a simple
+ * induction variable, which the loop steps one way only without
+ * wrapping around, everything from its start onwards */
+Interval inductionInterval(IRInstr* phi, int depth) {
+  IRBlock* header = phi->block;
+  IRInstr* value;
+  Interval interval = makeInterval(INT_MAX, INT_MIN);
+  Interval argument;
+  Interval step;
+  int up = 0, down = 0;
+  int i;
+
+  for (i = 0; i < phi->argCount; i++) {
+    value = resolveInstr(phi->args[i]);
+    if (value == phi)
+      continue;
+    if (dominates(header, header->preds[i])) {
+      if (!stepOf(value, phi, &step, depth - 1))
+        return fullInterval();
+      up |= (step.high > 0);
+      down |= (step.low < 0);
+      argument = edgeFacts(phi, value->block, depth - 1);
+      if ((up && down) || argument.high + step.high > INT_MAX || argument.low + step.low < INT_MIN)
+        return fullInterval();
+    } else {
+      argument = intervalOf(value, header->preds[i], depth - 1);
+      if (argument.low < interval.low)
+        interval.low = argument.low;
+      if (argument.high > interval.high)
+        interval.high = argument.high;
+    }
+  }
+  if (up)
+    interval.high = INT_MAX;
+  if (down)
+    interval.low = INT_MIN;
+  return interval;
+}
+
+/* The values v may have in block; marks the values being computed */
+Interval intervalOf(IRInstr* v, IRBlock* block, int depth) {
+  Interval interval = fullInterval();
+  Interval x, y;
+  long long products[4];
+  int i;
+
+  v = resolveInstr(v);
+  if (v->op == IR_CONST)
+    return makeInterval(v->a, v->a);
+  if (depth <= 0 || v->mark)
+    return interval;
+
+  v->mark = 1;
+  switch (v->op) {
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+    x = intervalOf(v->args[0], block, depth - 1);
+    y = intervalOf(v->args[1], block, depth - 1);
+    if (v->op == IR_ADD)
+      interval = fitInterval(x.low + y.low, x.high + y.high);
+    else if (v->op == IR_SUB)
+      interval = fitInterval(x.low - y.high, x.high - y.low);
+    else if (v->op == IR_MUL) {
+      products[0] = x.low * y.low;
+      products[1] = x.low * y.high;
+      products[2] = x.high * y.low;
+      products[3] = x.high * y.high;
+      interval = makeInterval(products[0], products[0]);
+      for (i = 1; i < 4; i++) {
+        if (products[i] < interval.low)
+          interval.low = products[i];
+        if (products[i] > interval.high)
+          interval.high = products[i];
+      }
+      interval = fitInterval(interval.low, interval.high);
+    } else if (y.low == y.high && y.low > 0)
+      interval = makeInterval(x.low / y.low, x.high / y.low);
+    break;
+  case IR_NEG:
+    x = intervalOf(v->args[0], block, depth - 1);
+    interval = fitInterval(-x.high, -x.low);
+    break;
+  case IR_CHECK:
+    x = intervalOf(v->args[0], block, depth - 1);
+    interval = intersectIntervals(x, makeInterval(0, v->a - 1));
+    break;
+  case IR_PHI:
+    interval = inductionInterval(v, depth);
+    break;
+  case IR_EQ:
+  case IR_NE:
+  case IR_GT:
+  case IR_LT:
+  case IR_GE:
+  case IR_LE:
+    interval = makeInterval(0, 1);
+    break;
+  default:
+    break;
+  }
+  v->mark = 0;
+  return intersectIntervals(interval, edgeFacts(v, block, depth));
+}
+
+/* Drops the index checks that the interval of the index proves to pass:
+ * loop bounds, constants and induction variables usually do */
+void removeBoundsChecks(IRProgram* program, IRFunction* fn) {
+  IRBlock* block;
+  IRInstr* instr;
+  Interval index;
+  int i, j;
+
+  computeDominators(fn);
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      fn->blocks[i]->instrs[j]->mark = 0;
+
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (instr->op != IR_CHECK)
+        continue;
+      index = intervalOf(instr->args[0], block, MAX_RANGE_DEPTH);
+      if (index.low >= 0 && index.high < instr->a)
+        replaceInstr(instr, resolveInstr(instr->args[0]));
+    }
+  }
+  compactFunction(fn);
+}
+
+/******************* Dead code ******************************/
+
+void markLive(IRInstr* instr) {
+  int i;
+
+  if (instr->mark)
+    return;
+  instr->mark = 1;
+  for (i = 0; i < instr->argCount; i++)
+    markLive(instr->args[i]);
+}
+
+void removeDeadCode(IRProgram* program, IRFunction* fn) {
+  IRBlock* block;
+  IRInstr* instr;
+  int i, j;
+
+  for (i = 0; i < fn->blockCount; i++)
+    for (j = 0; j < fn->blocks[i]->count; j++)
+      fn->blocks[i]->instrs[j]->mark = 0;
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (irHasSideEffects(instr->op) && !irIsPureInstr(instr))
+        markLive(instr);
+    }
+  }
+  for (i = 0; i < fn->blockCount; i++) {
+    block = fn->blocks[i];
+    for (j = 0; j < block->count; j++) {
+      instr = block->instrs[j];
+      if (!instr->mark)
+        removeInstr(instr);
+      instr->mark = 0;
+    }
+  }
+  compactFunction(fn);
+}
@@ -0,0 +1,57 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PASSES_H__
+#define __PASSES_H__
+
+#include "ir.h"
+
+/* The optimizer. -O0 does not build the IR at all and keeps the code of
+ * the single-pass code generator; -O1 cleans up the control flow, turns
+ * self tail calls into loops and folds constants; -O2 also lifts nested
+ * routines to the top level, inlines small routines, copies the words
+ * of VAR parameters in and out, promotes local variables to SSA values,
+ * propagates constant arguments into the routines, specializing copies
+ * of them for the calls that pass constants, evaluates the calls of pure
+ * functions on constants, drops the routines no longer called, keeps
+ * the variables a loop uses in locals while it runs, removes common
+ * subexpressions, drops the array index checks it can prove to pass,
+ * hoists loop invariants and gives the routines that cannot call
+ * themselves static frames. */
+
+typedef void (*PassFunction)(IRProgram* program, IRFunction* fn);
+
+typedef struct {
+  char* name;
+  PassFunction run;       // on one function at a time
+  double seconds;         // spent in it so far
+} Pass;
+
+/* Returns the optimized copy of a code block */
+CodeBlock* optimizeCode(CodeBlock* codeBlock, int level);
+void printPassTimings(void);
+
+extern int printIR;       // print the IR after the passes
+
+/* The passes */
+void simplifyControlFlow(IRProgram* program, IRFunction* fn);
+void eliminateTailCalls(IRProgram* program, IRFunction* fn);
+void liftRoutines(IRProgram* program, IRFunction* fn);
+void inlineCalls(IRProgram* program, IRFunction* fn);
+void passByValueResult(IRProgram* program, IRFunction* fn);
+void specializeCalls(IRProgram* program, IRFunction* fn);
+void evaluateCalls(IRProgram* program, IRFunction* fn);
+void removeUnusedRoutines(IRProgram* program, IRFunction* fn);
+void foldConstants(IRProgram* program, IRFunction* fn);
+void promoteVariables(IRProgram* program, IRFunction* fn);
+void removeCommonSubexpressions(IRProgram* program, IRFunction* fn);
+void removeBoundsChecks(IRProgram* program, IRFunction* fn);
+void hoistLoopInvariants(IRProgram* program, IRFunction* fn);
+void promoteLoopVariables(IRProgram* program, IRFunction* fn);
+void allocateStaticFrames(IRProgram* program, IRFunction* fn);
+void removeDeadCode(IRProgram* program, IRFunction* fn);
+
+#endif
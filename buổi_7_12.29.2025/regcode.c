@@ -0,0 +1,686 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regcode.h"
+
+#define INITIAL_REG_CODE_SIZE 256
+#define INITIAL_SYM_STACK_SIZE 64
+
+char* regOpCodeNames[NUM_OF_REG_OPCODES] = {
+  "MOV", "MOVI", "LDA", "LDV", "STV", "LDI", "STI",
+  "ADD", "ADDI", "SUB", "SUBI", "MUL", "MULI", "DIV", "DIVI", "NEG",
+  "EQ", "NE", "GT", "LT", "GE", "LE",
+  "J", "JZ", "JEQ", "JNE", "JGT", "JLT", "JGE", "JLE",
+  "JEQI", "JNEI", "JGTI", "JLTI", "JGEI", "JLEI",
+  "CALL", "RET", "ENTER", "HALT", "RC", "RI", "WRC", "WRI", "WLN", "CHK"
+};
+
+/* The translator runs the stack code symbolically. Each word of the
+ * stack is described by an entry instead of being computed at once:
+ * constants, frame addresses, variables and comparisons wait on the
+ * symbolic stack until an instruction consumes them, so that most loads
+ * become operands of the instruction using them. A word that has to live
+ * in memory is kept in the temporary register of its stack depth d, that
+ * is, slot frameSize + d of the current frame. */
+
+enum SymKind {
+  SYM_RESERVED,   // a frame word reserved for a call, no value
+  SYM_REG,        // the value of a register
+  SYM_IMM,        // a constant
+  SYM_ADDR,       // the address base(level) + value
+  SYM_CMP         // a comparison of two operands, not yet computed
+};
+
+typedef struct {
+  enum SymKind kind;    // SYM_REG or SYM_IMM
+  WORD value;
+} Operand;
+
+typedef struct {
+  enum SymKind kind;
+  WORD value;           // register, constant or address offset
+  int level;            // nesting level of the frame of an address
+  int def;              // the instruction that computed a temporary, or -1
+  RegOpCode cmp;        // comparison of left and right, RO_EQ .. RO_LE
+  Operand left;
+  Operand right;
+} SymEntry;
+
+RegCodeBlock* regCode;
+SymEntry* symStack;
+int symDepth;
+int symMaxDepth;
+int tempBase;           // the frame size of the routine being translated
+int routineLevel;       // and its nesting level
+
+CodeAddress emitReg(RegOpCode op, int p, WORD a, WORD b, WORD c) {
+  RegInstruction* inst;
+
+  if (regCode->codeSize == regCode->maxSize) {
+    regCode->maxSize *= 2;
+    regCode->code = (RegInstruction*) realloc(regCode->code, regCode->maxSize * sizeof(RegInstruction));
+  }
+
+  inst = &(regCode->code[regCode->codeSize]);
+  inst->op = op;
+  inst->p = p;
+  inst->a = a;
+  inst->b = b;
+  inst->c = c;
+  return regCode->codeSize++;
+}
+
+/******************* The symbolic stack ******************************/
+
+WORD tempRegister(int depth) {
+  return tempBase + depth;
+}
+
+SymEntry* pushSym(enum SymKind kind, WORD value) {
+  SymEntry* entry;
+
+  if (symDepth == symMaxDepth) {
+    symMaxDepth *= 2;
+    symStack = (SymEntry*) realloc(symStack, symMaxDepth * sizeof(SymEntry));
+  }
+  entry = &(symStack[symDepth++]);
+  entry->kind = kind;
+  entry->value = value;
+  entry->level = 0;
+  entry->def = -1;
+  return entry;
+}
+
+void pushTemp(int depth, CodeAddress def) {
+  SymEntry* entry;
+
+  symDepth = depth;
+  entry = pushSym(SYM_REG, tempRegister(depth));
+  entry->def = def;
+}
+
+/* Moves an operand of a comparison into a register, using the temporary
+ * register given when it is a constant */
+WORD operandRegister(Operand* operand, WORD temp) {
+  if (operand->kind == SYM_IMM) {
+    emitReg(RO_MOVI, 0, temp, operand->value, 0);
+    return temp;
+  }
+  return operand->value;
+}
+
+/* Computes the entry at the given depth into its temporary register */
+void materialize(int depth) {
+  SymEntry* entry = &(symStack[depth]);
+  WORD temp = tempRegister(depth);
+  WORD left, right;
+
+  switch (entry->kind) {
+  case SYM_RESERVED:
+    return;
+  case SYM_REG:
+    if (entry->value == temp)
+      return;
+    entry->def = emitReg(RO_MOV, 0, temp, entry->value, 0);
+    break;
+  case SYM_IMM:
+    entry->def = emitReg(RO_MOVI, 0, temp, entry->value, 0);
+    break;
+  case SYM_ADDR:
+    entry->def = emitReg(RO_LDA, entry->level, temp, entry->value, 0);
+    break;
+  case SYM_CMP:
+    // The left operand is at this depth, the right one just above
+    left = operandRegister(&(entry->left), temp);
+    right = operandRegister(&(entry->right), temp + 1);
+    entry->def = emitReg(entry->cmp, 0, temp, left, right);
+    break;
+  }
+  entry->kind = SYM_REG;
+  entry->value = temp;
+}
+
+/* The register holding the entry at the given depth */
+WORD registerOf(int depth) {
+  if (symStack[depth].kind != SYM_REG)
+    materialize(depth);
+  return symStack[depth].value;
+}
+
+Operand operandOf(int depth) {
+  Operand operand;
+
+  if (symStack[depth].kind == SYM_IMM) {
+    operand.kind = SYM_IMM;
+    operand.value = symStack[depth].value;
+  } else {
+    operand.kind = SYM_REG;
+    operand.value = registerOf(depth);
+  }
+  return operand;
+}
+
+int refersTo(SymEntry* entry, WORD reg) {
+  switch (entry->kind) {
+  case SYM_REG:
+    return entry->value == reg;
+  case SYM_CMP:
+    return (entry->left.kind == SYM_REG && entry->left.value == reg) ||
+      (entry->right.kind == SYM_REG && entry->right.value == reg);
+  default:
+    return 0;
+  }
+}
+
+/* Before a register is written, entries still reading it take a copy */
+void protectRegister(WORD reg) {
+  int i;
+  for (i = 0; i < symDepth; i++)
+    if (refersTo(&(symStack[i]), reg) && !(symStack[i].kind == SYM_REG && symStack[i].value == tempRegister(i)))
+      materialize(i);
+}
+
+/* Before memory is written through a pointer or a call, no entry may
+ * read a variable lazily any more */
+void protectAll(void) {
+  int i;
+  for (i = 0; i < symDepth; i++)
+    if (symStack[i].kind == SYM_CMP ||
+        (symStack[i].kind == SYM_REG && symStack[i].value != tempRegister(i)))
+      materialize(i);
+}
+
+/* Control flow meets at labels: there every entry is in its register */
+void flushAll(void) {
+  int i;
+  for (i = 0; i < symDepth; i++) {
+    materialize(i);
+    symStack[i].def = -1;
+  }
+}
+
+/******************* Translation ******************************/
+
+WORD foldArithmetic(OpCode op, WORD x, WORD y) {
+  switch (op) {
+  case OP_AD: return (WORD) ((unsigned) x + (unsigned) y);
+  case OP_SB: return (WORD) ((unsigned) x - (unsigned) y);
+  case OP_ML: return (WORD) ((unsigned) x * (unsigned) y);
+  default: return (y == -1) ? (WORD) (0u - (unsigned) x) : x / y;
+  }
+}
+
+int foldComparison(RegOpCode cmp, WORD x, WORD y) {
+  switch (cmp) {
+  case RO_EQ: return x == y;
+  case RO_NE: return x != y;
+  case RO_GT: return x > y;
+  case RO_LT: return x < y;
+  case RO_GE: return x >= y;
+  default: return x <= y;
+  }
+}
+
+RegOpCode invertComparison(RegOpCode cmp) {
+  switch (cmp) {
+  case RO_EQ: return RO_NE;
+  case RO_NE: return RO_EQ;
+  case RO_GT: return RO_LE;
+  case RO_LT: return RO_GE;
+  case RO_GE: return RO_LT;
+  default: return RO_GT;
+  }
+}
+
+RegOpCode mirrorComparison(RegOpCode cmp) {
+  switch (cmp) {
+  case RO_GT: return RO_LT;
+  case RO_LT: return RO_GT;
+  case RO_GE: return RO_LE;
+  case RO_LE: return RO_GE;
+  default: return cmp;
+  }
+}
+
+void translateArithmetic(OpCode op) {
+  int depth = symDepth - 2;
+  SymEntry* left = &(symStack[depth]);
+  SymEntry* right = &(symStack[depth + 1]);
+  RegOpCode regOp = (op == OP_AD) ? RO_ADD : (op == OP_SB) ? RO_SUB : (op == OP_ML) ? RO_MUL : RO_DIV;
+  WORD x, y;
+  CodeAddress def;
+
+  // Constant offsets into frames stay addresses
+  if (left->kind == SYM_ADDR && right->kind == SYM_IMM && (op == OP_AD || op == OP_SB)) {
+    left->value = foldArithmetic(op, left->value, right->value);
+    symDepth--;
+    return;
+  }
+
+  if (left->kind == SYM_IMM && right->kind == SYM_IMM &&
+      !(op == OP_DV && right->value == 0)) {
+    left->value = foldArithmetic(op, left->value, right->value);
+    symDepth--;
+    return;
+  }
+
+  if (left->kind == SYM_IMM && right->kind != SYM_IMM && (op == OP_AD || op == OP_ML)) {
+    y = left->value;
+    x = registerOf(depth + 1);
+    pushTemp(depth, emitReg(regOp + 1, 0, tempRegister(depth), x, y));
+    return;
+  }
+
+  if (right->kind == SYM_IMM && !(op == OP_DV && (right->value == 0 || right->value == -1))) {
+    y = right->value;
+    x = registerOf(depth);
+    pushTemp(depth, emitReg(regOp + 1, 0, tempRegister(depth), x, y));
+    return;
+  }
+
+  x = registerOf(depth);
+  y = registerOf(depth + 1);
+  def = emitReg(regOp, 0, tempRegister(depth), x, y);
+  pushTemp(depth, def);
+}
+
+void translateComparison(OpCode op) {
+  int depth = symDepth - 2;
+  Operand left = operandOf(depth);
+  Operand right = operandOf(depth + 1);
+  SymEntry* entry;
+
+  symDepth = depth;
+  entry = pushSym(SYM_CMP, 0);
+  entry->cmp = RO_EQ + (op - OP_EQ);
+  entry->left = left;
+  entry->right = right;
+}
+
+/* Translates a false jump, fusing it with the comparison it tests */
+void translateFalseJump(CodeAddress target) {
+  SymEntry cond = symStack[--symDepth];
+  Operand left, right;
+  RegOpCode cmp;
+
+  if (cond.kind == SYM_IMM) {
+    flushAll();
+    if (cond.value == 0)
+      emitReg(RO_J, 0, 0, 0, target);
+    return;
+  }
+
+  if (cond.kind != SYM_CMP) {
+    symDepth++;
+    cond.value = registerOf(symDepth - 1);
+    symDepth--;
+    flushAll();
+    emitReg(RO_JZ, 0, cond.value, 0, target);
+    return;
+  }
+
+  flushAll();
+  left = cond.left;
+  right = cond.right;
+  cmp = cond.cmp;
+  if (left.kind == SYM_IMM && right.kind == SYM_IMM) {
+    if (!foldComparison(cmp, left.value, right.value))
+      emitReg(RO_J, 0, 0, 0, target);
+    return;
+  }
+  if (left.kind == SYM_IMM) {
+    left = cond.right;
+    right = cond.left;
+    cmp = mirrorComparison(cmp);
+  }
+  cmp = invertComparison(cmp);
+  if (right.kind == SYM_IMM)
+    emitReg(RO_JEQI + (cmp - RO_EQ), 0, left.value, right.value, target);
+  else emitReg(RO_JEQ + (cmp - RO_EQ), 0, left.value, right.value, target);
+}
+
+int isRetargetable(RegOpCode op) {
+  return (op < RO_J && op != RO_STV && op != RO_STI) || op == RO_RC || op == RO_RI;
+}
+
+void translateStore(void) {
+  int depth = symDepth - 2;
+  SymEntry* addr = &(symStack[depth]);
+  SymEntry* value = &(symStack[depth + 1]);
+  RegInstruction* last;
+  WORD dest, reg;
+
+  if (addr->kind == SYM_ADDR && addr->level == routineLevel) {
+    dest = addr->value;
+    if (value->kind == SYM_ADDR || value->kind == SYM_CMP)
+      materialize(depth + 1);
+    symDepth = depth;
+    protectRegister(dest);
+    if (value->kind == SYM_IMM)
+      emitReg(RO_MOVI, 0, dest, value->value, 0);
+    else if (value->def >= 0 && value->def == regCode->codeSize - 1 &&
+             value->value == tempRegister(depth + 1) &&
+             isRetargetable((last = &(regCode->code[value->def]))->op))
+      // The value was just computed: compute it straight into the variable
+      last->a = dest;
+    else if (value->value != dest)
+      emitReg(RO_MOV, 0, dest, value->value, 0);
+    return;
+  }
+
+  reg = registerOf(depth + 1);
+  if (addr->kind == SYM_ADDR) {
+    symDepth = depth;
+    emitReg(RO_STV, addr->level, reg, addr->value, 0);
+    return;
+  }
+
+  dest = registerOf(depth);
+  symDepth = depth;
+  protectAll();
+  emitReg(RO_STI, 0, dest, reg, 0);
+}
+
+/* The nesting level of the frame p static links away */
+int frameLevel(int p) {
+  return (p == PROGRAM_FRAME) ? 0 : routineLevel - p;
+}
+
+void translateInstruction(CodeBlock* codeBlock, Instruction* inst, int isFrameInt) {
+  int depth = symDepth;
+  SymEntry* entry;
+  Routine* callee;
+  WORD reg;
+  int i;
+
+  switch (inst->op) {
+  case OP_LA:
+    entry = pushSym(SYM_ADDR, inst->q);
+    entry->level = frameLevel(inst->p);
+    break;
+  case OP_LV:
+    if (frameLevel(inst->p) == routineLevel)
+      pushSym(SYM_REG, inst->q);
+    else pushTemp(depth, emitReg(RO_LDV, frameLevel(inst->p), tempRegister(depth), inst->q, 0));
+    break;
+  case OP_LC:
+    pushSym(SYM_IMM, inst->q);
+    break;
+  case OP_LI:
+    entry = &(symStack[depth - 1]);
+    if (entry->kind == SYM_ADDR && entry->level == routineLevel) {
+      entry->kind = SYM_REG;
+      entry->def = -1;
+    } else if (entry->kind == SYM_ADDR)
+      pushTemp(depth - 1, emitReg(RO_LDV, entry->level, tempRegister(depth - 1), entry->value, 0));
+    else {
+      reg = registerOf(depth - 1);
+      pushTemp(depth - 1, emitReg(RO_LDI, 0, tempRegister(depth - 1), reg, 0));
+    }
+    break;
+  case OP_INT:
+    if (isFrameInt)
+      emitReg(RO_ENTER, 0, 0, inst->q, 0);
+    else
+      for (i = 0; i < inst->q; i++)
+        pushSym(SYM_RESERVED, 0);
+    break;
+  case OP_DCT:
+    // The arguments of a call go to the parameter slots of the new frame
+    for (i = depth - inst->q; i < depth; i++)
+      materialize(i);
+    symDepth -= inst->q;
+    break;
+  case OP_J:
+    flushAll();
+    emitReg(RO_J, 0, 0, 0, inst->q);
+    break;
+  case OP_FJ:
+    translateFalseJump(inst->q);
+    break;
+  case OP_HL:
+    emitReg(RO_HALT, 0, 0, 0, 0);
+    break;
+  case OP_ST:
+    translateStore();
+    break;
+  case OP_CALL:
+    protectAll();
+    emitReg(RO_CALL, routineLevel - inst->p + 1, tempRegister(depth), 0, inst->q);
+    callee = findRoutine(codeBlock, inst->q);
+    if (callee != NULL && callee->kind == RT_FUNCTION)
+      pushSym(SYM_REG, tempRegister(depth));
+    break;
+  case OP_EP:
+  case OP_EF:
+    emitReg(RO_RET, routineLevel, 0, 0, 0);
+    break;
+  case OP_RC:
+    pushTemp(depth, emitReg(RO_RC, 0, tempRegister(depth), 0, 0));
+    break;
+  case OP_RI:
+    pushTemp(depth, emitReg(RO_RI, 0, tempRegister(depth), 0, 0));
+    break;
+  case OP_WRC:
+  case OP_WRI:
+    reg = registerOf(depth - 1);
+    symDepth--;
+    emitReg(inst->op == OP_WRC ? RO_WRC : RO_WRI, 0, reg, 0, 0);
+    break;
+  case OP_WLN:
+    emitReg(RO_WLN, 0, 0, 0, 0);
+    break;
+  case OP_AD:
+  case OP_SB:
+  case OP_ML:
+  case OP_DV:
+    translateArithmetic(inst->op);
+    break;
+  case OP_NEG:
+    entry = &(symStack[depth - 1]);
+    if (entry->kind == SYM_IMM)
+      entry->value = (WORD) (0u - (unsigned) entry->value);
+    else {
+      reg = registerOf(depth - 1);
+      pushTemp(depth - 1, emitReg(RO_NEG, 0, tempRegister(depth - 1), reg, 0));
+    }
+    break;
+  case OP_CK:
+    // A constant index in range needs no check
+    entry = &(symStack[depth - 1]);
+    if (entry->kind != SYM_IMM || (unsigned) entry->value >= (unsigned) inst->q)
+      emitReg(RO_CHK, 0, registerOf(depth - 1), inst->q, 0);
+    break;
+  case OP_CV:
+    if (symStack[depth - 1].kind == SYM_CMP)
+      materialize(depth - 1);
+    entry = pushSym(SYM_RESERVED, 0);
+    *entry = symStack[depth - 1];
+    entry->def = -1;
+    if (entry->kind == SYM_REG && entry->value == tempRegister(depth - 1)) {
+      entry->value = tempRegister(depth);
+      entry->def = emitReg(RO_MOV, 0, tempRegister(depth), tempRegister(depth - 1), 0);
+    }
+    break;
+  case OP_EQ:
+  case OP_NE:
+  case OP_GT:
+  case OP_LT:
+  case OP_GE:
+  case OP_LE:
+    translateComparison(inst->op);
+    break;
+  }
+}
+
+int isJump(RegOpCode op) {
+  return op >= RO_J && op <= RO_CALL;
+}
+
+/* Translates the stack code of a code block into register code. The
+ * stack code is walked in address order; jump targets and call targets
+ * are renumbered at the end. */
+RegCodeBlock* translateToRegisters(CodeBlock* codeBlock) {
+  int* owner = mapRoutines(codeBlock);
+  char* isLabel = (char*) calloc(codeBlock->codeSize + 1, 1);
+  char* isFrameInt = (char*) calloc(codeBlock->codeSize + 1, 1);
+  CodeAddress* map = (CodeAddress*) malloc((codeBlock->codeSize + 1) * sizeof(CodeAddress));
+  Instruction* inst;
+  CodeAddress i, entry;
+  int r;
+
+  regCode = (RegCodeBlock*) malloc(sizeof(RegCodeBlock));
+  regCode->code = (RegInstruction*) malloc(INITIAL_REG_CODE_SIZE * sizeof(RegInstruction));
+  regCode->codeSize = 0;
+  regCode->maxSize = INITIAL_REG_CODE_SIZE;
+  regCode->routineCount = codeBlock->routineCount;
+  regCode->routines = (Routine*) malloc(codeBlock->routineCount * sizeof(Routine));
+  memcpy(regCode->routines, codeBlock->routines, codeBlock->routineCount * sizeof(Routine));
+
+  symMaxDepth = INITIAL_SYM_STACK_SIZE;
+  symStack = (SymEntry*) malloc(symMaxDepth * sizeof(SymEntry));
+  symDepth = 0;
+
+  for (i = 0; i < codeBlock->codeSize; i++) {
+    inst = &(codeBlock->code[i]);
+    if (inst->op == OP_J || inst->op == OP_FJ)
+      isLabel[inst->q] = 1;
+  }
+  for (r = 0; r < codeBlock->routineCount; r++) {
+    entry = codeBlock->routines[r].entry;
+    if (codeBlock->code[entry].op == OP_J)
+      entry = codeBlock->code[entry].q;
+    if (codeBlock->code[entry].op == OP_INT)
+      isFrameInt[entry] = 1;
+  }
+
+  for (i = 0; i < codeBlock->codeSize; i++) {
+    if (owner[i] < 0) {
+      map[i] = regCode->codeSize;
+      continue;
+    }
+    tempBase = codeBlock->routines[owner[i]].frameSize;
+    routineLevel = codeBlock->routines[owner[i]].level;
+    if (codeBlock->routines[owner[i]].entry == i)
+      symDepth = 0;
+    else if (isLabel[i])
+      flushAll();
+    map[i] = regCode->codeSize;
+    translateInstruction(codeBlock, &(codeBlock->code[i]), isFrameInt[i]);
+  }
+  map[codeBlock->codeSize] = regCode->codeSize;
+
+  for (i = 0; i < regCode->codeSize; i++)
+    if (isJump(regCode->code[i].op))
+      regCode->code[i].c = map[regCode->code[i].c];
+  for (r = 0; r < regCode->routineCount; r++)
+    regCode->routines[r].entry = map[regCode->routines[r].entry];
+
+  free(symStack);
+  free(map);
+  free(isFrameInt);
+  free(isLabel);
+  free(owner);
+  return regCode;
+}
+
+void freeRegCodeBlock(RegCodeBlock* regCode) {
+  free(regCode->code);
+  free(regCode->routines);
+  free(regCode);
+}
+
+/******************* Disassembler ******************************/
+
+char* regOpCodeName(RegOpCode op) {
+  return regOpCodeNames[op];
+}
+
+void printRegInstruction(RegInstruction* inst) {
+  char* name = regOpCodeNames[inst->op];
+
+  switch (inst->op) {
+  case RO_MOV:
+  case RO_LDI:
+  case RO_NEG:
+    printf("%s r%d,r%d", name, inst->a, inst->b);
+    break;
+  case RO_MOVI:
+    printf("%s r%d,%d", name, inst->a, inst->b);
+    break;
+  case RO_STI:
+    printf("%s [r%d],r%d", name, inst->a, inst->b);
+    break;
+  case RO_LDA:
+  case RO_LDV:
+    printf("%s r%d,%d,%d", name, inst->a, inst->p, inst->b);
+    break;
+  case RO_STV:
+    printf("%s %d,%d,r%d", name, inst->p, inst->b, inst->a);
+    break;
+  case RO_ADDI:
+  case RO_SUBI:
+  case RO_MULI:
+  case RO_DIVI:
+    printf("%s r%d,r%d,%d", name, inst->a, inst->b, inst->c);
+    break;
+  case RO_J:
+    printf("%s %d", name, inst->c);
+    break;
+  case RO_JZ:
+    printf("%s r%d,%d", name, inst->a, inst->c);
+    break;
+  case RO_JEQ: case RO_JNE: case RO_JGT: case RO_JLT: case RO_JGE: case RO_JLE:
+    printf("%s r%d,r%d,%d", name, inst->a, inst->b, inst->c);
+    break;
+  case RO_JEQI: case RO_JNEI: case RO_JGTI: case RO_JLTI: case RO_JGEI: case RO_JLEI:
+    printf("%s r%d,%d,%d", name, inst->a, inst->b, inst->c);
+    break;
+  case RO_CALL:
+    printf("%s %d,%d,r%d", name, inst->p, inst->c, inst->a);
+    break;
+  case RO_ENTER:
+    printf("%s %d", name, inst->b);
+    break;
+  case RO_CHK:
+    printf("%s r%d,%d", name, inst->a, inst->b);
+    break;
+  case RO_RET:
+    printf("%s %d", name, inst->p);
+    break;
+  case RO_HALT:
+  case RO_WLN:
+    printf("%s", name);
+    break;
+  case RO_RC:
+  case RO_RI:
+  case RO_WRC:
+  case RO_WRI:
+    printf("%s r%d", name, inst->a);
+    break;
+  default:
+    printf("%s r%d,r%d,r%d", name, inst->a, inst->b, inst->c);
+    break;
+  }
+}
+
+void printRegCodeBlock(RegCodeBlock* regCode) {
+  CodeAddress i;
+  int r;
+
+  for (i = 0; i < regCode->codeSize; i++) {
+    for (r = 0; r < regCode->routineCount; r++)
+      if (regCode->routines[r].entry == i)
+        printf("%s:  ; level %d, frame %d\n", regCode->routines[r].name,
+               regCode->routines[r].level, regCode->routines[r].frameSize);
+    printf("%5d:  ", i);
+    printRegInstruction(&(regCode->code[i]));
+    printf("\n");
+  }
+}
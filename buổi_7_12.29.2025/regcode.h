@@ -0,0 +1,92 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __REGCODE_H__
+#define __REGCODE_H__
+
+#include "instructions.h"
+
+/* Three-address instructions of the KPL register machine. r is the
+ * current frame: its slots are the registers, so declared variables and
+ * parameters are used in place and expression temporaries take the slots
+ * just above the frame. k is an immediate constant and base(p) the
+ * display entry of nesting level p: unlike in the stack code, p is a
+ * level, not a number of static links. */
+typedef enum {
+  RO_MOV,    // r[a] := r[b]
+  RO_MOVI,   // r[a] := k                      (k in b)
+  RO_LDA,    // r[a] := base(p) + b
+  RO_LDV,    // r[a] := s[base(p) + b]
+  RO_STV,    // s[base(p) + b] := r[a]
+  RO_LDI,    // r[a] := s[r[b]]
+  RO_STI,    // s[r[a]] := r[b]
+  RO_ADD,    // r[a] := r[b] + r[c]
+  RO_ADDI,   // r[a] := r[b] + k               (k in c)
+  RO_SUB,    // r[a] := r[b] - r[c]
+  RO_SUBI,   // r[a] := r[b] - k
+  RO_MUL,    // r[a] := r[b] * r[c]
+  RO_MULI,   // r[a] := r[b] * k
+  RO_DIV,    // r[a] := r[b] / r[c]
+  RO_DIVI,   // r[a] := r[b] / k               (k is neither 0 nor -1)
+  RO_NEG,    // r[a] := - r[b]
+  RO_EQ,     // r[a] := (r[b] = r[c])
+  RO_NE,     // r[a] := (r[b] != r[c])
+  RO_GT,     // r[a] := (r[b] > r[c])
+  RO_LT,     // r[a] := (r[b] < r[c])
+  RO_GE,     // r[a] := (r[b] >= r[c])
+  RO_LE,     // r[a] := (r[b] <= r[c])
+  RO_J,      // pc := c
+  RO_JZ,     // if r[a] = 0 then pc := c
+  RO_JEQ,    // if r[a] = r[b] then pc := c
+  RO_JNE,    // if r[a] != r[b] then pc := c
+  RO_JGT,    // if r[a] > r[b] then pc := c
+  RO_JLT,    // if r[a] < r[b] then pc := c
+  RO_JGE,    // if r[a] >= r[b] then pc := c
+  RO_JLE,    // if r[a] <= r[b] then pc := c
+  RO_JEQI,   // if r[a] = k then pc := c       (k in b)
+  RO_JNEI,   // if r[a] != k then pc := c
+  RO_JGTI,   // if r[a] > k then pc := c
+  RO_JLTI,   // if r[a] < k then pc := c
+  RO_JGEI,   // if r[a] >= k then pc := c
+  RO_JLEI,   // if r[a] <= k then pc := c
+  RO_CALL,   // new frame at r + a, which becomes base(p); pc := c
+  RO_RET,    // back to the caller's frame and pc, restoring base(p)
+  RO_ENTER,  // check that a frame of b words fits on the stack
+  RO_HALT,
+  RO_RC,     // r[a] := the next character
+  RO_RI,     // r[a] := the next integer
+  RO_WRC,    // write r[a] as a character
+  RO_WRI,    // write r[a] as an integer
+  RO_WLN,    // new line
+  RO_CHK     // stop with an error unless 0 <= r[a] < k   (k in b)
+} RegOpCode;
+
+#define NUM_OF_REG_OPCODES (RO_CHK + 1)
+
+typedef struct {
+  unsigned int op : 8;
+  signed int p : 24;
+  WORD a;
+  WORD b;
+  WORD c;
+} RegInstruction;
+
+typedef struct {
+  RegInstruction* code;
+  int codeSize;
+  int maxSize;
+  Routine* routines;        // as in the code block, entries renumbered
+  int routineCount;
+} RegCodeBlock;
+
+RegCodeBlock* translateToRegisters(CodeBlock* codeBlock);
+void freeRegCodeBlock(RegCodeBlock* regCode);
+
+char* regOpCodeName(RegOpCode op);
+void printRegInstruction(RegInstruction* inst);
+void printRegCodeBlock(RegCodeBlock* regCode);
+
+#endif
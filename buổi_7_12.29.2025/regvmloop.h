@@ -0,0 +1,272 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+/* The interpreter loop of the register machine, included by vm.c like
+ * vmloop.h. r points at the current frame. */
+
+#if VM_COUNTING
+#define VM_COUNT count++
+#else
+#define VM_COUNT
+#endif
+
+#ifdef VM_THREADED
+#define HANDLER(op) L_##op:
+#define DISPATCH do { VM_COUNT; goto *(pc->handler); } while (0)
+#else
+#define HANDLER(op) case op:
+#define DISPATCH continue
+#endif
+
+#define BRANCH(cond) pc = (cond) ? code + pc->c : pc + 1
+
+long VM_FUNCTION(RegCodeBlock* regCode, WORD* s, int stackSize) {
+  RegThread* code;
+  RegThread* pc;
+  WORD* display = (WORD*) calloc(displaySize(regCode->routines, regCode->routineCount), sizeof(WORD));
+  WORD* r = s;
+  WORD* frame;
+  WORD x;
+  long count = 0;
+  int i;
+
+#ifdef VM_THREADED
+  static const void* handlers[NUM_OF_REG_OPCODES] = {
+    &&L_RO_MOV, &&L_RO_MOVI, &&L_RO_LDA, &&L_RO_LDV, &&L_RO_STV, &&L_RO_LDI, &&L_RO_STI,
+    &&L_RO_ADD, &&L_RO_ADDI, &&L_RO_SUB, &&L_RO_SUBI, &&L_RO_MUL, &&L_RO_MULI,
+    &&L_RO_DIV, &&L_RO_DIVI, &&L_RO_NEG,
+    &&L_RO_EQ, &&L_RO_NE, &&L_RO_GT, &&L_RO_LT, &&L_RO_GE, &&L_RO_LE,
+    &&L_RO_J, &&L_RO_JZ, &&L_RO_JEQ, &&L_RO_JNE, &&L_RO_JGT, &&L_RO_JLT, &&L_RO_JGE, &&L_RO_JLE,
+    &&L_RO_JEQI, &&L_RO_JNEI, &&L_RO_JGTI, &&L_RO_JLTI, &&L_RO_JGEI, &&L_RO_JLEI,
+    &&L_RO_CALL, &&L_RO_RET, &&L_RO_ENTER, &&L_RO_HALT,
+    &&L_RO_RC, &&L_RO_RI, &&L_RO_WRC, &&L_RO_WRI, &&L_RO_WLN, &&L_RO_CHK
+  };
+#endif
+
+  code = (RegThread*) malloc((regCode->codeSize + 1) * sizeof(RegThread));
+  for (i = 0; i < regCode->codeSize; i++) {
+    code[i].op = regCode->code[i].op;
+    code[i].p = regCode->code[i].p;
+    code[i].a = regCode->code[i].a;
+    code[i].b = regCode->code[i].b;
+    code[i].c = regCode->code[i].c;
+#ifdef VM_THREADED
+    code[i].handler = handlers[code[i].op];
+#endif
+  }
+  code[i].op = RO_HALT;
+#ifdef VM_THREADED
+  code[i].handler = handlers[RO_HALT];
+#endif
+
+  pc = code;
+
+#ifdef VM_THREADED
+  DISPATCH;
+  {
+#else
+  for (;;) {
+    VM_COUNT;
+    switch (pc->op) {
+#endif
+
+    HANDLER(RO_MOV)
+      r[pc->a] = r[pc->b];
+      pc++;
+      DISPATCH;
+    HANDLER(RO_MOVI)
+      r[pc->a] = pc->b;
+      pc++;
+      DISPATCH;
+    HANDLER(RO_LDA)
+      r[pc->a] = display[pc->p] + pc->b;
+      pc++;
+      DISPATCH;
+    HANDLER(RO_LDV)
+      r[pc->a] = s[display[pc->p] + pc->b];
+      pc++;
+      DISPATCH;
+    HANDLER(RO_STV)
+      s[display[pc->p] + pc->b] = r[pc->a];
+      pc++;
+      DISPATCH;
+    HANDLER(RO_LDI)
+      r[pc->a] = s[r[pc->b]];
+      pc++;
+      DISPATCH;
+    HANDLER(RO_STI)
+      s[r[pc->a]] = r[pc->b];
+      pc++;
+      DISPATCH;
+    HANDLER(RO_ADD)
+      r[pc->a] = (WORD) ((unsigned) r[pc->b] + (unsigned) r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_ADDI)
+      r[pc->a] = (WORD) ((unsigned) r[pc->b] + (unsigned) pc->c);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_SUB)
+      r[pc->a] = (WORD) ((unsigned) r[pc->b] - (unsigned) r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_SUBI)
+      r[pc->a] = (WORD) ((unsigned) r[pc->b] - (unsigned) pc->c);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_MUL)
+      r[pc->a] = (WORD) ((unsigned) r[pc->b] * (unsigned) r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_MULI)
+      r[pc->a] = (WORD) ((unsigned) r[pc->b] * (unsigned) pc->c);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_DIV)
+      x = r[pc->c];
+      if (x == 0)
+        kplDivisionByZero();
+      r[pc->a] = (x == -1) ? (WORD) (0u - (unsigned) r[pc->b]) : r[pc->b] / x;
+      pc++;
+      DISPATCH;
+    HANDLER(RO_DIVI)
+      r[pc->a] = r[pc->b] / pc->c;
+      pc++;
+      DISPATCH;
+    HANDLER(RO_NEG)
+      r[pc->a] = (WORD) (0u - (unsigned) r[pc->b]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_EQ)
+      r[pc->a] = (r[pc->b] == r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_NE)
+      r[pc->a] = (r[pc->b] != r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_GT)
+      r[pc->a] = (r[pc->b] > r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_LT)
+      r[pc->a] = (r[pc->b] < r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_GE)
+      r[pc->a] = (r[pc->b] >= r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_LE)
+      r[pc->a] = (r[pc->b] <= r[pc->c]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_J)
+      pc = code + pc->c;
+      DISPATCH;
+    HANDLER(RO_JZ)
+      BRANCH(r[pc->a] == 0);
+      DISPATCH;
+    HANDLER(RO_JEQ)
+      BRANCH(r[pc->a] == r[pc->b]);
+      DISPATCH;
+    HANDLER(RO_JNE)
+      BRANCH(r[pc->a] != r[pc->b]);
+      DISPATCH;
+    HANDLER(RO_JGT)
+      BRANCH(r[pc->a] > r[pc->b]);
+      DISPATCH;
+    HANDLER(RO_JLT)
+      BRANCH(r[pc->a] < r[pc->b]);
+      DISPATCH;
+    HANDLER(RO_JGE)
+      BRANCH(r[pc->a] >= r[pc->b]);
+      DISPATCH;
+    HANDLER(RO_JLE)
+      BRANCH(r[pc->a] <= r[pc->b]);
+      DISPATCH;
+    HANDLER(RO_JEQI)
+      BRANCH(r[pc->a] == pc->b);
+      DISPATCH;
+    HANDLER(RO_JNEI)
+      BRANCH(r[pc->a] != pc->b);
+      DISPATCH;
+    HANDLER(RO_JGTI)
+      BRANCH(r[pc->a] > pc->b);
+      DISPATCH;
+    HANDLER(RO_JLTI)
+      BRANCH(r[pc->a] < pc->b);
+      DISPATCH;
+    HANDLER(RO_JGEI)
+      BRANCH(r[pc->a] >= pc->b);
+      DISPATCH;
+    HANDLER(RO_JLEI)
+      BRANCH(r[pc->a] <= pc->b);
+      DISPATCH;
+    HANDLER(RO_CALL)
+      frame = r + pc->a;
+      frame[1] = r - s;
+      frame[2] = (pc - code) + 1;
+      frame[3] = display[pc->p];
+      display[pc->p] = frame - s;
+      r = frame;
+      pc = code + pc->c;
+      DISPATCH;
+    HANDLER(RO_RET)
+      display[pc->p] = r[3];
+      pc = code + r[2];
+      r = s + r[1];
+      DISPATCH;
+    HANDLER(RO_ENTER)
+      if ((r - s) + pc->b >= stackSize)
+        kplStackOverflow();
+      pc++;
+      DISPATCH;
+    HANDLER(RO_HALT)
+      goto halt;
+    HANDLER(RO_RC)
+      r[pc->a] = kplReadChar();
+      pc++;
+      DISPATCH;
+    HANDLER(RO_RI)
+      r[pc->a] = kplReadInt();
+      pc++;
+      DISPATCH;
+    HANDLER(RO_WRC)
+      kplWriteChar(r[pc->a]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_WRI)
+      kplWriteInt(r[pc->a]);
+      pc++;
+      DISPATCH;
+    HANDLER(RO_WLN)
+      kplWriteLn();
+      pc++;
+      DISPATCH;
+    HANDLER(RO_CHK)
+      if ((unsigned) r[pc->a] >= (unsigned) pc->b)
+        kplIndexOutOfRange();
+      pc++;
+      DISPATCH;
+
+#ifndef VM_THREADED
+    }
+#endif
+  }
+
+ halt:
+  free(display);
+  free(code);
+  return count;
+}
+
+#undef BRANCH
+#undef VM_COUNT
+#undef HANDLER
+#undef DISPATCH
+#undef VM_FUNCTION
+#undef VM_COUNTING
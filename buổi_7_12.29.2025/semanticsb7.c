@@ -129,11 +129,6 @@ void checkArrayType(Type* type) {
 }
 
 void checkTypeEquality(Type* type1, Type* type2) {
-  if (type1->typeClass != type2->typeClass) {
+  if (!compareType(type1, type2))
     error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
-  } else {
-    if (type1->typeClass == TP_ARRAY) {
-      checkTypeEquality(type1->arrayAttrs->elementType, type2->arrayAttrs->elementType);
-    }
-  }
-}
\ No newline at end of file
+}
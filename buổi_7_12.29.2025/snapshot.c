@@ -0,0 +1,468 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "reader.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "KPLS"
+#define SNAPSHOT_VERSION 1
+
+/* Pointers to records are stored as offsets from the start of the file,
+ * and pointers to types as indexes into the type records, both plus one
+ * so that NULL stays zero. */
+#define ENCODE(n) ((void*) (uintptr_t) ((n) + 1))
+#define DECODE(p) ((long) (uintptr_t) (p) - 1)
+
+struct SnapshotHeader_ {
+  char magic[4];
+  int version;
+  int objectSize;               // guards against a different Object layout
+  int typeCount;
+  int scopeCount;
+  int objectCount;
+  int nodeCount;
+  long fileSize;
+  long typeOffset;
+  long scopeOffset;
+  long objectOffset;
+  long nodeOffset;
+  Scope scope;                  // the exported scope
+};
+
+struct TypeRecord_ {
+  int typeClass;
+  int arraySize;
+  int elementType;              // index of the element type, or -1
+};
+
+typedef struct SnapshotHeader_ SnapshotHeader;
+typedef struct TypeRecord_ TypeRecord;
+
+/******************* Saving ******************************/
+
+Type** savedTypes;
+int savedTypeCount;
+
+int indexOfType(Type* type) {
+  int i;
+
+  for (i = 0; i < savedTypeCount; i++)
+    if (savedTypes[i] == type)
+      return i;
+
+  // Element types are numbered before the arrays built on them
+  if (type->typeClass == TP_ARRAY)
+    indexOfType(type->elementType);
+  savedTypes = (Type**) realloc(savedTypes, (savedTypeCount + 1) * sizeof(Type*));
+  savedTypes[savedTypeCount] = type;
+  return savedTypeCount++;
+}
+
+int isExported(Object* obj) {
+  return obj->kind != OBJ_PROGRAM && obj->kind != OBJ_PARAMETER;
+}
+
+ObjectNode* signatureOf(Object* obj) {
+  switch (obj->kind) {
+  case OBJ_FUNCTION: return obj->funcAttrs->paramList;
+  case OBJ_PROCEDURE: return obj->procAttrs->paramList;
+  default: return NULL;
+  }
+}
+
+int saveSnapshot(Scope* scope, char *fileName) {
+  SnapshotHeader* header;
+  TypeRecord* types;
+  Scope* scopes;
+  Object* objects;
+  ObjectNode* nodes;
+  ObjectNode* node;
+  ObjectNode* param;
+  char* image;
+  FILE* f;
+  int scopeCount = 1, objectCount = 0;
+  int s, o, n, i, last;
+  long size;
+
+  savedTypes = NULL;
+  savedTypeCount = 0;
+
+  // Count the records and number the types
+  for (node = scope->objList; node != NULL; node = node->next) {
+    Object* obj = node->object;
+    if (!isExported(obj)) continue;
+    objectCount ++;
+    switch (obj->kind) {
+    case OBJ_TYPE: indexOfType(obj->typeAttrs->actualType); break;
+    case OBJ_VARIABLE: indexOfType(obj->varAttrs->type); break;
+    case OBJ_FUNCTION: indexOfType(obj->funcAttrs->returnType); // fall through
+    case OBJ_PROCEDURE:
+      scopeCount ++;
+      for (param = signatureOf(obj); param != NULL; param = param->next) {
+        indexOfType(param->object->paramAttrs->type);
+        objectCount ++;
+      }
+      break;
+    default: break;
+    }
+  }
+
+  size = sizeof(SnapshotHeader)
+    + savedTypeCount * sizeof(TypeRecord)
+    + (scopeCount - 1) * sizeof(Scope)
+    + objectCount * sizeof(Object)
+    + objectCount * sizeof(ObjectNode);
+  image = (char*) calloc(1, size);
+
+  header = (SnapshotHeader*) image;
+  memcpy(header->magic, SNAPSHOT_MAGIC, 4);
+  header->version = SNAPSHOT_VERSION;
+  header->objectSize = sizeof(Object);
+  header->typeCount = savedTypeCount;
+  header->scopeCount = scopeCount - 1;
+  header->objectCount = objectCount;
+  header->nodeCount = objectCount;
+  header->fileSize = size;
+  header->typeOffset = sizeof(SnapshotHeader);
+  header->scopeOffset = header->typeOffset + savedTypeCount * sizeof(TypeRecord);
+  header->objectOffset = header->scopeOffset + (scopeCount - 1) * sizeof(Scope);
+  header->nodeOffset = header->objectOffset + objectCount * sizeof(Object);
+
+  types = (TypeRecord*) (image + header->typeOffset);
+  scopes = (Scope*) (image + header->scopeOffset);
+  objects = (Object*) (image + header->objectOffset);
+  nodes = (ObjectNode*) (image + header->nodeOffset);
+
+  for (i = 0; i < savedTypeCount; i++) {
+    types[i].typeClass = savedTypes[i]->typeClass;
+    types[i].arraySize = savedTypes[i]->arraySize;
+    types[i].elementType = (savedTypes[i]->typeClass == TP_ARRAY) ? indexOfType(savedTypes[i]->elementType) : -1;
+  }
+
+#define OBJECT_AT(k) ENCODE(header->objectOffset + (k) * (long) sizeof(Object))
+#define NODE_AT(k) ENCODE(header->nodeOffset + (k) * (long) sizeof(ObjectNode))
+#define SCOPE_AT(k) ENCODE(header->scopeOffset + (k) * (long) sizeof(Scope))
+#define ROOT_SCOPE ENCODE(offsetof(SnapshotHeader, scope))
+
+  header->scope.objList = NULL;
+  header->scope.owner = NULL;
+  header->scope.outer = NULL;
+  header->scope.frameSize = scope->frameSize;
+  header->scope.level = scope->level;
+
+  // Objects and nodes are numbered in the same order, so node k refers to object k
+  s = o = 0;
+  for (node = scope->objList; node != NULL; node = node->next) {
+    Object* obj = node->object;
+    Object* rec;
+    int self;
+
+    if (!isExported(obj)) continue;
+
+    self = o;
+    rec = &objects[o];
+    *rec = *obj;
+    o ++;
+
+    switch (obj->kind) {
+    case OBJ_TYPE:
+      rec->typeAttrs->actualType = ENCODE(indexOfType(obj->typeAttrs->actualType));
+      break;
+    case OBJ_VARIABLE:
+      rec->varAttrs->type = ENCODE(indexOfType(obj->varAttrs->type));
+      rec->varAttrs->scope = ROOT_SCOPE;
+      break;
+    case OBJ_FUNCTION:
+    case OBJ_PROCEDURE:
+      if (obj->kind == OBJ_FUNCTION)
+        rec->funcAttrs->returnType = ENCODE(indexOfType(obj->funcAttrs->returnType));
+
+      scopes[s].owner = OBJECT_AT(self);
+      scopes[s].outer = ROOT_SCOPE;
+      scopes[s].objList = NULL;
+      scopes[s].frameSize = (obj->kind == OBJ_FUNCTION) ? obj->funcAttrs->scope->frameSize : obj->procAttrs->scope->frameSize;
+      scopes[s].level = scope->level + 1;
+
+      // The parameters form both the scope's object list and the parameter list
+      for (param = signatureOf(obj), n = 0; param != NULL; param = param->next, n++) {
+        Object* p = &objects[o];
+        *p = *(param->object);
+        p->paramAttrs->type = ENCODE(indexOfType(param->object->paramAttrs->type));
+        p->paramAttrs->function = OBJECT_AT(self);
+        nodes[o].object = OBJECT_AT(o);
+        nodes[o].next = (param->next != NULL) ? NODE_AT(o + 1) : NULL;
+        if (n == 0) scopes[s].objList = NODE_AT(o);
+        o ++;
+      }
+
+      // Imported subprograms have no code in the importing program
+      if (obj->kind == OBJ_FUNCTION) {
+        rec->funcAttrs->paramList = scopes[s].objList;
+        rec->funcAttrs->scope = SCOPE_AT(s);
+        rec->funcAttrs->codeAddress = -1;
+      } else {
+        rec->procAttrs->paramList = scopes[s].objList;
+        rec->procAttrs->scope = SCOPE_AT(s);
+        rec->procAttrs->codeAddress = -1;
+      }
+      s ++;
+      break;
+    default:
+      break;
+    }
+
+    nodes[self].object = OBJECT_AT(self);
+    nodes[self].next = NULL;
+  }
+
+  // Chain the top-level nodes, skipping over the parameter nodes
+  last = -1;
+  for (i = 0; i < objectCount; i++) {
+    if (objects[i].kind == OBJ_PARAMETER) continue;
+    if (last < 0) header->scope.objList = NODE_AT(i);
+    else nodes[last].next = NODE_AT(i);
+    last = i;
+  }
+
+  free(savedTypes);
+
+  f = fopen(fileName, "wb");
+  if (f == NULL) {
+    free(image);
+    return IO_ERROR;
+  }
+  n = (fwrite(image, 1, size, f) == size);
+  fclose(f);
+  free(image);
+  return n ? IO_SUCCESS : IO_ERROR;
+}
+
+/******************* Loading ******************************/
+
+/* Whether count records of the given size start at offset, right after
+ * the records before them, and leave the file large enough for them */
+int isRegion(SnapshotHeader* header, long* end, long offset, int count, long size) {
+  if (offset != *end || count < 0 || count > (header->fileSize - offset) / size)
+    return 0;
+  *end = offset + count * size;
+  return 1;
+}
+
+/* Whether an encoded pointer is NULL or names one of the records */
+int isRecord(void* p, long offset, int count, long size) {
+  long n;
+
+  if (p == NULL) return 1;
+  n = DECODE(p);
+  return n >= offset && n - offset < count * size && (n - offset) % size == 0;
+}
+
+int isType(SnapshotHeader* header, void* p) {
+  return p != NULL && DECODE(p) >= 0 && DECODE(p) < header->typeCount;
+}
+
+int isScope(SnapshotHeader* header, void* p) {
+  return p != NULL && (isRecord(p, header->scopeOffset, header->scopeCount, sizeof(Scope))
+                       || DECODE(p) == (long) offsetof(SnapshotHeader, scope));
+}
+
+#define IS_OBJECT(p) isRecord(p, header->objectOffset, header->objectCount, sizeof(Object))
+#define IS_NODE(p) isRecord(p, header->nodeOffset, header->nodeCount, sizeof(ObjectNode))
+
+/* Checks the offsets and indexes of a snapshot before any is followed,
+ * so that a damaged file is rejected instead of read out of bounds */
+int checkSnapshot(SnapshotHeader* header) {
+  TypeRecord* types;
+  Scope* scopes;
+  Object* objects;
+  ObjectNode* nodes;
+  char* base = (char*) header;
+  long end = sizeof(SnapshotHeader);
+  int* sizes;
+  int i;
+
+  if (!isRegion(header, &end, header->typeOffset, header->typeCount, sizeof(TypeRecord))
+      || !isRegion(header, &end, header->scopeOffset, header->scopeCount, sizeof(Scope))
+      || !isRegion(header, &end, header->objectOffset, header->objectCount, sizeof(Object))
+      || !isRegion(header, &end, header->nodeOffset, header->nodeCount, sizeof(ObjectNode))
+      || end != header->fileSize)
+    return 0;
+
+  types = (TypeRecord*) (base + header->typeOffset);
+  scopes = (Scope*) (base + header->scopeOffset);
+  objects = (Object*) (base + header->objectOffset);
+  nodes = (ObjectNode*) (base + header->nodeOffset);
+
+  // An array type is built on a type loaded before it, and its size in
+  // words must fit in an int
+  sizes = (int*) malloc((header->typeCount + 1) * sizeof(int));
+  for (i = 0; i < header->typeCount; i++) {
+    if (types[i].typeClass == TP_ARRAY) {
+      if (types[i].elementType < 0 || types[i].elementType >= i || types[i].arraySize < 0
+          || (sizes[types[i].elementType] > 0 && types[i].arraySize > INT_MAX / sizes[types[i].elementType]))
+        break;
+      sizes[i] = types[i].arraySize * sizes[types[i].elementType];
+    } else if (types[i].typeClass == TP_INT || types[i].typeClass == TP_CHAR)
+      sizes[i] = 1;
+    else break;
+  }
+  free(sizes);
+  if (i < header->typeCount) return 0;
+
+  // The exported scope is the outermost one
+  if (!IS_NODE(header->scope.objList) || header->scope.owner != NULL || header->scope.outer != NULL)
+    return 0;
+  for (i = 0; i < header->scopeCount; i++)
+    if (!IS_NODE(scopes[i].objList) || !IS_OBJECT(scopes[i].owner)
+        || (scopes[i].outer != NULL && !isScope(header, scopes[i].outer)))
+      return 0;
+
+  // A node links only to a later one, so no list can loop
+  for (i = 0; i < header->nodeCount; i++)
+    if (!IS_OBJECT(nodes[i].object) || !IS_NODE(nodes[i].next)
+        || (nodes[i].next != NULL && DECODE(nodes[i].next) <= header->nodeOffset + i * (long) sizeof(ObjectNode)))
+      return 0;
+
+  for (i = 0; i < header->objectCount; i++) {
+    Object* obj = &objects[i];
+    if (memchr(obj->name, '\0', MAX_IDENT_LEN + 1) == NULL) return 0;
+    switch (obj->kind) {
+    case OBJ_TYPE:
+      if (!isType(header, obj->typeAttrs->actualType)) return 0;
+      break;
+    case OBJ_VARIABLE:
+      if (!isType(header, obj->varAttrs->type) || !isScope(header, obj->varAttrs->scope)) return 0;
+      break;
+    case OBJ_FUNCTION:
+      if (!isType(header, obj->funcAttrs->returnType) || !IS_NODE(obj->funcAttrs->paramList)
+          || !isScope(header, obj->funcAttrs->scope))
+        return 0;
+      break;
+    case OBJ_PROCEDURE:
+      if (!IS_NODE(obj->procAttrs->paramList) || !isScope(header, obj->procAttrs->scope)) return 0;
+      break;
+    case OBJ_PARAMETER:
+      if (!isType(header, obj->paramAttrs->type) || !IS_OBJECT(obj->paramAttrs->function)) return 0;
+      break;
+    case OBJ_CONSTANT:
+      break;
+    default:
+      return 0;
+    }
+  }
+  return 1;
+}
+
+#define RELOCATE(p) ((p) = (void*) ((p) == NULL ? NULL : base + DECODE(p)))
+#define RETYPE(p) ((p) = typeMap[DECODE(p)])
+
+Scope* loadSnapshot(char *fileName) {
+  SnapshotHeader* header;
+  TypeRecord* types;
+  Scope* scopes;
+  Object* objects;
+  ObjectNode* nodes;
+  Type** typeMap;
+  struct stat st;
+  char* base;
+  int fd, i;
+
+  fd = open(fileName, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(SnapshotHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  // A private mapping lets the records be relocated in place
+  base = (char*) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  header = (SnapshotHeader*) base;
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0
+      || header->version != SNAPSHOT_VERSION
+      || header->objectSize != sizeof(Object)
+      || header->fileSize != st.st_size
+      || !checkSnapshot(header)) {
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  types = (TypeRecord*) (base + header->typeOffset);
+  scopes = (Scope*) (base + header->scopeOffset);
+  objects = (Object*) (base + header->objectOffset);
+  nodes = (ObjectNode*) (base + header->nodeOffset);
+
+  // Types are interned so that they compare equal to the compiler's own
+  typeMap = (Type**) malloc((header->typeCount + 1) * sizeof(Type*));
+  for (i = 0; i < header->typeCount; i++) {
+    switch (types[i].typeClass) {
+    case TP_INT: typeMap[i] = makeIntType(); break;
+    case TP_CHAR: typeMap[i] = makeCharType(); break;
+    default: typeMap[i] = makeArrayType(types[i].arraySize, typeMap[types[i].elementType]); break;
+    }
+  }
+
+  RELOCATE(header->scope.objList);
+  for (i = 0; i < header->scopeCount; i++) {
+    RELOCATE(scopes[i].objList);
+    RELOCATE(scopes[i].owner);
+    RELOCATE(scopes[i].outer);
+  }
+
+  for (i = 0; i < header->nodeCount; i++) {
+    RELOCATE(nodes[i].object);
+    RELOCATE(nodes[i].next);
+  }
+
+  for (i = 0; i < header->objectCount; i++) {
+    Object* obj = &objects[i];
+    switch (obj->kind) {
+    case OBJ_TYPE:
+      RETYPE(obj->typeAttrs->actualType);
+      break;
+    case OBJ_VARIABLE:
+      RETYPE(obj->varAttrs->type);
+      RELOCATE(obj->varAttrs->scope);
+      break;
+    case OBJ_FUNCTION:
+      RETYPE(obj->funcAttrs->returnType);
+      RELOCATE(obj->funcAttrs->paramList);
+      RELOCATE(obj->funcAttrs->scope);
+      break;
+    case OBJ_PROCEDURE:
+      RELOCATE(obj->procAttrs->paramList);
+      RELOCATE(obj->procAttrs->scope);
+      break;
+    case OBJ_PARAMETER:
+      RETYPE(obj->paramAttrs->type);
+      RELOCATE(obj->paramAttrs->function);
+      break;
+    default:
+      break;
+    }
+  }
+
+  free(typeMap);
+  return &(header->scope);
+}
+
+void freeSnapshot(Scope* scope) {
+  SnapshotHeader* header = (SnapshotHeader*) ((char*) scope - offsetof(SnapshotHeader, scope));
+  munmap(header, header->fileSize);
+}
@@ -0,0 +1,22 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "symtab.h"
+
+/* A snapshot is a binary image of the declarations of one scope:
+ * constants, types, variables and the signatures of functions and
+ * procedures. Records are stored as the in-memory Object, Scope and
+ * ObjectNode structures with pointers replaced by file offsets, so a
+ * snapshot is loaded by mapping the file and relocating it in place. */
+
+int saveSnapshot(Scope* scope, char *fileName);
+Scope* loadSnapshot(char *fileName);
+void freeSnapshot(Scope* scope);
+
+#endif
@@ -16,61 +16,76 @@ void freeObjectList(ObjectNode *objList);
 void freeReferenceList(ObjectNode *objList);
 
 SymTab* symtab;
-Type* intType;
-Type* charType;
+
+/* The basic types are immutable singletons; array types are interned in typeTable */
+const Type intTypeNode = {TP_INT, 0, 1, NULL, NULL};
+const Type charTypeNode = {TP_CHAR, 0, 1, NULL, NULL};
+Type* intType = (Type*) &intTypeNode;
+Type* charType = (Type*) &charTypeNode;
+
+#define TYPE_TABLE_SIZE 256
+#define OBJECT_POOL_SIZE 256
+
+Type* typeTable[TYPE_TABLE_SIZE];
+
+/* Objects are fixed-size records allocated densely from pools */
+struct ObjectPool_ {
+  Object objects[OBJECT_POOL_SIZE];
+  int count;
+  struct ObjectPool_ *next;
+};
+
+struct ObjectPool_* objectPool = NULL;
 
 /******************* Type utilities ******************************/
 
 Type* makeIntType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_INT;
-  return type;
+  return intType;
 }
 
 Type* makeCharType(void) {
-  Type* type = (Type*) malloc(sizeof(Type));
-  type->typeClass = TP_CHAR;
-  return type;
+  return charType;
 }
 
 Type* makeArrayType(int arraySize, Type* elementType) {
-  Type* type = (Type*) malloc(sizeof(Type));
+  unsigned h = ((unsigned) arraySize * 31u + (unsigned) ((size_t) elementType >> 4)) % TYPE_TABLE_SIZE;
+  Type* type;
+
+  for (type = typeTable[h]; type != NULL; type = type->next)
+    if (type->arraySize == arraySize && type->elementType == elementType)
+      return type;
+
+  type = (Type*) malloc(sizeof(Type));
   type->typeClass = TP_ARRAY;
   type->arraySize = arraySize;
+  type->size = arraySize * elementType->size;
   type->elementType = elementType;
+  type->next = typeTable[h];
+  typeTable[h] = type;
   return type;
 }
 
 Type* duplicateType(Type* type) {
-  Type* resultType = (Type*) malloc(sizeof(Type));
-  resultType->typeClass = type->typeClass;
-  if (type->typeClass == TP_ARRAY) {
-    resultType->arraySize = type->arraySize;
-    resultType->elementType = duplicateType(type->elementType);
-  }
-  return resultType;
+  return type;
 }
 
 int compareType(Type* type1, Type* type2) {
-  if (type1->typeClass == type2->typeClass) {
-    if (type1->typeClass == TP_ARRAY) {
-      if (type1->arraySize == type2->arraySize)
-	return compareType(type1->elementType, type2->elementType);
-      else return 0;
-    } else return 1;
-  } else return 0;
+  return type1 == type2;
 }
 
-void freeType(Type* type) {
-  switch (type->typeClass) {
-  case TP_INT:
-  case TP_CHAR:
-    free(type);
-    break;
-  case TP_ARRAY:
-    freeType(type->elementType);
-    freeType(type);
-    break;
+int sizeOfType(Type* type) {
+  return type->size;
+}
+
+void freeTypeTable(void) {
+  int i;
+
+  for (i = 0; i < TYPE_TABLE_SIZE; i++) {
+    while (typeTable[i] != NULL) {
+      Type* type = typeTable[i];
+      typeTable[i] = type->next;
+      free(type);
+    }
   }
 }
 
@@ -102,75 +117,84 @@ ConstantValue* duplicateConstantValue(ConstantValue* v) {
 
 /******************* Object utilities ******************************/
 
+Object* allocObject(char *name, enum ObjectKind kind) {
+  Object* obj;
+
+  if (objectPool == NULL || objectPool->count == OBJECT_POOL_SIZE) {
+    struct ObjectPool_* pool = (struct ObjectPool_*) malloc(sizeof(struct ObjectPool_));
+    pool->count = 0;
+    pool->next = objectPool;
+    objectPool = pool;
+  }
+  obj = &(objectPool->objects[objectPool->count++]);
+  strcpy(obj->name, name);
+  obj->kind = kind;
+  return obj;
+}
+
+void freeObjectPool(void) {
+  while (objectPool != NULL) {
+    struct ObjectPool_* pool = objectPool;
+    objectPool = pool->next;
+    free(pool);
+  }
+}
+
 Scope* createScope(Object* owner, Scope* outer) {
   Scope* scope = (Scope*) malloc(sizeof(Scope));
   scope->objList = NULL;
   scope->owner = owner;
   scope->outer = outer;
+  scope->frameSize = RESERVED_WORDS;
+  scope->level = (outer == NULL) ? 0 : outer->level + 1;
   return scope;
 }
 
 Object* createProgramObject(char *programName) {
-  Object* program = (Object*) malloc(sizeof(Object));
-  strcpy(program->name, programName);
-  program->kind = OBJ_PROGRAM;
-  program->progAttrs = (ProgramAttributes*) malloc(sizeof(ProgramAttributes));
+  Object* program = allocObject(programName, OBJ_PROGRAM);
   program->progAttrs->scope = createScope(program,NULL);
+  program->progAttrs->codeAddress = -1;
   symtab->program = program;
 
   return program;
 }
 
 Object* createConstantObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
-  obj->kind = OBJ_CONSTANT;
-  obj->constAttrs = (ConstantAttributes*) malloc(sizeof(ConstantAttributes));
+  Object* obj = allocObject(name, OBJ_CONSTANT);
   return obj;
 }
 
 Object* createTypeObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
-  obj->kind = OBJ_TYPE;
-  obj->typeAttrs = (TypeAttributes*) malloc(sizeof(TypeAttributes));
+  Object* obj = allocObject(name, OBJ_TYPE);
   return obj;
 }
 
 Object* createVariableObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
-  obj->kind = OBJ_VARIABLE;
-  obj->varAttrs = (VariableAttributes*) malloc(sizeof(VariableAttributes));
+  Object* obj = allocObject(name, OBJ_VARIABLE);
   obj->varAttrs->scope = symtab->currentScope;
   return obj;
 }
 
 Object* createFunctionObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
-  obj->kind = OBJ_FUNCTION;
-  obj->funcAttrs = (FunctionAttributes*) malloc(sizeof(FunctionAttributes));
+  Object* obj = allocObject(name, OBJ_FUNCTION);
   obj->funcAttrs->paramList = NULL;
+  obj->funcAttrs->paramCount = 0;
+  obj->funcAttrs->codeAddress = -1;
   obj->funcAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
 
 Object* createProcedureObject(char *name) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
-  obj->kind = OBJ_PROCEDURE;
-  obj->procAttrs = (ProcedureAttributes*) malloc(sizeof(ProcedureAttributes));
+  Object* obj = allocObject(name, OBJ_PROCEDURE);
   obj->procAttrs->paramList = NULL;
+  obj->procAttrs->paramCount = 0;
+  obj->procAttrs->codeAddress = -1;
   obj->procAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
 
 Object* createParameterObject(char *name, enum ParamKind kind, Object* owner) {
-  Object* obj = (Object*) malloc(sizeof(Object));
-  strcpy(obj->name, name);
-  obj->kind = OBJ_PARAMETER;
-  obj->paramAttrs = (ParameterAttributes*) malloc(sizeof(ParameterAttributes));
+  Object* obj = allocObject(name, OBJ_PARAMETER);
   obj->paramAttrs->kind = kind;
   obj->paramAttrs->function = owner;
   return obj;
@@ -178,38 +202,20 @@ Object* createParameterObject(char *name, enum ParamKind kind, Object* owner) {
 
 void freeObject(Object* obj) {
   switch (obj->kind) {
-  case OBJ_CONSTANT:
-    free(obj->constAttrs->value);
-    free(obj->constAttrs);
-    break;
-  case OBJ_TYPE:
-    free(obj->typeAttrs->actualType);
-    free(obj->typeAttrs);
-    break;
-  case OBJ_VARIABLE:
-    free(obj->varAttrs->type);
-    free(obj->varAttrs);
-    break;
   case OBJ_FUNCTION:
     freeReferenceList(obj->funcAttrs->paramList);
-    freeType(obj->funcAttrs->returnType);
     freeScope(obj->funcAttrs->scope);
-    free(obj->funcAttrs);
     break;
   case OBJ_PROCEDURE:
     freeReferenceList(obj->procAttrs->paramList);
     freeScope(obj->procAttrs->scope);
-    free(obj->procAttrs);
     break;
   case OBJ_PROGRAM:
     freeScope(obj->progAttrs->scope);
-    free(obj->progAttrs);
     break;
-  case OBJ_PARAMETER:
-    freeType(obj->paramAttrs->type);
-    free(obj->paramAttrs);
+  default:
+    break;
   }
-  free(obj);
 }
 
 void freeScope(Scope* scope) {
@@ -261,48 +267,88 @@ Object* findObject(ObjectNode *objList, char *name) {
   return NULL;
 }
 
+/******************* Predefined objects ******************************/
+
+/* The predefined functions and procedures form one scope of read-only
+ * data, initialized at compile time and shared by every compilation.
+ * Each subprogram has its own scope holding its parameter, which is also
+ * its parameter list. */
+
+#define BUILTIN_TYPE(t) ((Type*) &(t))
+#define BUILTIN_OBJECT(o) ((Object*) &(o))
+#define BUILTIN_SCOPE(s) ((Scope*) &(s))
+#define BUILTIN_NODE(n) ((ObjectNode*) &(n))
+
+extern const Scope readcScope, readiScope, writeiScope, writecScope, writelnScope;
+extern const ObjectNode writeiParamNode, writecParamNode;
+extern const ObjectNode readcNode, readiNode, writeiNode, writecNode, writelnNode;
+
+const Object readcFunction = {
+  "READC", OBJ_FUNCTION,
+  .funcAttrs = {{ NULL, 0, BUILTIN_TYPE(charTypeNode), BUILTIN_SCOPE(readcScope), -1 }}
+};
+
+const Object readiFunction = {
+  "READI", OBJ_FUNCTION,
+  .funcAttrs = {{ NULL, 0, BUILTIN_TYPE(intTypeNode), BUILTIN_SCOPE(readiScope), -1 }}
+};
+
+const Object writeiProcedure = {
+  "WRITEI", OBJ_PROCEDURE,
+  .procAttrs = {{ BUILTIN_NODE(writeiParamNode), 1, BUILTIN_SCOPE(writeiScope), -1 }}
+};
+
+const Object writecProcedure = {
+  "WRITEC", OBJ_PROCEDURE,
+  .procAttrs = {{ BUILTIN_NODE(writecParamNode), 1, BUILTIN_SCOPE(writecScope), -1 }}
+};
+
+const Object writelnProcedure = {
+  "WRITELN", OBJ_PROCEDURE,
+  .procAttrs = {{ NULL, 0, BUILTIN_SCOPE(writelnScope), -1 }}
+};
+
+const Object writeiParam = {
+  "i", OBJ_PARAMETER,
+  .paramAttrs = {{ PARAM_VALUE, BUILTIN_TYPE(intTypeNode), BUILTIN_OBJECT(writeiProcedure), RESERVED_WORDS, 1 }}
+};
+
+const Object writecParam = {
+  "ch", OBJ_PARAMETER,
+  .paramAttrs = {{ PARAM_VALUE, BUILTIN_TYPE(charTypeNode), BUILTIN_OBJECT(writecProcedure), RESERVED_WORDS, 1 }}
+};
+
+const ObjectNode writeiParamNode = { BUILTIN_OBJECT(writeiParam), NULL };
+const ObjectNode writecParamNode = { BUILTIN_OBJECT(writecParam), NULL };
+
+const ObjectNode readcNode = { BUILTIN_OBJECT(readcFunction), BUILTIN_NODE(readiNode) };
+const ObjectNode readiNode = { BUILTIN_OBJECT(readiFunction), BUILTIN_NODE(writeiNode) };
+const ObjectNode writeiNode = { BUILTIN_OBJECT(writeiProcedure), BUILTIN_NODE(writecNode) };
+const ObjectNode writecNode = { BUILTIN_OBJECT(writecProcedure), BUILTIN_NODE(writelnNode) };
+const ObjectNode writelnNode = { BUILTIN_OBJECT(writelnProcedure), NULL };
+
+const Scope builtinScope = { BUILTIN_NODE(readcNode), NULL, NULL, RESERVED_WORDS, 0 };
+
+const Scope readcScope = { NULL, BUILTIN_OBJECT(readcFunction), BUILTIN_SCOPE(builtinScope), RESERVED_WORDS, 1 };
+const Scope readiScope = { NULL, BUILTIN_OBJECT(readiFunction), BUILTIN_SCOPE(builtinScope), RESERVED_WORDS, 1 };
+const Scope writeiScope = { BUILTIN_NODE(writeiParamNode), BUILTIN_OBJECT(writeiProcedure), BUILTIN_SCOPE(builtinScope), RESERVED_WORDS + 1, 1 };
+const Scope writecScope = { BUILTIN_NODE(writecParamNode), BUILTIN_OBJECT(writecProcedure), BUILTIN_SCOPE(builtinScope), RESERVED_WORDS + 1, 1 };
+const Scope writelnScope = { NULL, BUILTIN_OBJECT(writelnProcedure), BUILTIN_SCOPE(builtinScope), RESERVED_WORDS, 1 };
+
 /******************* others ******************************/
 
 void initSymTab(void) {
-  Object* obj;
-  Object* param;
-
   symtab = (SymTab*) malloc(sizeof(SymTab));
-  symtab->globalObjectList = NULL;
-  
-  obj = createFunctionObject("READC");
-  obj->funcAttrs->returnType = makeCharType();
-  addObject(&(symtab->globalObjectList), obj);
-
-  obj = createFunctionObject("READI");
-  obj->funcAttrs->returnType = makeIntType();
-  addObject(&(symtab->globalObjectList), obj);
-
-  obj = createProcedureObject("WRITEI");
-  param = createParameterObject("i", PARAM_VALUE, obj);
-  param->paramAttrs->type = makeIntType();
-  addObject(&(obj->procAttrs->paramList),param);
-  addObject(&(symtab->globalObjectList), obj);
-
-  obj = createProcedureObject("WRITEC");
-  param = createParameterObject("ch", PARAM_VALUE, obj);
-  param->paramAttrs->type = makeCharType();
-  addObject(&(obj->procAttrs->paramList),param);
-  addObject(&(symtab->globalObjectList), obj);
-
-  obj = createProcedureObject("WRITELN");
-  addObject(&(symtab->globalObjectList), obj);
-
-  intType = makeIntType();
-  charType = makeCharType();
+  symtab->program = NULL;
+  symtab->currentScope = NULL;
+  symtab->globalObjectList = builtinScope.objList;
 }
 
 void cleanSymTab(void) {
   freeObject(symtab->program);
-  freeObjectList(symtab->globalObjectList);
   free(symtab);
-  freeType(intType);
-  freeType(charType);
+  freeObjectPool();
+  freeTypeTable();
 }
 
 void enterBlock(Scope* scope) {
@@ -314,21 +360,37 @@ void exitBlock(void) {
 }
 
 void declareObject(Object* obj) {
-  if (obj->kind == OBJ_PARAMETER) {
-    Object* owner = symtab->currentScope->owner;
-    switch (owner->kind) {
+  Scope* scope = symtab->currentScope;
+
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    /* Storage is allocated once, at declaration */
+    obj->varAttrs->localOffset = scope->frameSize;
+    obj->varAttrs->level = scope->level;
+    scope->frameSize += sizeOfType(obj->varAttrs->type);
+    break;
+  case OBJ_PARAMETER:
+    /* A VAR parameter holds the address of its argument, one word either way */
+    obj->paramAttrs->localOffset = scope->frameSize;
+    obj->paramAttrs->level = scope->level;
+    scope->frameSize ++;
+
+    switch (scope->owner->kind) {
     case OBJ_FUNCTION:
-      addObject(&(owner->funcAttrs->paramList), obj);
+      addObject(&(scope->owner->funcAttrs->paramList), obj);
+      scope->owner->funcAttrs->paramCount ++;
       break;
     case OBJ_PROCEDURE:
-      addObject(&(owner->procAttrs->paramList), obj);
+      addObject(&(scope->owner->procAttrs->paramList), obj);
+      scope->owner->procAttrs->paramCount ++;
       break;
     default:
       break;
     }
+    break;
+  default:
+    break;
   }
  
-  addObject(&(symtab->currentScope->objList), obj);
+  addObject(&(scope->objList), obj);
 }
-
-
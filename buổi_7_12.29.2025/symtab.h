@@ -9,6 +9,12 @@
 
 #include "token.h"
 
+/* Every frame starts with RESERVED_WORDS words: the function result,
+ * the dynamic link, the return address and the display entry the call
+ * replaced, which the return puts back. Parameters
+ * and local variables are laid out after them, one word per basic value. */
+#define RESERVED_WORDS 4
+
 enum TypeClass {
   TP_INT,
   TP_CHAR,
@@ -30,10 +36,15 @@ enum ParamKind {
   PARAM_REFERENCE
 };
 
+/* Types are hash-consed: structurally equal types share one node, so
+ * two types are equal iff their pointers are equal. Type nodes belong
+ * to the type table and must never be modified or freed by clients. */
 struct Type_ {
   enum TypeClass typeClass;
   int arraySize;
+  int size;                    /* storage size in words */
   struct Type_ *elementType;
+  struct Type_ *next;          /* hash chain in the type table */
 };
 
 typedef struct Type_ Type;
@@ -55,12 +66,14 @@ struct ObjectNode_;
 struct Object_;
 
 struct ConstantAttributes_ {
-  ConstantValue* value;
+  ConstantValue value[1];
 };
 
 struct VariableAttributes_ {
   Type *type;
   struct Scope_ *scope;
+  int localOffset;
+  int level;
 };
 
 struct TypeAttributes_ {
@@ -69,23 +82,30 @@ struct TypeAttributes_ {
 
 struct ProcedureAttributes_ {
   struct ObjectNode_ *paramList;
+  int paramCount;
   struct Scope_* scope;
+  int codeAddress;
 };
 
 struct FunctionAttributes_ {
   struct ObjectNode_ *paramList;
+  int paramCount;
   Type* returnType;
   struct Scope_ *scope;
+  int codeAddress;
 };
 
 struct ProgramAttributes_ {
   struct Scope_ *scope;
+  int codeAddress;
 };
 
 struct ParameterAttributes_ {
   enum ParamKind kind;
   Type* type;
   struct Object_ *function;
+  int localOffset;
+  int level;
 };
 
 typedef struct ConstantAttributes_ ConstantAttributes;
@@ -96,17 +116,20 @@ typedef struct ProcedureAttributes_ ProcedureAttributes;
 typedef struct ProgramAttributes_ ProgramAttributes;
 typedef struct ParameterAttributes_ ParameterAttributes;
 
+/* The kind-specific attributes are stored inline, tagged by kind. Each
+ * member is a one-element array so that the usual obj->varAttrs->type
+ * accessors still work, without a separate allocation behind them. */
 struct Object_ {
-  char name[MAX_IDENT_LEN];
+  char name[MAX_IDENT_LEN + 1];
   enum ObjectKind kind;
   union {
-    ConstantAttributes* constAttrs;
-    VariableAttributes* varAttrs;
-    TypeAttributes* typeAttrs;
-    FunctionAttributes* funcAttrs;
-    ProcedureAttributes* procAttrs;
-    ProgramAttributes* progAttrs;
-    ParameterAttributes* paramAttrs;
+    ConstantAttributes constAttrs[1];
+    VariableAttributes varAttrs[1];
+    TypeAttributes typeAttrs[1];
+    FunctionAttributes funcAttrs[1];
+    ProcedureAttributes procAttrs[1];
+    ProgramAttributes progAttrs[1];
+    ParameterAttributes paramAttrs[1];
   };
 };
 
@@ -123,6 +146,8 @@ struct Scope_ {
   ObjectNode *objList;
   Object *owner;
   struct Scope_ *outer;
+  int frameSize;               /* in words, including RESERVED_WORDS */
+  int level;                   /* nesting level, the program is level 0 */
 };
 
 typedef struct Scope_ Scope;
@@ -135,12 +160,20 @@ struct SymTab_ {
 
 typedef struct SymTab_ SymTab;
 
+extern const Scope builtinScope;
+extern const Object readcFunction;
+extern const Object readiFunction;
+extern const Object writeiProcedure;
+extern const Object writecProcedure;
+extern const Object writelnProcedure;
+
 Type* makeIntType(void);
 Type* makeCharType(void);
 Type* makeArrayType(int arraySize, Type* elementType);
 Type* duplicateType(Type* type);
 int compareType(Type* type1, Type* type2);
-void freeType(Type* type);
+int sizeOfType(Type* type);
+void freeTypeTable(void);
 
 ConstantValue* makeIntConstant(int i);
 ConstantValue* makeCharConstant(char ch);
@@ -0,0 +1,39 @@
+#!/bin/sh
+# The regression tests, run from the directory of kplc by make check.
+# Every tests/NAME.kpl must print tests/NAME.out, runtime errors
+# included, once translated to C and once through LLVM, both at -O2. The lines of tests/NAME.absent,
+# if there is one, are patterns the generated C must not contain.
+
+CC=${CC:-gcc}
+out=tests/out
+failed=0
+
+for test in tests/*.kpl; do
+  name=${test%.kpl}
+  if ! ./kplc $test -c $out.c -O2 > /dev/null ||
+     ! $CC -w -fwrapv -I. $out.c kplrt.c -o $out ||
+     ! ./$out < /dev/null 2>&1 | cmp -s - $name.out; then
+    echo "$test: C output differs"
+    failed=1
+  fi
+  if [ -f $name.absent ]; then
+    while read pattern; do
+      if grep -q "$pattern" $out.c; then
+        echo "$test: the C code contains $pattern"
+        failed=1
+      fi
+    done < $name.absent
+  fi
+  if command -v opt > /dev/null; then
+    if ! ./kplc $test -l $out.ll -O2 > /dev/null ||
+       ! opt -verify -O2 $out.ll -o $out.bc ||
+       ! llc -relocation-model=pic $out.bc -o $out.s ||
+       ! $CC $out.s kplrt.c -o $out ||
+       ! ./$out < /dev/null 2>&1 | cmp -s - $name.out; then
+      echo "$test: LLVM output differs"
+      failed=1
+    fi
+  fi
+done
+rm -f $out $out.c $out.ll $out.bc $out.s
+exit $failed
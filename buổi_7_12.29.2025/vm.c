@@ -0,0 +1,168 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "vm.h"
+#include "kplrt.h"
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED
+#endif
+
+/* A translated instruction */
+typedef struct {
+#ifdef VM_THREADED
+  const void* handler;
+#endif
+  int op;
+  WORD p;
+  WORD q;
+} Thread;
+
+/* A translated register instruction */
+typedef struct {
+#ifdef VM_THREADED
+  const void* handler;
+#endif
+  int op;
+  int p;
+  WORD a;
+  WORD b;
+  WORD c;
+} RegThread;
+
+/* The display entry an instruction uses: the level of the frame LA and
+ * LV address, of the routine CALL enters or of the one EP and EF leave */
+static int displayIndex(CodeBlock* codeBlock, int* owner, CodeAddress pc) {
+  Instruction* inst = &(codeBlock->code[pc]);
+  int level = (owner[pc] >= 0) ? codeBlock->routines[owner[pc]].level : 0;
+
+  switch (inst->op) {
+  case OP_LA:
+  case OP_LV:
+    return (inst->p == PROGRAM_FRAME) ? 0 : level - inst->p;
+  case OP_CALL:
+    return level - inst->p + 1;
+  case OP_EP:
+  case OP_EF:
+    return level;
+  default:
+    return inst->p;
+  }
+}
+
+#define VM_FUNCTION execute
+#define VM_COUNTING 0
+#include "vmloop.h"
+
+#define VM_FUNCTION executeCounting
+#define VM_COUNTING 1
+#include "vmloop.h"
+
+#define VM_FUNCTION executeRegisters
+#define VM_COUNTING 0
+#include "regvmloop.h"
+
+#define VM_FUNCTION executeRegistersCounting
+#define VM_COUNTING 1
+#include "regvmloop.h"
+
+/* Some slack above the stack limit for the words pushed by expressions */
+#define STACK_SLACK 4096
+
+void runCode(CodeBlock* codeBlock, int stackSize) {
+  WORD* s = (WORD*) calloc(stackSize + STACK_SLACK, sizeof(WORD));
+
+  execute(codeBlock, s, stackSize);
+  fflush(stdout);
+  free(s);
+}
+
+double elapsedSeconds(struct timespec* start, struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+void printBenchmark(char* tier, long count, double seconds, unsigned long long cycles) {
+#ifdef VM_THREADED
+  fprintf(stderr, "dispatch:      threaded, %s\n", tier);
+#else
+  fprintf(stderr, "dispatch:      switch, %s\n", tier);
+#endif
+  fprintf(stderr, "instructions:  %ld\n", count);
+  fprintf(stderr, "time:          %.6f s\n", seconds);
+  if (count > 0) {
+    fprintf(stderr, "ns/instr:      %.3f\n", seconds * 1e9 / count);
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(stderr, "cycles/instr:  %.3f\n", (double) cycles / count);
+#endif
+  }
+}
+
+unsigned long long readCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* Runs the program twice: once silently, counting executed instructions,
+ * and once timed at full speed. Meant for programs that read no input. */
+void benchmarkCode(CodeBlock* codeBlock, int stackSize) {
+  WORD* s = (WORD*) calloc(stackSize + STACK_SLACK, sizeof(WORD));
+  struct timespec start, end;
+  unsigned long long cycles;
+  long count;
+
+  kplSilent = 1;
+  count = executeCounting(codeBlock, s, stackSize);
+  kplSilent = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  cycles = readCycles();
+  execute(codeBlock, s, stackSize);
+  cycles = readCycles() - cycles;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fflush(stdout);
+
+  printBenchmark("stack", count, elapsedSeconds(&start, &end), cycles);
+  free(s);
+}
+
+void runRegCode(RegCodeBlock* regCode, int stackSize) {
+  WORD* s = (WORD*) calloc(stackSize + STACK_SLACK, sizeof(WORD));
+
+  executeRegisters(regCode, s, stackSize);
+  fflush(stdout);
+  free(s);
+}
+
+void benchmarkRegCode(RegCodeBlock* regCode, int stackSize) {
+  WORD* s = (WORD*) calloc(stackSize + STACK_SLACK, sizeof(WORD));
+  struct timespec start, end;
+  unsigned long long cycles;
+  long count;
+
+  kplSilent = 1;
+  count = executeRegistersCounting(regCode, s, stackSize);
+  kplSilent = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  cycles = readCycles();
+  executeRegisters(regCode, s, stackSize);
+  cycles = readCycles() - cycles;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fflush(stdout);
+
+  printBenchmark("registers", count, elapsedSeconds(&start, &end), cycles);
+  free(s);
+}
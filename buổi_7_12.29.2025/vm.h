@@ -0,0 +1,30 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VM_H__
+#define __VM_H__
+
+#include <time.h>
+#include "instructions.h"
+#include "regcode.h"
+
+#define DEFAULT_STACK_SIZE (1 << 22)
+
+/* The virtual machine translates a code block into threaded code: each
+ * instruction becomes the address of its handler plus its operands, and
+ * handlers jump straight to the next one (GCC computed goto). Compilers
+ * without computed goto, or builds with -DVM_SWITCH_DISPATCH, dispatch
+ * with a switch instead. The register machine of regcode.h runs the
+ * same way, on frames laid out like those of the stack machine. */
+
+void runCode(CodeBlock* codeBlock, int stackSize);
+void benchmarkCode(CodeBlock* codeBlock, int stackSize);
+double elapsedSeconds(struct timespec* start, struct timespec* end);
+
+void runRegCode(RegCodeBlock* regCode, int stackSize);
+void benchmarkRegCode(RegCodeBlock* regCode, int stackSize);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+/* The interpreter loop. vm.c includes this file once for every variant
+ * it needs, with VM_FUNCTION naming the function and VM_COUNTING telling
+ * whether executed instructions are counted. */
+
+#if VM_COUNTING
+#define VM_COUNT count++
+#else
+#define VM_COUNT
+#endif
+
+#ifdef VM_THREADED
+#define HANDLER(op) L_##op:
+#define DISPATCH do { VM_COUNT; goto *(pc->handler); } while (0)
+#else
+#define HANDLER(op) case op:
+#define DISPATCH continue
+#endif
+
+long VM_FUNCTION(CodeBlock* codeBlock, WORD* s, int stackSize) {
+  Thread* code;
+  Thread* pc;
+  WORD* display = (WORD*) calloc(displaySize(codeBlock->routines, codeBlock->routineCount), sizeof(WORD));
+  int* owner = mapRoutines(codeBlock);
+  WORD t = -1;
+  WORD b = 0;
+  WORD x;
+  long count = 0;
+  int i;
+
+#ifdef VM_THREADED
+  static const void* handlers[NUM_OF_OPCODES] = {
+    &&L_OP_LA, &&L_OP_LV, &&L_OP_LC, &&L_OP_LI, &&L_OP_INT, &&L_OP_DCT,
+    &&L_OP_J, &&L_OP_FJ, &&L_OP_HL, &&L_OP_ST, &&L_OP_CALL, &&L_OP_EP,
+    &&L_OP_EF, &&L_OP_RC, &&L_OP_RI, &&L_OP_WRC, &&L_OP_WRI, &&L_OP_WLN,
+    &&L_OP_AD, &&L_OP_SB, &&L_OP_ML, &&L_OP_DV, &&L_OP_NEG, &&L_OP_CV,
+    &&L_OP_EQ, &&L_OP_NE, &&L_OP_GT, &&L_OP_LT, &&L_OP_GE, &&L_OP_LE,
+    &&L_OP_CK
+  };
+#endif
+
+  // Pre-translate the code into threaded code, with display entries for p
+  code = (Thread*) malloc((codeBlock->codeSize + 1) * sizeof(Thread));
+  for (i = 0; i < codeBlock->codeSize; i++) {
+    code[i].op = codeBlock->code[i].op;
+    code[i].p = displayIndex(codeBlock, owner, i);
+    code[i].q = codeBlock->code[i].q;
+#ifdef VM_THREADED
+    code[i].handler = handlers[code[i].op];
+#endif
+  }
+  // Running off the end of the code halts
+  code[i].op = OP_HL;
+#ifdef VM_THREADED
+  code[i].handler = handlers[OP_HL];
+#endif
+  free(owner);
+
+  pc = code;
+
+#ifdef VM_THREADED
+  DISPATCH;
+  {
+#else
+  for (;;) {
+    VM_COUNT;
+    switch (pc->op) {
+#endif
+
+    HANDLER(OP_LA)
+      s[++t] = display[pc->p] + pc->q;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_LV)
+      s[t + 1] = s[display[pc->p] + pc->q];
+      t++;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_LC)
+      s[++t] = pc->q;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_LI)
+      s[t] = s[s[t]];
+      pc++;
+      DISPATCH;
+    HANDLER(OP_INT)
+      t += pc->q;
+      if (t >= stackSize)
+        kplStackOverflow();
+      pc++;
+      DISPATCH;
+    HANDLER(OP_DCT)
+      t -= pc->q;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_J)
+      pc = code + pc->q;
+      DISPATCH;
+    HANDLER(OP_FJ)
+      if (s[t--] == 0)
+        pc = code + pc->q;
+      else pc++;
+      DISPATCH;
+    HANDLER(OP_HL)
+      goto halt;
+    HANDLER(OP_ST)
+      s[s[t - 1]] = s[t];
+      t -= 2;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_CALL)
+      s[t + 2] = b;
+      s[t + 3] = (pc - code) + 1;
+      s[t + 4] = display[pc->p];
+      b = t + 1;
+      display[pc->p] = b;
+      pc = code + pc->q;
+      DISPATCH;
+    HANDLER(OP_EP)
+      display[pc->p] = s[b + 3];
+      t = b - 1;
+      pc = code + s[b + 2];
+      b = s[b + 1];
+      DISPATCH;
+    HANDLER(OP_EF)
+      display[pc->p] = s[b + 3];
+      t = b;
+      pc = code + s[b + 2];
+      b = s[b + 1];
+      DISPATCH;
+    HANDLER(OP_RC)
+      s[++t] = kplReadChar();
+      pc++;
+      DISPATCH;
+    HANDLER(OP_RI)
+      s[++t] = kplReadInt();
+      pc++;
+      DISPATCH;
+    HANDLER(OP_WRC)
+      kplWriteChar(s[t--]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_WRI)
+      kplWriteInt(s[t--]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_WLN)
+      kplWriteLn();
+      pc++;
+      DISPATCH;
+    HANDLER(OP_AD)
+      t--;
+      s[t] = (WORD) ((unsigned) s[t] + (unsigned) s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_SB)
+      t--;
+      s[t] = (WORD) ((unsigned) s[t] - (unsigned) s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_ML)
+      t--;
+      s[t] = (WORD) ((unsigned) s[t] * (unsigned) s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_DV)
+      t--;
+      x = s[t + 1];
+      if (x == 0)
+        kplDivisionByZero();
+      s[t] = (x == -1) ? (WORD) (0u - (unsigned) s[t]) : s[t] / x;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_NEG)
+      s[t] = (WORD) (0u - (unsigned) s[t]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_CV)
+      s[t + 1] = s[t];
+      t++;
+      pc++;
+      DISPATCH;
+    HANDLER(OP_EQ)
+      t--;
+      s[t] = (s[t] == s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_NE)
+      t--;
+      s[t] = (s[t] != s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_GT)
+      t--;
+      s[t] = (s[t] > s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_LT)
+      t--;
+      s[t] = (s[t] < s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_GE)
+      t--;
+      s[t] = (s[t] >= s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_LE)
+      t--;
+      s[t] = (s[t] <= s[t + 1]);
+      pc++;
+      DISPATCH;
+    HANDLER(OP_CK)
+      if ((unsigned) s[t] >= (unsigned) pc->q)
+        kplIndexOutOfRange();
+      pc++;
+      DISPATCH;
+
+#ifndef VM_THREADED
+    }
+#endif
+  }
+
+ halt:
+  free(display);
+  free(code);
+  return count;
+}
+
+#undef VM_COUNT
+#undef HANDLER
+#undef DISPATCH
+#undef VM_FUNCTION
+#undef VM_COUNTING
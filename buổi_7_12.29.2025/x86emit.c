@@ -0,0 +1,475 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "x86emit.h"
+
+char* regNames64[16] = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+char* regNames32[16] = {
+  "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+  "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+
+char* regNames8[16] = {
+  "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+  "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+char* condNames[16] = {
+  "o", "no", "b", "ae", "e", "ne", "be", "a",
+  "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+char* aluNames[] = { "add", "sub", "and", "cmp", "mov" };
+char* unaryNames[] = { "neg", "not", "imul", "idiv" };
+char* shiftNames[] = { "shl", "shr", "sar" };
+
+int aluDigits[] = { 0, 5, 4, 7 };
+int unaryDigits[] = { 3, 2, 5, 7 };
+int shiftDigits[] = { 4, 5, 7 };
+
+#define INITIAL_MACHINE_CODE_SIZE 4096
+
+X86Emitter* createEmitter(FILE* out) {
+  X86Emitter* e = (X86Emitter*) malloc(sizeof(X86Emitter));
+  e->out = out;
+  e->labelCount = 0;
+  e->code = NULL;
+  e->size = 0;
+  e->maxSize = 0;
+  e->labelOffsets = NULL;
+  e->maxLabels = 0;
+  e->fixups = NULL;
+  e->fixupCount = 0;
+  e->maxFixups = 0;
+  return e;
+}
+
+X86Emitter* createTextEmitter(FILE* out) {
+  return createEmitter(out);
+}
+
+X86Emitter* createBinaryEmitter(void) {
+  X86Emitter* e = createEmitter(NULL);
+  e->maxSize = INITIAL_MACHINE_CODE_SIZE;
+  e->code = (unsigned char*) malloc(e->maxSize);
+  return e;
+}
+
+void freeEmitter(X86Emitter* e) {
+  free(e->code);
+  free(e->labelOffsets);
+  free(e->fixups);
+  free(e);
+}
+
+/******************* Operands ******************************/
+
+X86Operand x86Reg(X86Reg reg) {
+  X86Operand operand;
+  operand.kind = X86_REG;
+  operand.reg = reg;
+  operand.index = NO_REG;
+  operand.scale = 1;
+  operand.disp = 0;
+  return operand;
+}
+
+X86Operand x86Mem(X86Reg base, int disp) {
+  return x86MemIndex(base, NO_REG, 1, disp);
+}
+
+X86Operand x86MemIndex(X86Reg base, X86Reg index, int scale, int disp) {
+  X86Operand operand;
+  operand.kind = X86_MEM;
+  operand.reg = base;
+  operand.index = index;
+  operand.scale = scale;
+  operand.disp = disp;
+  return operand;
+}
+
+X86Operand x86Imm(int value) {
+  X86Operand operand;
+  operand.kind = X86_IMM;
+  operand.reg = NO_REG;
+  operand.index = NO_REG;
+  operand.scale = 1;
+  operand.disp = value;
+  return operand;
+}
+
+char sizeSuffix(int size) {
+  return size == 8 ? 'q' : 'l';
+}
+
+char* regName(X86Reg reg, int size) {
+  switch (size) {
+  case 1: return regNames8[reg];
+  case 4: return regNames32[reg];
+  default: return regNames64[reg];
+  }
+}
+
+void printOperand(X86Emitter* e, X86Operand operand, int size) {
+  switch (operand.kind) {
+  case X86_REG:
+    fprintf(e->out, "%%%s", regName(operand.reg, size));
+    break;
+  case X86_IMM:
+    fprintf(e->out, "$%d", operand.disp);
+    break;
+  case X86_MEM:
+    if (operand.disp != 0)
+      fprintf(e->out, "%d", operand.disp);
+    fprintf(e->out, "(%%%s", regNames64[operand.reg]);
+    if (operand.index != NO_REG)
+      fprintf(e->out, ",%%%s,%d", regNames64[operand.index], operand.scale);
+    fprintf(e->out, ")");
+    break;
+  }
+}
+
+/******************* Encoding ******************************/
+
+void emitByte(X86Emitter* e, int byte) {
+  if (e->size == e->maxSize) {
+    e->maxSize *= 2;
+    e->code = (unsigned char*) realloc(e->code, e->maxSize);
+  }
+  e->code[e->size++] = (unsigned char) byte;
+}
+
+void emitInt32(X86Emitter* e, int value) {
+  emitByte(e, value);
+  emitByte(e, value >> 8);
+  emitByte(e, value >> 16);
+  emitByte(e, value >> 24);
+}
+
+int isInt8(int value) {
+  return value >= -128 && value <= 127;
+}
+
+/* The REX prefix for a reg field and an r/m operand. Byte registers
+ * above bl need it too. */
+void emitRex(X86Emitter* e, int size, int reg, X86Operand rm) {
+  int rex = 0x40;
+
+  if (size == 8) rex |= 0x08;
+  if (reg >= 8) rex |= 0x04;
+  if (rm.kind == X86_MEM && rm.index != NO_REG && rm.index >= 8) rex |= 0x02;
+  if (rm.reg >= 8) rex |= 0x01;
+  if (rex != 0x40 || (size == 1 && (reg >= 4 || (rm.kind == X86_REG && rm.reg >= 4))))
+    emitByte(e, rex);
+}
+
+void emitModRM(X86Emitter* e, int reg, X86Operand rm) {
+  int base, mod, scale;
+
+  reg &= 7;
+  if (rm.kind == X86_REG) {
+    emitByte(e, 0xC0 | (reg << 3) | (rm.reg & 7));
+    return;
+  }
+
+  base = rm.reg & 7;
+  // rbp and r13 have no form without a displacement
+  if (rm.disp == 0 && base != RBP) mod = 0x00;
+  else if (isInt8(rm.disp)) mod = 0x40;
+  else mod = 0x80;
+
+  if (rm.index == NO_REG && base != RSP)
+    emitByte(e, mod | (reg << 3) | base);
+  else {
+    scale = (rm.scale == 8) ? 3 : (rm.scale == 4) ? 2 : (rm.scale == 2) ? 1 : 0;
+    emitByte(e, mod | (reg << 3) | RSP);
+    emitByte(e, (scale << 6) | (((rm.index == NO_REG) ? RSP : rm.index) & 7) << 3 | base);
+  }
+
+  if (mod == 0x40) emitByte(e, rm.disp);
+  else if (mod == 0x80) emitInt32(e, rm.disp);
+}
+
+/* An instruction with a one-byte opcode and a ModRM operand */
+void emitOp(X86Emitter* e, int size, int opcode, int reg, X86Operand rm) {
+  emitRex(e, size, reg, rm);
+  emitByte(e, opcode);
+  emitModRM(e, reg, rm);
+}
+
+/* The same with a two-byte opcode 0F xx */
+void emitOp2(X86Emitter* e, int size, int opcode, int reg, X86Operand rm) {
+  emitRex(e, size, reg, rm);
+  emitByte(e, 0x0F);
+  emitByte(e, opcode);
+  emitModRM(e, reg, rm);
+}
+
+void emitRel32(X86Emitter* e, X86Label label) {
+  if (e->fixupCount == e->maxFixups) {
+    e->maxFixups = e->maxFixups ? e->maxFixups * 2 : 256;
+    e->fixups = (X86Fixup*) realloc(e->fixups, e->maxFixups * sizeof(X86Fixup));
+  }
+  e->fixups[e->fixupCount].offset = e->size;
+  e->fixups[e->fixupCount].label = label;
+  e->fixupCount++;
+  emitInt32(e, 0);
+}
+
+void x86ResolveLabels(X86Emitter* e) {
+  X86Fixup* fixup;
+  int i, rel;
+
+  for (i = 0; i < e->fixupCount; i++) {
+    fixup = &(e->fixups[i]);
+    rel = e->labelOffsets[fixup->label] - (fixup->offset + 4);
+    e->code[fixup->offset] = rel;
+    e->code[fixup->offset + 1] = rel >> 8;
+    e->code[fixup->offset + 2] = rel >> 16;
+    e->code[fixup->offset + 3] = rel >> 24;
+  }
+}
+
+/******************* Labels ******************************/
+
+X86Label x86NewLabel(X86Emitter* e) {
+  if (e->out == NULL && e->labelCount == e->maxLabels) {
+    e->maxLabels = e->maxLabels ? e->maxLabels * 2 : 256;
+    e->labelOffsets = (int*) realloc(e->labelOffsets, e->maxLabels * sizeof(int));
+  }
+  return e->labelCount++;
+}
+
+void x86PlaceLabel(X86Emitter* e, X86Label label) {
+  if (e->out == NULL)
+    e->labelOffsets[label] = e->size;
+  else fprintf(e->out, ".L%d:\n", label);
+}
+
+void x86Directive(X86Emitter* e, char* text) {
+  if (e->out != NULL)
+    fprintf(e->out, "%s\n", text);
+}
+
+/******************* Instructions ******************************/
+
+void x86Alu(X86Emitter* e, X86AluOp op, int size, X86Operand dst, X86Operand src) {
+  int digit;
+
+  if (e->out != NULL) {
+    fprintf(e->out, "\t%s%c\t", aluNames[op], sizeSuffix(size));
+    printOperand(e, src, size);
+    fprintf(e->out, ", ");
+    printOperand(e, dst, size);
+    fprintf(e->out, "\n");
+    return;
+  }
+
+  if (op == X86_MOV) {
+    if (src.kind == X86_IMM) {
+      emitOp(e, size, 0xC7, 0, dst);
+      emitInt32(e, src.disp);
+    } else if (src.kind == X86_REG)
+      emitOp(e, size, 0x89, src.reg, dst);
+    else emitOp(e, size, 0x8B, dst.reg, src);
+    return;
+  }
+
+  digit = aluDigits[op];
+  if (src.kind == X86_IMM) {
+    if (isInt8(src.disp)) {
+      emitOp(e, size, 0x83, digit, dst);
+      emitByte(e, src.disp);
+    } else {
+      emitOp(e, size, 0x81, digit, dst);
+      emitInt32(e, src.disp);
+    }
+  } else if (src.kind == X86_REG)
+    emitOp(e, size, digit * 8 + 1, src.reg, dst);
+  else emitOp(e, size, digit * 8 + 3, dst.reg, src);
+}
+
+void x86Unary(X86Emitter* e, X86UnaryOp op, int size, X86Operand operand) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\t%s%c\t", unaryNames[op], sizeSuffix(size));
+    printOperand(e, operand, size);
+    fprintf(e->out, "\n");
+    return;
+  }
+  emitOp(e, size, 0xF7, unaryDigits[op], operand);
+}
+
+void x86Shift(X86Emitter* e, X86ShiftOp op, int size, X86Operand operand, int count) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\t%s%c\t$%d, ", shiftNames[op], sizeSuffix(size), count);
+    printOperand(e, operand, size);
+    fprintf(e->out, "\n");
+    return;
+  }
+  emitOp(e, size, 0xC1, shiftDigits[op], operand);
+  emitByte(e, count);
+}
+
+void x86Test(X86Emitter* e, int size, X86Operand dst, X86Reg src) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\ttest%c\t%%%s, ", sizeSuffix(size), regName(src, size));
+    printOperand(e, dst, size);
+    fprintf(e->out, "\n");
+    return;
+  }
+  emitOp(e, size, 0x85, src, dst);
+}
+
+void x86Lea(X86Emitter* e, X86Reg dst, X86Operand mem) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tleaq\t");
+    printOperand(e, mem, 8);
+    fprintf(e->out, ", %%%s\n", regNames64[dst]);
+    return;
+  }
+  emitOp(e, 8, 0x8D, dst, mem);
+}
+
+void x86Imul(X86Emitter* e, int size, X86Reg dst, X86Operand src) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\timul%c\t", sizeSuffix(size));
+    printOperand(e, src, size);
+    fprintf(e->out, ", %%%s\n", regName(dst, size));
+    return;
+  }
+  emitOp2(e, size, 0xAF, dst, src);
+}
+
+void x86ImulImm(X86Emitter* e, int size, X86Reg dst, X86Operand src, int value) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\timul%c\t$%d, ", sizeSuffix(size), value);
+    printOperand(e, src, size);
+    fprintf(e->out, ", %%%s\n", regName(dst, size));
+    return;
+  }
+  if (isInt8(value)) {
+    emitOp(e, size, 0x6B, dst, src);
+    emitByte(e, value);
+  } else {
+    emitOp(e, size, 0x69, dst, src);
+    emitInt32(e, value);
+  }
+}
+
+void x86MovImm64(X86Emitter* e, X86Reg dst, long value) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tmovabsq\t$%ld, %%%s\n", value, regNames64[dst]);
+    return;
+  }
+  emitByte(e, 0x48 | (dst >= 8 ? 0x01 : 0));
+  emitByte(e, 0xB8 + (dst & 7));
+  emitInt32(e, (int) value);
+  emitInt32(e, (int) (value >> 32));
+}
+
+void x86Movsxd(X86Emitter* e, X86Reg dst, X86Operand src) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tmovslq\t");
+    printOperand(e, src, 4);
+    fprintf(e->out, ", %%%s\n", regNames64[dst]);
+    return;
+  }
+  emitOp(e, 8, 0x63, dst, src);
+}
+
+void x86Cdq(X86Emitter* e) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tcltd\n");
+    return;
+  }
+  emitByte(e, 0x99);
+}
+
+void x86Setcc(X86Emitter* e, X86Cond cond, X86Reg dst) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tset%s\t%%%s\n", condNames[cond], regNames8[dst]);
+    return;
+  }
+  emitOp2(e, 1, 0x90 + cond, 0, x86Reg(dst));
+}
+
+void x86Movzx8(X86Emitter* e, X86Reg dst, X86Reg src) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tmovzbl\t%%%s, %%%s\n", regNames8[src], regNames32[dst]);
+    return;
+  }
+  emitOp2(e, 1, 0xB6, dst, x86Reg(src));
+}
+
+void x86Push(X86Emitter* e, X86Reg reg) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tpushq\t%%%s\n", regNames64[reg]);
+    return;
+  }
+  if (reg >= 8) emitByte(e, 0x41);
+  emitByte(e, 0x50 + (reg & 7));
+}
+
+void x86Pop(X86Emitter* e, X86Reg reg) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tpopq\t%%%s\n", regNames64[reg]);
+    return;
+  }
+  if (reg >= 8) emitByte(e, 0x41);
+  emitByte(e, 0x58 + (reg & 7));
+}
+
+void x86Jmp(X86Emitter* e, X86Label label) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tjmp\t.L%d\n", label);
+    return;
+  }
+  emitByte(e, 0xE9);
+  emitRel32(e, label);
+}
+
+void x86Jcc(X86Emitter* e, X86Cond cond, X86Label label) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tj%s\t.L%d\n", condNames[cond], label);
+    return;
+  }
+  emitByte(e, 0x0F);
+  emitByte(e, 0x80 + cond);
+  emitRel32(e, label);
+}
+
+void x86Call(X86Emitter* e, X86Label label) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tcall\t.L%d\n", label);
+    return;
+  }
+  emitByte(e, 0xE8);
+  emitRel32(e, label);
+}
+
+/* Machine code calls the function at its address through r11 */
+void x86CallExternal(X86Emitter* e, char* name, void* address) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tcall\t%s@PLT\n", name);
+    return;
+  }
+  x86MovImm64(e, R11, (long) address);
+  emitOp(e, 4, 0xFF, 2, x86Reg(R11));
+}
+
+void x86Ret(X86Emitter* e) {
+  if (e->out != NULL) {
+    fprintf(e->out, "\tret\n");
+    return;
+  }
+  emitByte(e, 0xC3);
+}
@@ -0,0 +1,114 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __X86EMIT_H__
+#define __X86EMIT_H__
+
+#include <stdio.h>
+
+/* A small x86-64 assembler for the native backends. The code generator
+ * describes each instruction with operands built by x86Reg(), x86Mem()
+ * and x86Imm(); a text emitter writes it as GNU as source (AT&T syntax),
+ * a binary emitter encodes it into a code buffer for the JIT. */
+
+typedef enum {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+  NO_REG = -1
+} X86Reg;
+
+typedef enum {
+  X86_REG,
+  X86_MEM,       // disp(base, index, scale)
+  X86_IMM
+} X86OperandKind;
+
+typedef struct {
+  X86OperandKind kind;
+  X86Reg reg;            // the register, or the base of a memory operand
+  X86Reg index;
+  int scale;
+  int disp;              // displacement or immediate
+} X86Operand;
+
+typedef enum {
+  X86_ADD, X86_SUB, X86_AND, X86_CMP, X86_MOV
+} X86AluOp;
+
+typedef enum {
+  X86_NEG, X86_NOT, X86_IMUL1, X86_IDIV
+} X86UnaryOp;
+
+typedef enum {
+  X86_SHL, X86_SHR, X86_SAR
+} X86ShiftOp;
+
+/* Condition codes, numbered as in the encodings */
+typedef enum {
+  CC_O = 0x0, CC_NO = 0x1, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5,
+  CC_BE = 0x6, CC_A = 0x7, CC_S = 0x8, CC_NS = 0x9,
+  CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+} X86Cond;
+
+typedef struct {
+  int offset;            // of a rel32 field
+  int label;
+} X86Fixup;
+
+typedef struct {
+  FILE* out;             // text output, or NULL for machine code
+  int labelCount;
+  // Machine code
+  unsigned char* code;
+  int size;
+  int maxSize;
+  int* labelOffsets;
+  int maxLabels;
+  X86Fixup* fixups;
+  int fixupCount;
+  int maxFixups;
+} X86Emitter;
+
+typedef int X86Label;
+
+X86Emitter* createTextEmitter(FILE* out);
+X86Emitter* createBinaryEmitter(void);
+void freeEmitter(X86Emitter* e);
+
+/* Fills in the jumps and calls to labels of a binary emitter */
+void x86ResolveLabels(X86Emitter* e);
+
+X86Operand x86Reg(X86Reg reg);
+X86Operand x86Mem(X86Reg base, int disp);
+X86Operand x86MemIndex(X86Reg base, X86Reg index, int scale, int disp);
+X86Operand x86Imm(int value);
+
+X86Label x86NewLabel(X86Emitter* e);
+void x86PlaceLabel(X86Emitter* e, X86Label label);
+void x86Directive(X86Emitter* e, char* text);
+
+/* size is 4 or 8 bytes */
+void x86Alu(X86Emitter* e, X86AluOp op, int size, X86Operand dst, X86Operand src);
+void x86Unary(X86Emitter* e, X86UnaryOp op, int size, X86Operand operand);
+void x86Shift(X86Emitter* e, X86ShiftOp op, int size, X86Operand operand, int count);
+void x86Test(X86Emitter* e, int size, X86Operand dst, X86Reg src);
+void x86Lea(X86Emitter* e, X86Reg dst, X86Operand mem);
+void x86Imul(X86Emitter* e, int size, X86Reg dst, X86Operand src);
+void x86ImulImm(X86Emitter* e, int size, X86Reg dst, X86Operand src, int value);
+void x86MovImm64(X86Emitter* e, X86Reg dst, long value);
+void x86Movsxd(X86Emitter* e, X86Reg dst, X86Operand src);
+void x86Cdq(X86Emitter* e);
+void x86Setcc(X86Emitter* e, X86Cond cond, X86Reg dst);
+void x86Movzx8(X86Emitter* e, X86Reg dst, X86Reg src);
+void x86Push(X86Emitter* e, X86Reg reg);
+void x86Pop(X86Emitter* e, X86Reg reg);
+void x86Jmp(X86Emitter* e, X86Label label);
+void x86Jcc(X86Emitter* e, X86Cond cond, X86Label label);
+void x86Call(X86Emitter* e, X86Label label);
+void x86CallExternal(X86Emitter* e, char* name, void* address);
+void x86Ret(X86Emitter* e);
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "reader.h"
+#include "x86gen.h"
+#include "kplrt.h"
+
+#define FRAME R12
+#define STACK R13
+#define LIMIT R14
+
+X86Emitter* emitter;
+X86Label* labels;            // one label per register instruction
+X86Label haltLabel;
+X86Label divisionLabel;
+X86Label indexLabel;
+X86Label overflowLabel;
+
+X86Operand slot(WORD reg) {
+  return x86Mem(FRAME, reg * (int) sizeof(WORD));
+}
+
+/* Condition codes of RO_EQ .. RO_LE */
+X86Cond comparisonCond(int cmp) {
+  static const X86Cond conds[] = { CC_E, CC_NE, CC_G, CC_L, CC_GE, CC_LE };
+  return conds[cmp];
+}
+
+/* The display entry of nesting level p, just below the KPL stack */
+X86Operand displayEntry(int p) {
+  return x86Mem(STACK, -(p + 1) * (int) sizeof(WORD));
+}
+
+/* Word b of the frame at nesting level p; the program frame sits at the
+ * bottom of the stack, the others are found through eax */
+X86Operand frameWord(int p, WORD b) {
+  if (p == 0)
+    return x86Mem(STACK, b * sizeof(WORD));
+  x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), displayEntry(p));
+  return x86MemIndex(STACK, RAX, sizeof(WORD), b * sizeof(WORD));
+}
+
+/* Leaves in eax the index of the current frame */
+void genFrameIndex(void) {
+  x86Alu(emitter, X86_MOV, 8, x86Reg(RAX), x86Reg(FRAME));
+  x86Alu(emitter, X86_SUB, 8, x86Reg(RAX), x86Reg(STACK));
+  x86Shift(emitter, X86_SHR, 8, x86Reg(RAX), 2);
+}
+
+void genLoad(X86Reg dst, WORD reg) {
+  x86Alu(emitter, X86_MOV, 4, x86Reg(dst), slot(reg));
+}
+
+void genStore(WORD reg, X86Reg src) {
+  x86Alu(emitter, X86_MOV, 4, slot(reg), x86Reg(src));
+}
+
+void genArithmetic(X86AluOp op, RegInstruction* inst, X86Operand src) {
+  genLoad(RAX, inst->b);
+  x86Alu(emitter, op, 4, x86Reg(RAX), src);
+  genStore(inst->a, RAX);
+}
+
+void genDivision(RegInstruction* inst) {
+  X86Label notMinusOne = x86NewLabel(emitter);
+  X86Label done = x86NewLabel(emitter);
+
+  genLoad(RAX, inst->b);
+  genLoad(RCX, inst->c);
+  x86Test(emitter, 4, x86Reg(RCX), RCX);
+  x86Jcc(emitter, CC_E, divisionLabel);
+  // INT_MIN / -1 traps in idiv, the VM wraps
+  x86Alu(emitter, X86_CMP, 4, x86Reg(RCX), x86Imm(-1));
+  x86Jcc(emitter, CC_NE, notMinusOne);
+  x86Unary(emitter, X86_NEG, 4, x86Reg(RAX));
+  x86Jmp(emitter, done);
+  x86PlaceLabel(emitter, notMinusOne);
+  x86Cdq(emitter);
+  x86Unary(emitter, X86_IDIV, 4, x86Reg(RCX));
+  x86PlaceLabel(emitter, done);
+  genStore(inst->a, RAX);
+}
+
+/* The magic number and shift of a signed division by d, |d| >= 2
+ * (Warren, Hacker's Delight, 10-1): n / d is the high word of n * magic,
+ * corrected by n when the signs of d and magic differ, shifted right
+ * and rounded towards zero */
+void computeMagic(WORD d, WORD* magic, int* shift) {
+  const unsigned two31 = 0x80000000u;
+  unsigned ad = (d < 0) ? 0u - (unsigned) d : (unsigned) d;
+  unsigned t = two31 + ((unsigned) d >> 31);
+  unsigned anc = t - 1 - t % ad;
+  unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+  unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+  unsigned delta;
+  int p = 31;
+
+  do {
+    p++;
+    q1 = 2 * q1;
+    r1 = 2 * r1;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 = 2 * q2;
+    r2 = 2 * r2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+
+  *magic = (WORD) (q2 + 1);
+  if (d < 0)
+    *magic = - *magic;
+  *shift = p - 32;
+}
+
+/* A division by a constant other than 0 and -1 needs no idiv: it
+ * multiplies by the magic number of the divisor. A remainder
+ * a - (a / c) * c then costs a multiply more. */
+void genConstantDivision(RegInstruction* inst) {
+  WORD magic;
+  int shift;
+
+  if (inst->c == 1) {
+    genLoad(RAX, inst->b);
+    genStore(inst->a, RAX);
+    return;
+  }
+  computeMagic(inst->c, &magic, &shift);
+
+  x86Movsxd(emitter, RAX, slot(inst->b));
+  x86ImulImm(emitter, 8, RAX, x86Reg(RAX), magic);
+  if ((inst->c > 0 && magic < 0) || (inst->c < 0 && magic > 0)) {
+    x86Shift(emitter, X86_SAR, 8, x86Reg(RAX), 32);
+    x86Alu(emitter, inst->c > 0 ? X86_ADD : X86_SUB, 4, x86Reg(RAX), slot(inst->b));
+    if (shift > 0)
+      x86Shift(emitter, X86_SAR, 4, x86Reg(RAX), shift);
+  } else x86Shift(emitter, X86_SAR, 8, x86Reg(RAX), 32 + shift);
+  // Add 1 to a negative quotient
+  x86Alu(emitter, X86_MOV, 4, x86Reg(RCX), x86Reg(RAX));
+  x86Shift(emitter, X86_SHR, 4, x86Reg(RCX), 31);
+  x86Alu(emitter, X86_ADD, 4, x86Reg(RAX), x86Reg(RCX));
+  genStore(inst->a, RAX);
+}
+
+void genComparison(RegInstruction* inst) {
+  genLoad(RAX, inst->b);
+  x86Alu(emitter, X86_CMP, 4, x86Reg(RAX), slot(inst->c));
+  x86Setcc(emitter, comparisonCond(inst->op - RO_EQ), RAX);
+  x86Movzx8(emitter, RAX, RAX);
+  genStore(inst->a, RAX);
+}
+
+/* The new frame saves the display entry of the callee's level and
+ * takes its place */
+void genCall(RegInstruction* inst) {
+  int offset = inst->a * sizeof(WORD);
+
+  x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), displayEntry(inst->p));
+  x86Alu(emitter, X86_MOV, 4, x86Mem(FRAME, offset + 3 * sizeof(WORD)), x86Reg(RAX));
+  x86Alu(emitter, X86_ADD, 8, x86Reg(FRAME), x86Imm(offset));
+  genFrameIndex();
+  x86Alu(emitter, X86_MOV, 4, displayEntry(inst->p), x86Reg(RAX));
+  x86Call(emitter, labels[inst->c]);
+  x86Alu(emitter, X86_SUB, 8, x86Reg(FRAME), x86Imm(offset));
+}
+
+void genInstruction(RegInstruction* inst) {
+  switch (inst->op) {
+  case RO_MOV:
+    genLoad(RAX, inst->b);
+    genStore(inst->a, RAX);
+    break;
+  case RO_MOVI:
+    x86Alu(emitter, X86_MOV, 4, slot(inst->a), x86Imm(inst->b));
+    break;
+  case RO_LDA:
+    if (inst->p == 0)
+      x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), x86Imm(inst->b));
+    else {
+      x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), displayEntry(inst->p));
+      x86Alu(emitter, X86_ADD, 4, x86Reg(RAX), x86Imm(inst->b));
+    }
+    genStore(inst->a, RAX);
+    break;
+  case RO_LDV:
+    x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), frameWord(inst->p, inst->b));
+    genStore(inst->a, RAX);
+    break;
+  case RO_STV:
+    genLoad(RCX, inst->a);
+    x86Alu(emitter, X86_MOV, 4, frameWord(inst->p, inst->b), x86Reg(RCX));
+    break;
+  case RO_LDI:
+    genLoad(RAX, inst->b);
+    x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), x86MemIndex(STACK, RAX, sizeof(WORD), 0));
+    genStore(inst->a, RAX);
+    break;
+  case RO_STI:
+    genLoad(RAX, inst->a);
+    genLoad(RCX, inst->b);
+    x86Alu(emitter, X86_MOV, 4, x86MemIndex(STACK, RAX, sizeof(WORD), 0), x86Reg(RCX));
+    break;
+  case RO_ADD:
+    genArithmetic(X86_ADD, inst, slot(inst->c));
+    break;
+  case RO_ADDI:
+    genArithmetic(X86_ADD, inst, x86Imm(inst->c));
+    break;
+  case RO_SUB:
+    genArithmetic(X86_SUB, inst, slot(inst->c));
+    break;
+  case RO_SUBI:
+    genArithmetic(X86_SUB, inst, x86Imm(inst->c));
+    break;
+  case RO_MUL:
+    genLoad(RAX, inst->b);
+    x86Imul(emitter, 4, RAX, slot(inst->c));
+    genStore(inst->a, RAX);
+    break;
+  case RO_MULI:
+    x86ImulImm(emitter, 4, RAX, slot(inst->b), inst->c);
+    genStore(inst->a, RAX);
+    break;
+  case RO_DIV:
+    genDivision(inst);
+    break;
+  case RO_DIVI:
+    genConstantDivision(inst);
+    break;
+  case RO_NEG:
+    genLoad(RAX, inst->b);
+    x86Unary(emitter, X86_NEG, 4, x86Reg(RAX));
+    genStore(inst->a, RAX);
+    break;
+  case RO_EQ: case RO_NE: case RO_GT: case RO_LT: case RO_GE: case RO_LE:
+    genComparison(inst);
+    break;
+  case RO_J:
+    x86Jmp(emitter, labels[inst->c]);
+    break;
+  case RO_JZ:
+    x86Alu(emitter, X86_CMP, 4, slot(inst->a), x86Imm(0));
+    x86Jcc(emitter, CC_E, labels[inst->c]);
+    break;
+  case RO_JEQ: case RO_JNE: case RO_JGT: case RO_JLT: case RO_JGE: case RO_JLE:
+    genLoad(RAX, inst->a);
+    x86Alu(emitter, X86_CMP, 4, x86Reg(RAX), slot(inst->b));
+    x86Jcc(emitter, comparisonCond(inst->op - RO_JEQ), labels[inst->c]);
+    break;
+  case RO_JEQI: case RO_JNEI: case RO_JGTI: case RO_JLTI: case RO_JGEI: case RO_JLEI:
+    x86Alu(emitter, X86_CMP, 4, slot(inst->a), x86Imm(inst->b));
+    x86Jcc(emitter, comparisonCond(inst->op - RO_JEQI), labels[inst->c]);
+    break;
+  case RO_CALL:
+    genCall(inst);
+    break;
+  case RO_RET:
+    x86Alu(emitter, X86_MOV, 4, x86Reg(RAX), x86Mem(FRAME, 3 * sizeof(WORD)));
+    x86Alu(emitter, X86_MOV, 4, displayEntry(inst->p), x86Reg(RAX));
+    x86Alu(emitter, X86_ADD, 8, x86Reg(RSP), x86Imm(8));
+    x86Ret(emitter);
+    break;
+  case RO_ENTER:
+    x86Lea(emitter, RAX, x86Mem(FRAME, inst->b * sizeof(WORD)));
+    x86Alu(emitter, X86_CMP, 8, x86Reg(RAX), x86Reg(LIMIT));
+    x86Jcc(emitter, CC_AE, overflowLabel);
+    break;
+  case RO_HALT:
+    x86Jmp(emitter, haltLabel);
+    break;
+  case RO_RC:
+    x86CallExternal(emitter, "kplReadChar", (void*) kplReadChar);
+    genStore(inst->a, RAX);
+    break;
+  case RO_RI:
+    x86CallExternal(emitter, "kplReadInt", (void*) kplReadInt);
+    genStore(inst->a, RAX);
+    break;
+  case RO_WRC:
+    genLoad(RDI, inst->a);
+    x86CallExternal(emitter, "kplWriteChar", (void*) kplWriteChar);
+    break;
+  case RO_WRI:
+    genLoad(RDI, inst->a);
+    x86CallExternal(emitter, "kplWriteInt", (void*) kplWriteInt);
+    break;
+  case RO_WLN:
+    x86CallExternal(emitter, "kplWriteLn", (void*) kplWriteLn);
+    break;
+  case RO_CHK:
+    // Unsigned, so that negative indexes are above the size too
+    x86Alu(emitter, X86_CMP, 4, slot(inst->a), x86Imm(inst->b));
+    x86Jcc(emitter, CC_AE, indexLabel);
+    break;
+  }
+}
+
+/* The machine stack is kept 16-byte aligned inside KPL code, so that the
+ * runtime can be called from anywhere: the entry pushes three registers
+ * and every routine reserves 8 bytes above its return address. */
+void genNativeCode(RegCodeBlock* regCode, X86Emitter* e) {
+  char comment[MAX_IDENT_LEN + 8];
+  int i, r;
+
+  emitter = e;
+  labels = (X86Label*) malloc((regCode->codeSize + 1) * sizeof(X86Label));
+  for (i = 0; i <= regCode->codeSize; i++)
+    labels[i] = x86NewLabel(e);
+  haltLabel = x86NewLabel(e);
+  divisionLabel = x86NewLabel(e);
+  indexLabel = x86NewLabel(e);
+  overflowLabel = x86NewLabel(e);
+
+  x86Push(e, FRAME);
+  x86Push(e, STACK);
+  x86Push(e, LIMIT);
+  x86Alu(e, X86_MOV, 8, x86Reg(STACK), x86Reg(RDI));
+  x86Alu(e, X86_MOV, 8, x86Reg(FRAME), x86Reg(RDI));
+  x86Alu(e, X86_MOV, 8, x86Reg(LIMIT), x86Reg(RSI));
+  x86Alu(e, X86_MOV, 4, displayEntry(0), x86Imm(0));
+
+  for (i = 0; i < regCode->codeSize; i++) {
+    x86PlaceLabel(e, labels[i]);
+    for (r = 0; r < regCode->routineCount; r++)
+      if (regCode->routines[r].entry == i) {
+        sprintf(comment, "# %s", regCode->routines[r].name);
+        x86Directive(e, comment);
+        if (regCode->routines[r].kind != RT_PROGRAM)
+          x86Alu(e, X86_SUB, 8, x86Reg(RSP), x86Imm(8));
+      }
+    genInstruction(&(regCode->code[i]));
+  }
+  x86PlaceLabel(e, labels[regCode->codeSize]);
+
+  x86PlaceLabel(e, haltLabel);
+  x86Pop(e, LIMIT);
+  x86Pop(e, STACK);
+  x86Pop(e, FRAME);
+  x86Ret(e);
+
+  x86PlaceLabel(e, divisionLabel);
+  x86CallExternal(e, "kplDivisionByZero", (void*) kplDivisionByZero);
+  x86PlaceLabel(e, indexLabel);
+  x86CallExternal(e, "kplIndexOutOfRange", (void*) kplIndexOutOfRange);
+  x86PlaceLabel(e, overflowLabel);
+  x86CallExternal(e, "kplStackOverflow", (void*) kplStackOverflow);
+
+  free(labels);
+}
+
+/* Writes the program as GNU as source. Link it with the runtime:
+ *   gcc program.s kplrt.c -o program */
+int saveAssembly(RegCodeBlock* regCode, char* fileName) {
+  FILE* f = fopen(fileName, "w");
+  int display = displaySize(regCode->routines, regCode->routineCount) * sizeof(WORD);
+  X86Emitter* e;
+
+  if (f == NULL)
+    return IO_ERROR;
+
+  e = createTextEmitter(f);
+  fprintf(f, "\t.text\n");
+  fprintf(f, "kplProgram:\n");
+  genNativeCode(regCode, e);
+  fprintf(f, "\n\t.globl\tmain\n");
+  fprintf(f, "main:\n");
+  fprintf(f, "\tleaq\tkplStack+%d(%%rip), %%rdi\n", display);
+  fprintf(f, "\tleaq\tkplStack+%d(%%rip), %%rsi\n", display + (int) (NATIVE_STACK_SIZE * sizeof(WORD)));
+  fprintf(f, "\tsubq\t$8, %%rsp\n");
+  fprintf(f, "\tcall\tkplProgram\n");
+  fprintf(f, "\taddq\t$8, %%rsp\n");
+  fprintf(f, "\txorl\t%%eax, %%eax\n");
+  fprintf(f, "\tret\n");
+  fprintf(f, "\n\t.lcomm\tkplStack, %d\n", display + (int) ((NATIVE_STACK_SIZE + NATIVE_STACK_SLACK) * sizeof(WORD)));
+  fprintf(f, "\t.section\t.note.GNU-stack,\"\",@progbits\n");
+  freeEmitter(e);
+  fclose(f);
+  return IO_SUCCESS;
+}
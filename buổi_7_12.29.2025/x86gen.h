@@ -0,0 +1,31 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __X86GEN_H__
+#define __X86GEN_H__
+
+#include "regcode.h"
+#include "x86emit.h"
+
+/* Native frames are laid out as in the virtual machine, one 4-byte word
+ * per slot, on a KPL stack apart from the machine stack. r13 holds the
+ * bottom of the KPL stack, r12 the current frame and r14 the stack limit.
+ * Addresses are word indices from r13, so VAR parameters and frame
+ * bases have the same values as in the VM. The display, one word per
+ * nesting level, lies just below r13. Return addresses stay on the
+ * machine stack; the caller moves r12 to the new frame and back. */
+
+#define NATIVE_STACK_SIZE (1 << 20)   // words
+#define NATIVE_STACK_SLACK 4096
+
+/* The generated code starts with the entry of the program, a System V
+ * function void program(WORD* stack, WORD* limit); displaySize() words
+ * below stack belong to it too. */
+void genNativeCode(RegCodeBlock* regCode, X86Emitter* e);
+
+int saveAssembly(RegCodeBlock* regCode, char* fileName);
+
+#endif